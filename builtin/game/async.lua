@@ -20,3 +20,27 @@ function core.handle_async(func, callback, ...)
 	return true
 end
 
+
+core.path_jobs = {}
+
+function core.path_event_handler(jobid, path)
+	local job = core.path_jobs[jobid]
+	assert(job)
+	core.path_jobs[jobid] = nil
+	core.set_last_run_mod(job.mod_origin)
+	job.callback(path)
+end
+
+function core.find_path_async(pos1, pos2, searchdistance, max_jump, max_drop,
+		algorithm, callback)
+	assert(type(callback) == "function",
+		"Invalid minetest.find_path_async invocation")
+	local jobid = core.queue_find_path(pos1, pos2, searchdistance, max_jump,
+		max_drop, algorithm)
+	core.path_jobs[jobid] = {
+		callback = callback,
+		mod_origin = core.get_last_run_mod(),
+	}
+
+	return true
+end
@@ -0,0 +1,164 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "collision.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "environment.h"
+#include "noise.h"
+#include "server/activeobjectmgr.h"
+#include "server/serveractiveobject.h"
+#include <memory>
+#include <vector>
+
+class CollisionBenchEnvironment : public Environment
+{
+public:
+	CollisionBenchEnvironment(IGameDef *gamedef, Map *map) :
+		Environment(gamedef), m_map(map) {}
+
+	void step(f32 dtime) override {}
+	Map &getMap() override { return *m_map; }
+	void getSelectedActiveObjects(const core::line3d<f32> &shootline_on_map,
+			std::vector<PointedThing> &objects) override {}
+
+private:
+	Map *m_map;
+};
+
+class CollisionBenchObject : public ServerActiveObject
+{
+public:
+	CollisionBenchObject(const v3f &p) : ServerActiveObject(nullptr, p) {}
+
+	ActiveObjectType getType() const override { return ACTIVEOBJECT_TYPE_TEST; }
+	bool getCollisionBox(aabb3f *toset) const override { return false; }
+	bool getSelectionBox(aabb3f *toset) const override { return false; }
+	bool collideWithObjects() const override { return false; }
+};
+
+// One step of an entity as it was moving, replayed through the collision code
+struct EntityMotion
+{
+	v3f pos;
+	v3f speed;
+};
+
+TEST_CASE("benchmark_collision")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t c_stone, c_slab;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, f);
+	}
+	{
+		ContentFeatures f;
+		f.name = "slab";
+		f.drawtype = NDT_NODEBOX;
+		f.node_box.type = NODEBOX_FIXED;
+		f.node_box.fixed.emplace_back(-BS / 2, -BS / 2, -BS / 2, BS / 2, 0, BS / 2);
+		c_slab = ndef->set(f.name, f);
+	}
+
+	// Uneven ground with some slabs on it
+	v3s16 bpmin(-2, -1, -2), bpmax(1, 0, 1);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	PcgRandom pr(1234);
+	v3s16 nmin = bpmin * MAP_BLOCKSIZE;
+	v3s16 nmax = (bpmax + 1) * MAP_BLOCKSIZE - 1;
+	for (s16 z = nmin.Z; z <= nmax.Z; z++)
+	for (s16 x = nmin.X; x <= nmax.X; x++) {
+		s16 height = pr.range(-2, 1);
+		for (s16 y = nmin.Y; y <= nmax.Y; y++) {
+			content_t c = CONTENT_AIR;
+			if (y < height)
+				c = c_stone;
+			else if (y == height && pr.range(0, 7) == 0)
+				c = c_slab;
+			map.setNode(v3s16(x, y, z), MapNode(c));
+		}
+	}
+
+	CollisionBenchEnvironment env(&gamedef, &map);
+
+	// Entities walking and falling around, recorded at the server step rate
+	const f32 dtime = 0.09f;
+	const v3f gravity(0, -9.81f * BS, 0);
+	const aabb3f box(-0.3f * BS, -0.5f * BS, -0.3f * BS, 0.3f * BS, 1.2f * BS, 0.3f * BS);
+	std::vector<EntityMotion> motions;
+	for (int i = 0; i < 3000; i++) {
+		EntityMotion m;
+		m.pos = v3f(pr.range(nmin.X + 4, nmax.X - 4), pr.range(1, 4),
+				pr.range(nmin.Z + 4, nmax.Z - 4)) * BS;
+		m.speed = v3f(pr.range(-40, 40), pr.range(-20, 5), pr.range(-40, 40)) * 0.1f * BS;
+		motions.push_back(m);
+	}
+
+	BENCHMARK("collisionMoveSimple_nodes") {
+		u32 collisions = 0;
+		for (const EntityMotion &m : motions) {
+			v3f pos = m.pos, speed = m.speed;
+			collisionMoveResult r = collisionMoveSimple(&env, &gamedef, BS * 0.25f,
+					box, 0.6f * BS, dtime, &pos, &speed, gravity, nullptr, false);
+			collisions += r.collisions.size();
+		}
+		return collisions;
+	};
+
+	// Objects around each of the entities, as collisionMoveSimple looks for them
+	server::ActiveObjectMgr saomgr;
+	std::vector<ServerActiveObject *> objects;
+	for (const EntityMotion &m : motions) {
+		auto obj = std::make_unique<CollisionBenchObject>(m.pos);
+		objects.push_back(obj.get());
+		saomgr.registerObject(std::move(obj));
+	}
+	const f32 radius = 3.0f * BS;
+
+	BENCHMARK("getObjectsInsideRadius") {
+		size_t found = 0;
+		std::vector<ServerActiveObject *> result;
+		for (ServerActiveObject *obj : objects) {
+			result.clear();
+			saomgr.getObjectsInsideRadius(obj->getBasePosition(), radius, result, nullptr);
+			found += result.size();
+		}
+		return found;
+	};
+
+	// The spatial index must find exactly what checking every object finds
+	for (size_t i = 0; i < objects.size(); i += 97) {
+		v3f pos = objects[i]->getBasePosition();
+		std::vector<ServerActiveObject *> result;
+		saomgr.getObjectsInsideRadius(pos, radius, result, nullptr);
+		size_t expected = 0;
+		for (ServerActiveObject *obj : objects) {
+			if (obj->getBasePosition().getDistanceFromSQ(pos) <= radius * radius)
+				expected++;
+		}
+		CHECK(result.size() == expected);
+	}
+
+	saomgr.clear();
+}
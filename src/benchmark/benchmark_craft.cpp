@@ -0,0 +1,95 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "craftdef.h"
+#include "dummygamedef.h"
+#include "inventory.h"
+#include "itemdef.h"
+#include "noise.h"
+#include <vector>
+
+TEST_CASE("benchmark_craft")
+{
+	DummyGameDef gamedef;
+	IWritableItemDefManager *idef =
+		static_cast<IWritableItemDefManager *>(gamedef.getItemDefManager());
+	IWritableCraftDefManager *cdef =
+		static_cast<IWritableCraftDefManager *>(gamedef.getCraftDefManager());
+
+	// Items in a few groups each, like the wood and stone variants of a game
+	const int item_count = 500, group_count = 40;
+	PcgRandom pr(42);
+	for (int i = 0; i < item_count; i++) {
+		ItemDefinition def;
+		def.type = ITEM_CRAFT;
+		def.name = "bench:item_" + std::to_string(i);
+		for (int g = 0; g < 3; g++)
+			def.groups["bench_" + std::to_string(pr.range(0, group_count - 1))] = 1;
+		idef->registerItem(def);
+	}
+	auto item = [](int i) { return "bench:item_" + std::to_string(i); };
+	auto group = [](int g) { return "group:bench_" + std::to_string(g); };
+
+	// Many recipes with groups have the same number of items
+	for (int i = 0; i < 2000; i++) {
+		std::vector<std::string> recipe;
+		recipe.push_back(group(pr.range(0, group_count - 1)));
+		recipe.push_back(group(pr.range(0, group_count - 1)));
+		recipe.push_back(pr.range(0, 1) ? item(pr.range(0, item_count - 1)) :
+				group(pr.range(0, group_count - 1)));
+		if (i % 2)
+			cdef->registerCraft(new CraftDefinitionShapeless(item(i % item_count),
+					recipe, CraftReplacements{}), &gamedef);
+		else
+			cdef->registerCraft(new CraftDefinitionShaped(item(i % item_count),
+					3, recipe, CraftReplacements{}), &gamedef);
+	}
+	// And the plain recipes
+	for (int i = 0; i < 2000; i++) {
+		std::vector<std::string> recipe;
+		for (int j = 0; j < 4; j++)
+			recipe.push_back(item(pr.range(0, item_count - 1)));
+		cdef->registerCraft(new CraftDefinitionShapeless(item(i % item_count),
+				recipe, CraftReplacements{}), &gamedef);
+	}
+	cdef->initHashes(&gamedef);
+
+	// What players put into the craft grid, mostly without a result
+	std::vector<CraftInput> inputs;
+	for (int i = 0; i < 200; i++) {
+		CraftInput input;
+		input.method = CRAFT_METHOD_NORMAL;
+		input.width = 3;
+		input.items.resize(9);
+		int count = pr.range(1, 4);
+		for (int j = 0; j < count; j++)
+			input.items[j].deSerialize(item(pr.range(0, item_count - 1)), idef);
+		inputs.push_back(input);
+	}
+
+	BENCHMARK("getCraftResult") {
+		u32 found = 0;
+		CraftOutput output;
+		std::vector<ItemStack> replacements;
+		for (CraftInput &input : inputs)
+			found += cdef->getCraftResult(input, output, replacements, false, &gamedef);
+		return found;
+	};
+}
@@ -0,0 +1,105 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "inventory.h"
+#include "itemdef.h"
+#include "noise.h"
+#include <memory>
+#include <sstream>
+
+TEST_CASE("benchmark_inventory")
+{
+	std::unique_ptr<IWritableItemDefManager> idef(createItemDefManager());
+	const int item_count = 50;
+	for (int i = 0; i < item_count; i++) {
+		ItemDefinition def;
+		def.type = ITEM_CRAFT;
+		def.name = "bench:item_" + std::to_string(i);
+		def.stack_max = 99;
+		idef->registerItem(def);
+	}
+
+	// A large chest of partial stacks, some of them with metadata
+	const u32 list_size = 8 * 16;
+	Inventory inv(idef.get());
+	InventoryList *chest = inv.addList("chest", list_size);
+	InventoryList *dest = inv.addList("dest", list_size);
+	PcgRandom pr(42);
+	for (u32 i = 0; i < list_size; i++) {
+		ItemStack item("bench:item_" + std::to_string(pr.range(0, item_count - 1)),
+				pr.range(1, 60), 0, idef.get());
+		if (pr.range(0, 7) == 0)
+			item.metadata.setString("description", "Item #" + std::to_string(i));
+		chest->changeItem(i, item);
+	}
+
+	BENCHMARK("InventoryList_moveItemSomewhere") {
+		// Sort everything into the other list and back, like a sorting mod
+		for (u32 i = 0; i < list_size; i++)
+			chest->moveItemSomewhere(i, dest, 0);
+		for (u32 i = 0; i < list_size; i++)
+			dest->moveItemSomewhere(i, chest, 0);
+		return chest->getUsedSlots();
+	};
+
+	BENCHMARK("InventoryList_moveItem") {
+		// Move single items back and forth, like a hopper
+		u32 moved = 0;
+		for (u32 i = 0; i < list_size; i++)
+			moved += chest->moveItem(i, dest, i, 1);
+		for (u32 i = 0; i < list_size; i++)
+			moved += dest->moveItem(i, chest, i, 0);
+		return moved;
+	};
+
+	BENCHMARK("InventoryList_copy_compare") {
+		InventoryList copy(*chest);
+		return copy == *chest;
+	};
+
+	std::string serialized;
+	{
+		std::ostringstream os(std::ios::binary);
+		inv.serialize(os);
+		serialized = os.str();
+	}
+
+	BENCHMARK("Inventory_serialize") {
+		std::ostringstream os(std::ios::binary);
+		inv.serialize(os);
+		return os.str().size();
+	};
+
+	BENCHMARK("Inventory_deSerialize") {
+		Inventory inv2(idef.get());
+		std::istringstream is(serialized, std::ios::binary);
+		inv2.deSerialize(is);
+		return inv2.getLists().size();
+	};
+
+	// The wire and disk format stays the same
+	Inventory inv2(idef.get());
+	std::istringstream is(serialized, std::ios::binary);
+	inv2.deSerialize(is);
+	CHECK(inv2 == inv);
+	std::ostringstream os(std::ios::binary);
+	inv2.serialize(os);
+	CHECK(os.str() == serialized);
+}
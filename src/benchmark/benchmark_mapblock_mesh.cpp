@@ -0,0 +1,425 @@
+/*
+Minetest
+Copyright (C) 2024 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "client/content_mapblock.h"
+#include "client/mapblock_mesh.h"
+#include "client/meshgen/collector.h"
+#include "database/database-sqlite3.h"
+#include "dummygamedef.h"
+#include "exceptions.h"
+#include "mapblock.h"
+#include "serialization.h"
+#include "settings.h"
+#include "util/directiontables.h"
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <set>
+#include <sstream>
+
+/*
+	Mesh generation only depends on node definitions and node data, so these
+	benchmarks run without a Client, a window or a video driver.
+	Set MINETEST_BENCHMARK_WORLD to a world directory (sqlite3 backend) to
+	also mesh real blocks from that world.
+*/
+
+static const char *const world_env_var = "MINETEST_BENCHMARK_WORLD";
+
+static void setTiles(ContentFeatures &f, u32 texture_id,
+		u8 material_type = TILE_MATERIAL_BASIC)
+{
+	for (TileSpec &tile : f.tiles) {
+		tile.layers[0].texture_id = texture_id;
+		tile.layers[0].material_type = material_type;
+	}
+}
+
+struct MeshBenchNodes
+{
+	content_t stone, dirt, glass, leaves, plant, slab;
+};
+
+static MeshBenchNodes registerNodes(NodeDefManager *ndef)
+{
+	MeshBenchNodes c;
+	u32 texture_id = 1;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		setTiles(f, texture_id++);
+		c.stone = ndef->set(f.name, f);
+	}
+	{
+		ContentFeatures f;
+		f.name = "dirt";
+		setTiles(f, texture_id++);
+		c.dirt = ndef->set(f.name, f);
+	}
+	{
+		ContentFeatures f;
+		f.name = "glass";
+		f.drawtype = NDT_GLASSLIKE;
+		f.param_type = CPT_LIGHT;
+		f.light_propagates = true;
+		f.sunlight_propagates = true;
+		f.solidness = 0;
+		f.visual_solidness = 1;
+		setTiles(f, texture_id++, TILE_MATERIAL_ALPHA);
+		c.glass = ndef->set(f.name, f);
+	}
+	{
+		ContentFeatures f;
+		f.name = "leaves";
+		f.drawtype = NDT_ALLFACES;
+		f.param_type = CPT_LIGHT;
+		f.light_propagates = true;
+		f.solidness = 0;
+		f.visual_solidness = 1;
+		setTiles(f, texture_id++);
+		c.leaves = ndef->set(f.name, f);
+	}
+	{
+		ContentFeatures f;
+		f.name = "plant";
+		f.drawtype = NDT_PLANTLIKE;
+		f.param_type = CPT_LIGHT;
+		f.light_propagates = true;
+		f.sunlight_propagates = true;
+		f.walkable = false;
+		f.solidness = 0;
+		setTiles(f, texture_id++);
+		c.plant = ndef->set(f.name, f);
+	}
+	{
+		ContentFeatures f;
+		f.name = "slab";
+		f.drawtype = NDT_NODEBOX;
+		f.param_type = CPT_LIGHT;
+		f.light_propagates = true;
+		f.solidness = 0;
+		f.node_box.type = NODEBOX_FIXED;
+		f.node_box.fixed.emplace_back(-BS / 2, -BS / 2, -BS / 2, BS / 2, 0, BS / 2);
+		setTiles(f, texture_id++);
+		c.slab = ndef->set(f.name, f);
+	}
+	return c;
+}
+
+// Fills the block at (0,0,0) and its neighbors from a generator function
+// taking node positions relative to that block
+static void fillMeshMakeData(MeshMakeData &data, const std::function<MapNode(v3s16)> &gen)
+{
+	data.fillBlockDataBegin(v3s16(0, 0, 0));
+	std::vector<MapNode> nodes(MapBlock::nodecount);
+	v3s16 bp;
+	for (bp.Z = -1; bp.Z <= 1; bp.Z++)
+	for (bp.Y = -1; bp.Y <= 1; bp.Y++)
+	for (bp.X = -1; bp.X <= 1; bp.X++) {
+		for (u32 i = 0; i < MapBlock::nodecount; i++) {
+			v3s16 p(i % MAP_BLOCKSIZE, (i / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+					i / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+			nodes[i] = gen(bp * MAP_BLOCKSIZE + p);
+		}
+		data.fillBlockData(bp, nodes.data());
+	}
+}
+
+static void generateMesh(MeshMakeData &data, MeshCollector &collector)
+{
+	MapblockMeshGenerator(&data, &collector, nullptr).generate();
+}
+
+static u32 countVertices(const MeshCollector &collector)
+{
+	u32 count = 0;
+	for (const auto &prebuffers : collector.prebuffers)
+		for (const PreMeshBuffer &p : prebuffers)
+			count += p.vertices.size();
+	return count;
+}
+
+static u32 generateMesh(MeshMakeData &data)
+{
+	MeshCollector collector(v3f(0.0f));
+	generateMesh(data, collector);
+	return countVertices(collector);
+}
+
+// Simple deterministic terrain height
+static s16 terrainHeight(s16 x, s16 z)
+{
+	u32 h = ((u32)x * 73856093U) ^ ((u32)z * 19349663U);
+	return 6 + (h >> 7) % 4;
+}
+
+static void benchmarkScene(const char *name, const NodeDefManager *ndef,
+		const std::function<MapNode(v3s16)> &gen)
+{
+	MeshMakeData data(ndef, MAP_BLOCKSIZE, true);
+	fillMeshMakeData(data, gen);
+
+	const std::string prefix = std::string("MapblockMeshGenerator_") + name;
+	data.setSmoothLighting(false);
+	BENCHMARK(prefix + "_flat") {
+		return generateMesh(data);
+	};
+	data.setSmoothLighting(true);
+	BENCHMARK(prefix + "_smooth") {
+		return generateMesh(data);
+	};
+}
+
+TEST_CASE("benchmark_mapblock_mesh")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	const MeshBenchNodes c = registerNodes(ndef);
+
+	const MapNode air(CONTENT_AIR, LIGHT_SUN);
+
+	auto flat_terrain = [&] (v3s16 p) {
+		if (p.Y < 8)
+			return MapNode(p.Y < 6 ? c.stone : c.dirt);
+		return air;
+	};
+	auto hilly_terrain = [&] (v3s16 p) {
+		s16 h = terrainHeight(p.X, p.Z);
+		if (p.Y < h)
+			return MapNode(p.Y < h - 1 ? c.stone : c.dirt);
+		return air;
+	};
+
+	SECTION("drawtypes") {
+		benchmarkScene("flat_terrain", ndef, flat_terrain);
+		benchmarkScene("hilly_terrain", ndef, hilly_terrain);
+		benchmarkScene("plants", ndef, [&] (v3s16 p) {
+			if (p.Y == 8 && (p.X + p.Z) % 2 == 0)
+				return MapNode(c.plant, LIGHT_SUN);
+			return flat_terrain(p);
+		});
+		benchmarkScene("nodeboxes", ndef, [&] (v3s16 p) {
+			if (p.Y == 8 && (p.X ^ p.Z) % 3 == 0)
+				return MapNode(c.slab, LIGHT_SUN);
+			return flat_terrain(p);
+		});
+		benchmarkScene("leaves", ndef, [&] (v3s16 p) {
+			if (p.Y >= 8 && (p.X * 7 + p.Y * 3 + p.Z) % 5 != 0)
+				return MapNode(c.leaves, LIGHT_SUN);
+			return flat_terrain(p);
+		});
+		benchmarkScene("glass", ndef, [&] (v3s16 p) {
+			if ((p.X + p.Y + p.Z) % 2 == 0)
+				return MapNode(c.glass, LIGHT_SUN);
+			return air;
+		});
+	}
+
+	SECTION("greedy meshing") {
+		const bool greedy_old = g_settings->getBool("enable_greedy_meshing");
+		for (bool smooth : {false, true}) {
+			MeshMakeData data(ndef, MAP_BLOCKSIZE, true);
+			fillMeshMakeData(data, hilly_terrain);
+			data.setSmoothLighting(smooth);
+			const std::string suffix = smooth ? "_smooth" : "_flat";
+
+			g_settings->setBool("enable_greedy_meshing", false);
+			u32 vertices_plain = generateMesh(data);
+			BENCHMARK("MapblockMeshGenerator_hilly_terrain_plain" + suffix) {
+				return generateMesh(data);
+			};
+
+			g_settings->setBool("enable_greedy_meshing", true);
+			u32 vertices_greedy = generateMesh(data);
+			BENCHMARK("MapblockMeshGenerator_hilly_terrain_greedy" + suffix) {
+				return generateMesh(data);
+			};
+
+			WARN("hilly terrain" << suffix << ": " << vertices_plain
+					<< " vertices, " << vertices_greedy << " with greedy meshing");
+			CHECK(vertices_greedy <= vertices_plain);
+		}
+		g_settings->setBool("enable_greedy_meshing", greedy_old);
+	}
+
+	SECTION("smooth lighting") {
+		MeshMakeData data(ndef, MAP_BLOCKSIZE, true);
+		fillMeshMakeData(data, hilly_terrain);
+		data.setSmoothLighting(true);
+
+		BENCHMARK("getSmoothLightSolid") {
+			u32 sum = 0;
+			v3s16 p;
+			for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+			for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+			for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+				sum += getSmoothLightSolid(p, v3s16(0, 1, 0), v3s16(1, 1, 1), &data);
+			return sum;
+		};
+
+		// As used during mesh generation, where each corner is shared by
+		// several faces
+		BENCHMARK("getSmoothLightSolid_all_faces_cached") {
+			data.resetSmoothLightCache();
+			u32 sum = 0;
+			v3s16 p;
+			for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+			for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+			for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+			for (const v3s16 &dir : g_6dirs) {
+				v3s16 corner(dir.X ? dir.X : 1, dir.Y ? dir.Y : 1, dir.Z ? dir.Z : 1);
+				sum += getSmoothLightSolid(p, dir, corner, &data);
+			}
+			data.m_smooth_light_cache.clear();
+			data.m_smooth_light_known.clear();
+			return sum;
+		};
+
+		BENCHMARK("getSmoothLightTransparent") {
+			u32 sum = 0;
+			v3s16 p;
+			for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+			for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+			for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++)
+				sum += getSmoothLightTransparent(p, v3s16(1, 1, 1), &data);
+			return sum;
+		};
+	}
+
+	SECTION("bsp tree") {
+		MeshMakeData data(ndef, MAP_BLOCKSIZE, true);
+		fillMeshMakeData(data, [&] (v3s16 p) {
+			if ((p.X + p.Y + p.Z) % 2 == 0)
+				return MapNode(c.glass, LIGHT_SUN);
+			return air;
+		});
+		MeshCollector collector(v3f(0.0f));
+		generateMesh(data, collector);
+
+		// Same conversion as in the MapBlockMesh constructor
+		std::vector<scene::SMeshBuffer *> buffers;
+		std::vector<MeshTriangle> triangles;
+		for (const auto &prebuffers : collector.prebuffers) {
+			for (const PreMeshBuffer &p : prebuffers) {
+				if (!p.layer.isTransparent())
+					continue;
+				auto *buf = new scene::SMeshBuffer();
+				buf->append(&p.vertices[0], p.vertices.size(), nullptr, 0);
+				buffers.push_back(buf);
+				MeshTriangle t;
+				t.buffer = buf;
+				for (u32 i = 0; i < p.indices.size(); i += 3) {
+					t.p1 = p.indices[i];
+					t.p2 = p.indices[i + 1];
+					t.p3 = p.indices[i + 2];
+					t.updateAttributes();
+					triangles.push_back(t);
+				}
+			}
+		}
+		REQUIRE(!triangles.empty());
+
+		BENCHMARK("MapBlockBspTree::buildTree") {
+			MapBlockBspTree tree;
+			tree.buildTree(&triangles, data.side_length);
+			std::vector<s32> output;
+			tree.traverse(v3f(0.0f), output);
+			return output.size();
+		};
+
+		for (auto *buf : buffers)
+			buf->drop();
+	}
+
+	SECTION("world blocks") {
+		const char *world_path = std::getenv(world_env_var);
+		if (!world_path || !*world_path) {
+			WARN(world_env_var << " not set, skipping real world blocks");
+			return;
+		}
+
+		MapDatabaseSQLite3 db(world_path);
+		std::vector<v3s16> positions;
+		db.listAllLoadableBlocks(positions);
+		if (positions.size() > 64)
+			positions.resize(64);
+
+		std::set<content_t> contents;
+		auto load_block = [&] (v3s16 bp, MapBlock &block) -> bool {
+			std::string blob;
+			db.loadBlock(bp, &blob);
+			if (blob.empty())
+				return false;
+			try {
+				std::istringstream is(blob, std::ios_base::binary);
+				u8 version = SER_FMT_VER_INVALID;
+				is.read((char *)&version, 1);
+				block.deSerialize(is, version, true);
+			} catch (SerializationError &e) {
+				return false;
+			}
+			return true;
+		};
+
+		std::vector<std::unique_ptr<MeshMakeData>> blocks;
+		std::vector<MapNode> ignore(MapBlock::nodecount, MapNode(CONTENT_IGNORE));
+		for (v3s16 pos : positions) {
+			auto data = std::make_unique<MeshMakeData>(ndef, MAP_BLOCKSIZE, true);
+			data->fillBlockDataBegin(pos);
+			v3s16 ofs;
+			for (ofs.Z = -1; ofs.Z <= 1; ofs.Z++)
+			for (ofs.Y = -1; ofs.Y <= 1; ofs.Y++)
+			for (ofs.X = -1; ofs.X <= 1; ofs.X++) {
+				MapBlock block(pos + ofs, &gamedef);
+				if (!load_block(pos + ofs, block)) {
+					data->fillBlockData(pos + ofs, ignore.data());
+					continue;
+				}
+				for (u32 i = 0; i < MapBlock::nodecount; i++)
+					contents.insert(block.getData()[i].getContent());
+				data->fillBlockData(pos + ofs, block.getData());
+			}
+			blocks.push_back(std::move(data));
+		}
+
+		// Nodes of the world are unknown here and get allocated as solid dummy
+		// nodes, give them a texture so they are actually meshed.
+		for (content_t id : contents) {
+			const ContentFeatures &f = ndef->get(id);
+			if (id == CONTENT_AIR || id == CONTENT_IGNORE || f.tiles[0].layers[0].texture_id)
+				continue;
+			ContentFeatures f2 = f;
+			setTiles(f2, 100 + id);
+			ndef->set(f2.name, f2);
+		}
+
+		for (bool smooth : {false, true}) {
+			for (auto &data : blocks)
+				data->setSmoothLighting(smooth);
+			BENCHMARK(std::string("MapblockMeshGenerator_world_") +
+					(smooth ? "smooth" : "flat")) {
+				u32 vertices = 0;
+				for (auto &data : blocks)
+					vertices += generateMesh(*data);
+				return vertices;
+			};
+		}
+	}
+}
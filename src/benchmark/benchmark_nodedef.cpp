@@ -0,0 +1,86 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark_setup.h"
+#include "nodedef.h"
+#include "noise.h"
+#include <memory>
+#include <vector>
+
+// Scans a set of nodes like the hot loops (collision, liquid transformation,
+// mesh generation) do: few properties, many different content types
+TEST_CASE("benchmark_nodedef")
+{
+	// Too large for the stack
+	std::unique_ptr<NodeDefManager> ndef_ptr(createNodeDefManager());
+	NodeDefManager &ndef = *ndef_ptr;
+
+	// Register enough nodes that their ContentFeatures do not fit the cache
+	const u32 num_nodes = 2000;
+	std::vector<content_t> ids;
+	for (u32 i = 0; i < num_nodes; i++) {
+		ContentFeatures f;
+		f.name = "benchmark:node_" + std::to_string(i);
+		f.walkable = i % 3 != 0;
+		f.liquid_type = i % 7 == 0 ? LIQUID_SOURCE : LIQUID_NONE;
+		f.floodable = i % 5 == 0;
+		f.groups["cracky"] = 3;
+		f.groups["bouncy"] = i % 10;
+		ids.push_back(ndef.set(f.name, f));
+	}
+
+	// Random nodes, roughly as many as two map blocks of varied terrain
+	PcgRandom pr(1234);
+	std::vector<MapNode> nodes(2 * MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE);
+	for (MapNode &n : nodes)
+		n = MapNode(ids[pr.range(0, num_nodes - 1)]);
+
+	BENCHMARK("ContentFeatures_walkable_liquid") {
+		u32 count = 0;
+		for (const MapNode &n : nodes) {
+			const ContentFeatures &f = ndef.get(n);
+			if (f.walkable)
+				count++;
+			if (f.liquid_type == LIQUID_NONE && f.floodable)
+				count++;
+		}
+		return count;
+	};
+
+	BENCHMARK("ContentHotProperties_walkable_liquid") {
+		u32 count = 0;
+		for (const MapNode &n : nodes) {
+			const ContentHotProperties props = ndef.getHotProperties(n);
+			if (props.walkable)
+				count++;
+			if (props.getLiquidType() == LIQUID_NONE && props.floodable)
+				count++;
+		}
+		return count;
+	};
+
+	// Both ways must agree
+	for (content_t id : ids) {
+		const ContentFeatures &f = ndef.get(id);
+		const ContentHotProperties props = ndef.getHotProperties(id);
+		CHECK(props.walkable == f.walkable);
+		CHECK(props.floodable == f.floodable);
+		CHECK(props.getLiquidType() == f.liquid_type);
+	}
+}
@@ -453,9 +453,11 @@ void Client::step(float dtime)
 		Run Map's timers and unload unused data
 	*/
 	const float map_timer_and_unload_dtime = 5.25;
-	if(m_map_timer_and_unload_interval.step(dtime, map_timer_and_unload_dtime)) {
+	bool map_timer_due = m_map_timer_and_unload_interval.step(dtime,
+			map_timer_and_unload_dtime);
+	if (map_timer_due || m_env.getMap().isSweepInProgress()) {
 		std::vector<v3s16> deleted_blocks;
-		m_env.getMap().timerUpdate(map_timer_and_unload_dtime,
+		m_env.getMap().timerUpdate(map_timer_due ? map_timer_and_unload_dtime : 0.0f,
 			std::max(g_settings->getFloat("client_unload_unused_data_timeout"), 0.0f),
 			g_settings->getS32("client_mapblock_limit"),
 			&deleted_blocks);
@@ -585,6 +587,8 @@ void Client::step(float dtime)
 				delete block->mesh;
 				block->mesh = nullptr;
 				block->solid_sides = r.solid_sides;
+				// New geometry may hide or reveal the blocks behind it
+				m_env.getClientMap().invalidateOcclusionCache(r.p);
 
 				if (r.mesh) {
 					minimap_mapblocks = r.mesh->moveMinimapMapblocks();
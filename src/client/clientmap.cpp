@@ -283,10 +283,10 @@ void ClientMap::updateDrawList()
 
 	MeshGrid mesh_grid = m_client->getMeshGrid();
 
+	updateOcclusionCache(mesh_grid.cell_size);
+
 	// No occlusion culling when free_move is on and camera is inside ground
-	// No occlusion culling for chunk sizes of 4 and above
-	//   because the current occlusion culling test is highly inefficient at these sizes
-	bool occlusion_culling_enabled = mesh_grid.cell_size < 4;
+	bool occlusion_culling_enabled = true;
 	if (m_control.allow_noclip) {
 		MapNode n = getNode(cam_pos_nodes);
 		if (n.getContent() == CONTENT_IGNORE || m_nodedef->get(n).solidness == 2)
@@ -616,6 +616,8 @@ void ClientMap::updateDrawList()
 	}
 
 	g_profiler->avg("MapBlocks occlusion culled [#]", blocks_occlusion_culled);
+	g_profiler->avg("MapBlocks occlusion cache size [#]",
+			m_mesh_occlusion.size() + m_block_occlusion.size());
 	g_profiler->avg("MapBlocks frustum culled [#]", blocks_frustum_culled);
 	g_profiler->avg("MapBlocks drawn [#]", m_drawlist.size());
 }
@@ -1353,11 +1355,117 @@ void ClientMap::DrawDescriptor::draw(video::IVideoDriver* driver)
 	}
 }
 
+// A result stays valid while the camera has moved less than this fraction
+// of its distance to the box, i.e. while the view angle changed by less
+// than a degree. Results for boxes near the camera are only kept while the
+// camera stays at the same node.
+static constexpr f32 OCCLUSION_MAX_MOVE_RATIO = 1.0f / 64;
+
+// Results that were not used for this many draw list updates are dropped
+static constexpr u32 OCCLUSION_MAX_UNUSED_UPDATES = 16;
+
+// More replaced meshes than this drop all results instead of checking them
+static constexpr size_t OCCLUSION_MAX_CHANGES = 16;
+
+// Whether a sphere touches the line segment from a to b
+static bool sphereTouchesSegment(v3f center, f32 radius, v3f a, v3f b)
+{
+	v3f ab = b - a;
+	f32 length_sq = ab.getLengthSQ();
+	f32 t = length_sq > 0.0f ? rangelim(ab.dotProduct(center - a) / length_sq, 0.0f, 1.0f) : 0.0f;
+	return (a + ab * t - center).getLengthSQ() <= radius * radius;
+}
+
+bool ClientMap::isOcclusionResultValid(const OcclusionResult &result,
+		v3s16 center, v3s16 cam_pos_nodes)
+{
+	if (result.last_used == 0)
+		return false;
+	if (result.camera_pos == cam_pos_nodes)
+		return true;
+
+	f32 moved_sq = intToFloat(cam_pos_nodes - result.camera_pos, 1.0f).getLengthSQ();
+	f32 distance_sq = intToFloat(center - cam_pos_nodes, 1.0f).getLengthSQ();
+	return moved_sq <= distance_sq * (OCCLUSION_MAX_MOVE_RATIO * OCCLUSION_MAX_MOVE_RATIO);
+}
+
+void ClientMap::updateOcclusionCache(u16 mesh_size)
+{
+	m_occlusion_update_count++;
+
+	if (m_occlusion_changes.size() > OCCLUSION_MAX_CHANGES) {
+		m_mesh_occlusion.clear();
+		m_block_occlusion.clear();
+	} else if (!m_occlusion_changes.empty()) {
+		// A result is affected if the changed mesh is near the line from the
+		// camera it was computed for to the box it is about
+		const f32 block_radius = 0.87f * MAP_BLOCKSIZE;
+		const f32 mesh_radius = block_radius * mesh_size;
+		auto drop_affected = [&] (std::unordered_map<v3s16, OcclusionResult> &results,
+				u16 size, v3f changed_center) {
+			const f32 radius = mesh_radius + block_radius * size;
+			for (auto it = results.begin(); it != results.end();) {
+				v3f center = intToFloat(it->first * MAP_BLOCKSIZE, 1.0f) +
+						size * MAP_BLOCKSIZE * 0.5f;
+				if (sphereTouchesSegment(changed_center, radius,
+						intToFloat(it->second.camera_pos, 1.0f), center))
+					it = results.erase(it);
+				else
+					++it;
+			}
+		};
+		for (v3s16 mesh_pos : m_occlusion_changes) {
+			v3f changed_center = intToFloat(mesh_pos * MAP_BLOCKSIZE, 1.0f) +
+					mesh_size * MAP_BLOCKSIZE * 0.5f;
+			drop_affected(m_mesh_occlusion, mesh_size, changed_center);
+			drop_affected(m_block_occlusion, 1, changed_center);
+		}
+	}
+	m_occlusion_changes.clear();
+
+	if (m_occlusion_update_count % OCCLUSION_MAX_UNUSED_UPDATES != 0)
+		return;
+	auto drop_unused = [&] (std::unordered_map<v3s16, OcclusionResult> &results) {
+		for (auto it = results.begin(); it != results.end();) {
+			if (it->second.last_used + OCCLUSION_MAX_UNUSED_UPDATES < m_occlusion_update_count)
+				it = results.erase(it);
+			else
+				++it;
+		}
+	};
+	drop_unused(m_mesh_occlusion);
+	drop_unused(m_block_occlusion);
+}
+
+bool ClientMap::isBlockOccludedCached(MapBlock *block, v3s16 cam_pos_nodes)
+{
+	OcclusionResult &result = m_block_occlusion[block->getPos()];
+	v3s16 center = block->getPosRelative() + MAP_BLOCKSIZE / 2;
+	if (!isOcclusionResultValid(result, center, cam_pos_nodes)) {
+		result.occluded = isBlockOccluded(block, cam_pos_nodes);
+		result.camera_pos = cam_pos_nodes;
+	}
+	result.last_used = m_occlusion_update_count;
+	return result.occluded;
+}
+
 bool ClientMap::isMeshOccluded(MapBlock *mesh_block, u16 mesh_size, v3s16 cam_pos_nodes)
 {
 	if (mesh_size == 1)
-		return isBlockOccluded(mesh_block, cam_pos_nodes);
+		return isBlockOccludedCached(mesh_block, cam_pos_nodes);
 
+	OcclusionResult &result = m_mesh_occlusion[mesh_block->getPos()];
+	v3s16 center = mesh_block->getPosRelative() + mesh_size * MAP_BLOCKSIZE / 2;
+	if (!isOcclusionResultValid(result, center, cam_pos_nodes)) {
+		result.occluded = checkMeshOccluded(mesh_block, mesh_size, cam_pos_nodes);
+		result.camera_pos = cam_pos_nodes;
+	}
+	result.last_used = m_occlusion_update_count;
+	return result.occluded;
+}
+
+bool ClientMap::checkMeshOccluded(MapBlock *mesh_block, u16 mesh_size, v3s16 cam_pos_nodes)
+{
 	v3s16 min_edge = mesh_block->getPosRelative();
 	v3s16 max_edge = min_edge + mesh_size * MAP_BLOCKSIZE -1;
 	bool check_axis[3] = { false, false, false };
@@ -1395,7 +1503,7 @@ bool ClientMap::isMeshOccluded(MapBlock *mesh_block, u16 mesh_size, v3s16 cam_po
 				else
 					block = getBlockNoCreateNoEx(block_pos);
 
-				if (block && !isBlockOccluded(block, cam_pos_nodes))
+				if (block && !isBlockOccludedCached(block, cam_pos_nodes))
 					return false;
 			}
 		}
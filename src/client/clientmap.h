@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "camera.h"
 #include <set>
 #include <map>
+#include <unordered_map>
 
 struct MapDrawControl
 {
@@ -121,6 +122,9 @@ class ClientMap : public Map, public scene::ISceneNode
 	void updateDrawListShadow(v3f shadow_light_pos, v3f shadow_light_dir, float radius, float length);
 	// Returns true if draw list needs updating before drawing the next frame.
 	bool needsUpdateDrawList() { return m_needs_update_drawlist; }
+	// Forgets the cached occlusion results that the mesh at mesh_pos may have
+	// changed, call when a mesh has been replaced.
+	void invalidateOcclusionCache(v3s16 mesh_pos) { m_occlusion_changes.push_back(mesh_pos); }
 	void renderMap(video::IVideoDriver* driver, s32 pass);
 
 	void renderMapShadows(video::IVideoDriver *driver,
@@ -143,7 +147,31 @@ class ClientMap : public Map, public scene::ISceneNode
 protected:
 	void reportMetrics(u64 save_time_us, u32 saved_blocks, u32 all_blocks) override;
 private:
+	// Raytraced occlusion result of a mesh chunk or of a single block
+	struct OcclusionResult
+	{
+		// Camera position the result was computed for
+		v3s16 camera_pos;
+		bool occluded = false;
+		// Value of m_occlusion_update_count when the result was last used,
+		// 0 if it was never computed
+		u32 last_used = 0;
+	};
+
+	// Whether a result for a box centered at center (in nodes) can be used
+	// from cam_pos_nodes
+	static bool isOcclusionResultValid(const OcclusionResult &result,
+			v3s16 center, v3s16 cam_pos_nodes);
+	// Drops the results that the meshes passed to invalidateOcclusionCache()
+	// may have changed, and the results that were not used for a while
+	void updateOcclusionCache(u16 mesh_size);
+
+	// Like checkMeshOccluded(), but reuses the results of previous draw list updates
 	bool isMeshOccluded(MapBlock *mesh_block, u16 mesh_size, v3s16 cam_pos_nodes);
+	// Whether all blocks on the sides of the mesh chunk that face the camera are occluded
+	bool checkMeshOccluded(MapBlock *mesh_block, u16 mesh_size, v3s16 cam_pos_nodes);
+	// Like isBlockOccluded, but reuses the results of previous draw list updates
+	bool isBlockOccludedCached(MapBlock *block, v3s16 cam_pos_nodes);
 
 	// update the vertex order in transparent mesh buffers
 	void updateTransparentMeshBuffers();
@@ -209,6 +237,20 @@ class ClientMap : public Map, public scene::ISceneNode
 	std::map<v3s16, MapBlock*> m_drawlist_shadow;
 	bool m_needs_update_drawlist;
 
+	/*
+		Raytraced occlusion results, a two level hierarchy: one result per
+		mesh chunk, and below it one result per block of its near sides.
+		A chunk whose result is still valid is decided without looking at
+		its blocks. Results are kept while the camera moves, until it has
+		moved too far for them (see isOcclusionResultValid()), and a new mesh
+		only drops the results of the boxes it may hide or reveal.
+	*/
+	std::unordered_map<v3s16, OcclusionResult> m_mesh_occlusion;
+	std::unordered_map<v3s16, OcclusionResult> m_block_occlusion;
+	// Meshes replaced since the last draw list update
+	std::vector<v3s16> m_occlusion_changes;
+	u32 m_occlusion_update_count = 0;
+
 	std::set<v2s16> m_last_drawn_sectors;
 
 	bool m_cache_trilinear_filter;
@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <algorithm>
 #include <cmath>
 #include "content_mapblock.h"
 #include "util/numeric.h"
@@ -77,11 +78,12 @@ MapblockMeshGenerator::MapblockMeshGenerator(MeshMakeData *input, MeshCollector
 		scene::IMeshManipulator *mm):
 	data(input),
 	collector(output),
-	nodedef(data->m_client->ndef()),
+	nodedef(data->m_nodedef),
 	meshmanip(mm),
 	blockpos_nodes(data->m_blockpos * MAP_BLOCKSIZE),
 	enable_mesh_cache(g_settings->getBool("enable_mesh_cache") &&
-			!data->m_smooth_lighting) // Mesh cache is not supported with smooth lighting
+			!data->m_smooth_lighting), // Mesh cache is not supported with smooth lighting
+	enable_greedy_meshing(g_settings->getBool("enable_greedy_meshing"))
 {
 }
 
@@ -430,10 +432,10 @@ void MapblockMeshGenerator::drawSolidNode()
 		if (n2 == CONTENT_IGNORE)
 			continue;
 		if (n2 != CONTENT_AIR) {
-			const ContentFeatures &f2 = nodedef->get(n2);
-			if (f2.solidness == 2)
+			if (nodedef->getHotProperties(n2).solidness == 2)
 				continue;
 			if (cur_node.f->drawtype == NDT_LIQUID) {
+				const ContentFeatures &f2 = nodedef->get(n2);
 				if (cur_node.f->sameLiquidRender(f2))
 					continue;
 				backface_culling = f2.solidness || f2.visual_solidness;
@@ -453,6 +455,37 @@ void MapblockMeshGenerator::drawSolidNode()
 	}
 	if (!faces)
 		return;
+	LightPair smooth_lights[6][4];
+	if (data->m_smooth_lighting) {
+		for (int face = 0; face < 6; ++face) {
+			if (!(faces & (1 << face)))
+				continue;
+			for (int k = 0; k < 4; k++) {
+				v3s16 corner = light_dirs[light_indices[face][k]];
+				smooth_lights[face][k] = LightPair(getSmoothLightSolid(
+						blockpos_nodes + cur_node.p, tile_dirs[face], corner, data));
+			}
+		}
+	}
+	if (collect_greedy_faces && cur_node.f->drawtype == NDT_NORMAL) {
+		// Hand faces with uniform lighting over to the greedy mesher
+		for (int face = 0; face < 6; ++face) {
+			if (!(faces & (1 << face)))
+				continue;
+			if (!data->m_smooth_lighting) {
+				addGreedyFace(face, tiles[face], LightPair(lights[face]));
+			} else {
+				const LightPair *l = smooth_lights[face];
+				if ((u16)l[0] != (u16)l[1] || (u16)l[0] != (u16)l[2] ||
+						(u16)l[0] != (u16)l[3])
+					continue;
+				addGreedyFace(face, tiles[face], l[0]);
+			}
+			faces &= ~(1 << face);
+		}
+		if (!faces)
+			return;
+	}
 	u8 mask = faces ^ 0b0011'1111; // k-th bit is set if k-th face is to be *omitted*, as expected by cuboid drawing functions.
 	cur_node.origin = intToFloat(cur_node.p, BS);
 	auto box = aabb3f(v3f(-0.5 * BS), v3f(0.5 * BS));
@@ -461,17 +494,8 @@ void MapblockMeshGenerator::drawSolidNode()
 	box.MaxEdge += cur_node.origin;
 	generateCuboidTextureCoords(box, texture_coord_buf);
 	if (data->m_smooth_lighting) {
-		LightPair lights[6][4];
-		for (int face = 0; face < 6; ++face) {
-			for (int k = 0; k < 4; k++) {
-				v3s16 corner = light_dirs[light_indices[face][k]];
-				lights[face][k] = LightPair(getSmoothLightSolid(
-						blockpos_nodes + cur_node.p, tile_dirs[face], corner, data));
-			}
-		}
-
 		drawCuboid(box, tiles, 6, texture_coord_buf, mask, [&] (int face, video::S3DVertex vertices[4]) {
-			auto final_lights = lights[face];
+			auto final_lights = smooth_lights[face];
 			for (int j = 0; j < 4; j++) {
 				video::S3DVertex &vertex = vertices[j];
 				vertex.Color = encode_light(final_lights[j], cur_node.f->light_source);
@@ -496,6 +520,125 @@ void MapblockMeshGenerator::drawSolidNode()
 	}
 }
 
+// Axis along the face normal, followed by the two in-plane axes
+// (0 = X, 1 = Y, 2 = Z), indexed by face as in drawSolidNode
+static const u8 greedy_face_axes[6][3] = {
+	{1, 0, 2}, {1, 0, 2},
+	{0, 2, 1}, {0, 2, 1},
+	{2, 0, 1}, {2, 0, 1},
+};
+
+bool MapblockMeshGenerator::GreedyFace::operator==(const GreedyFace &other) const
+{
+	if (light != other.light || light_source != other.light_source ||
+			tile.world_aligned != other.tile.world_aligned ||
+			tile.rotation != other.tile.rotation ||
+			tile.emissive_light != other.tile.emissive_light)
+		return false;
+	for (int layer = 0; layer < MAX_TILE_LAYERS; layer++)
+		if (tile.layers[layer] != other.tile.layers[layer])
+			return false;
+	return true;
+}
+
+void MapblockMeshGenerator::addGreedyFace(int face, const TileSpec &tile, LightPair light)
+{
+	GreedyFace gf{tile, light, cur_node.f->light_source};
+	// Neighboring faces are usually the same, so only compare to the last one
+	if (greedy_faces.empty() || !(greedy_faces.back() == gf))
+		greedy_faces.push_back(std::move(gf));
+	const u8 *axes = greedy_face_axes[face];
+	const s16 c[3] = {cur_node.p.X, cur_node.p.Y, cur_node.p.Z};
+	greedy_cells.push_back({(u8)face, (u16)c[axes[0]], (u16)c[axes[1]],
+			(u16)c[axes[2]], (u32)greedy_faces.size()});
+}
+
+// Merges the collected solid node faces of each slice of the block into as
+// few rectangles as possible. Texture coordinates are derived from world
+// positions, so a merged face tiles its texture exactly like the single faces.
+void MapblockMeshGenerator::drawGreedyFaces()
+{
+	const s16 side = data->side_length;
+	// Only one slice is laid out at a time, the merging leaves it all zero
+	std::vector<u32> slice(side * side);
+
+	auto same = [this] (u32 a, u32 b) {
+		return a != 0 && b != 0 && (a == b || greedy_faces[a - 1] == greedy_faces[b - 1]);
+	};
+
+	// Slice by slice, in the order the slice is scanned for merging
+	std::sort(greedy_cells.begin(), greedy_cells.end(),
+			[] (const GreedyCell &a, const GreedyCell &b) {
+		if (a.face != b.face)
+			return a.face < b.face;
+		if (a.n != b.n)
+			return a.n < b.n;
+		return a.v != b.v ? a.v < b.v : a.u < b.u;
+	});
+
+	for (size_t first = 0; first < greedy_cells.size();) {
+		const int face = greedy_cells[first].face;
+		const s16 n = greedy_cells[first].n;
+		const u8 *axes = greedy_face_axes[face];
+		s16 c[3];
+		c[axes[0]] = n;
+
+		size_t last = first;
+		for (; last < greedy_cells.size() && greedy_cells[last].face == face &&
+				greedy_cells[last].n == n; last++) {
+			const GreedyCell &cell = greedy_cells[last];
+			slice[cell.v * side + cell.u] = cell.id;
+		}
+
+		for (size_t i = first; i < last; i++) {
+			const s16 u = greedy_cells[i].u;
+			const s16 v = greedy_cells[i].v;
+			const u32 id = slice[v * side + u];
+			// Already merged into an earlier rectangle
+			if (id == 0)
+				continue;
+
+			s16 w = 1;
+			while (u + w < side && same(id, slice[v * side + u + w]))
+				w++;
+			s16 h = 1;
+			for (; v + h < side; h++) {
+				s16 k = 0;
+				while (k < w && same(id, slice[(v + h) * side + u + k]))
+					k++;
+				if (k < w)
+					break;
+			}
+			for (s16 j = v; j < v + h; j++)
+				std::fill_n(&slice[j * side + u], w, 0);
+
+			c[axes[1]] = u;
+			c[axes[2]] = v;
+			v3s16 p_min(c[0], c[1], c[2]);
+			c[axes[1]] = u + w - 1;
+			c[axes[2]] = v + h - 1;
+			v3s16 p_max(c[0], c[1], c[2]);
+
+			GreedyFace &gf = greedy_faces[id - 1];
+			aabb3f box(intToFloat(p_min, BS) - v3f(0.5 * BS),
+					intToFloat(p_max, BS) + v3f(0.5 * BS));
+			f32 texture_coord_buf[24];
+			generateCuboidTextureCoords(box, texture_coord_buf);
+			u8 mask = (1 << face) ^ 0b0011'1111;
+			drawCuboid(box, &gf.tile, 1, texture_coord_buf, mask,
+					[&] (int, video::S3DVertex vertices[4]) {
+				video::SColor color = encode_light(gf.light, gf.light_source);
+				if (!gf.light_source)
+					applyFacesShading(color, vertices[0].Normal);
+				for (int j = 0; j < 4; j++)
+					vertices[j].Color = color;
+				return QuadDiagonal::Diag02;
+			});
+		}
+		first = last;
+	}
+}
+
 u8 MapblockMeshGenerator::getNodeBoxMask(aabb3f box, u8 solid_neighbors, u8 sametype_neighbors) const
 {
 	const f32 NODE_BOUNDARY = 0.5 * BS;
@@ -547,8 +690,7 @@ void MapblockMeshGenerator::prepareLiquidNodeDrawing()
 	cur_liquid.draw_bottom = (nbottom.getContent() != cur_liquid.c_flowing)
 			&& (nbottom.getContent() != cur_liquid.c_source);
 	if (cur_liquid.draw_bottom) {
-		const ContentFeatures &f2 = nodedef->get(nbottom.getContent());
-		if (f2.solidness > 1)
+		if (nodedef->getHotProperties(nbottom).solidness > 1)
 			cur_liquid.draw_bottom = false;
 	}
 
@@ -1540,7 +1682,7 @@ void MapblockMeshGenerator::drawNodeboxNode()
 			sametype_neighbors |= flag;
 
 		// mark neighbors that are simple solid blocks
-		if (nodedef->get(n2).drawtype == NDT_NORMAL)
+		if (nodedef->getHotProperties(n2).getDrawType() == NDT_NORMAL)
 			solid_neighbors |= flag;
 
 		if (cur_node.f->node_box.type == NODEBOX_CONNECTED) {
@@ -1726,13 +1868,27 @@ void MapblockMeshGenerator::drawNode()
 
 void MapblockMeshGenerator::generate()
 {
+	data->resetSmoothLightCache();
+
+	collect_greedy_faces = enable_greedy_meshing;
+
 	for (cur_node.p.Z = 0; cur_node.p.Z < data->side_length; cur_node.p.Z++)
 	for (cur_node.p.Y = 0; cur_node.p.Y < data->side_length; cur_node.p.Y++)
 	for (cur_node.p.X = 0; cur_node.p.X < data->side_length; cur_node.p.X++) {
 		cur_node.n = data->m_vmanip.getNodeNoEx(blockpos_nodes + cur_node.p);
+		// Most nodes are air, skip them without touching their definition
+		if (nodedef->getHotProperties(cur_node.n).getDrawType() == NDT_AIRLIKE)
+			continue;
 		cur_node.f = &nodedef->get(cur_node.n);
 		drawNode();
 	}
+
+	if (collect_greedy_faces) {
+		drawGreedyFaces();
+		collect_greedy_faces = false;
+		greedy_cells.clear();
+		greedy_faces.clear();
+	}
 }
 
 void MapblockMeshGenerator::renderSingle(content_t node, u8 param2)
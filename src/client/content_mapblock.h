@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "nodedef.h"
 #include <IMeshManipulator.h>
+#include <vector>
 
 struct MeshMakeData;
 struct MeshCollector;
@@ -77,6 +78,7 @@ class MapblockMeshGenerator
 
 // options
 	const bool enable_mesh_cache;
+	const bool enable_greedy_meshing;
 
 // current node
 	struct {
@@ -171,6 +173,31 @@ class MapblockMeshGenerator
 	void drawFirelikeQuad(float rotation, float opening_angle,
 		float offset_h, float offset_v = 0.0);
 
+// greedy meshing
+	// A solid node face that can be merged with coplanar neighbors showing
+	// the same tile with the same, uniform lighting.
+	struct GreedyFace {
+		TileSpec tile;
+		LightPair light;
+		u8 light_source;
+
+		bool operator==(const GreedyFace &other) const;
+	};
+	// A face handed to the greedy mesher, by face direction, position along
+	// its normal and position in its plane, with an index + 1 into greedy_faces
+	struct GreedyCell {
+		u8 face;
+		u16 n, u, v;
+		u32 id;
+	};
+	// Only filled while generate() is running with greedy meshing on
+	bool collect_greedy_faces = false;
+	std::vector<GreedyCell> greedy_cells;
+	std::vector<GreedyFace> greedy_faces;
+
+	void addGreedyFace(int face, const TileSpec &tile, LightPair light);
+	void drawGreedyFaces();
+
 // drawtypes
 	void drawSolidNode();
 	void drawLiquidNode();
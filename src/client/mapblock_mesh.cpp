@@ -28,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "minimap.h"
 #include "content_mapblock.h"
 #include "util/directiontables.h"
+#include "util/numeric.h"
 #include "client/meshgen/collector.h"
 #include "client/renderingengine.h"
 #include <array>
@@ -42,6 +43,15 @@ MeshMakeData::MeshMakeData(Client *client, bool use_shaders):
 	m_mesh_grid(client->getMeshGrid()),
 	side_length(MAP_BLOCKSIZE * m_mesh_grid.cell_size),
 	m_client(client),
+	m_nodedef(client->ndef()),
+	m_use_shaders(use_shaders)
+{}
+
+MeshMakeData::MeshMakeData(const NodeDefManager *ndef, u16 side_length, bool use_shaders):
+	m_mesh_grid{1},
+	side_length(side_length),
+	m_client(nullptr),
+	m_nodedef(ndef),
 	m_use_shaders(use_shaders)
 {}
 
@@ -77,6 +87,23 @@ void MeshMakeData::setSmoothLighting(bool smooth_lighting)
 	m_smooth_lighting = smooth_lighting;
 }
 
+// Largest smooth light cache, in entries (8 MiB)
+static constexpr u32 SMOOTH_LIGHT_CACHE_MAX_SIZE = 1 << 22;
+
+void MeshMakeData::resetSmoothLightCache()
+{
+	const u32 extent = side_length + 2;
+	const u32 node_count = extent * extent * extent;
+	if (!m_smooth_lighting || node_count * 8 > SMOOTH_LIGHT_CACHE_MAX_SIZE) {
+		m_smooth_light_cache.clear();
+		m_smooth_light_known.clear();
+		return;
+	}
+	// Only the known bits need to be cleared, not the values
+	m_smooth_light_cache.resize(node_count * 8);
+	m_smooth_light_known.assign(node_count, 0);
+}
+
 /*
 	Light and vertex color functions
 */
@@ -147,7 +174,7 @@ u16 getFaceLight(MapNode n, MapNode n2, const NodeDefManager *ndef)
 static u16 getSmoothLightCombined(const v3s16 &p,
 	const std::array<v3s16,8> &dirs, MeshMakeData *data)
 {
-	const NodeDefManager *ndef = data->m_client->ndef();
+	const NodeDefManager *ndef = data->m_nodedef;
 
 	u16 ambient_occlusion = 0;
 	u16 light_count = 0;
@@ -164,13 +191,13 @@ static u16 getSmoothLightCombined(const v3s16 &p,
 		MapNode n = data->m_vmanip.getNodeNoExNoEmerge(p + dirs[i]);
 		if (n.getContent() == CONTENT_IGNORE)
 			return true;
-		const ContentFeatures &f = ndef->get(n);
+		ContentLightingFlags f = ndef->getLightingFlags(n);
 		if (f.light_source > light_source_max)
 			light_source_max = f.light_source;
-		// Check f.solidness because fast-style leaves look better this way
-		if (f.param_type == CPT_LIGHT && f.solidness != 2) {
-			u8 light_level_day = n.getLight(LIGHTBANK_DAY, f.getLightingFlags());
-			u8 light_level_night = n.getLight(LIGHTBANK_NIGHT, f.getLightingFlags());
+		// Check solidness because fast-style leaves look better this way
+		if (f.has_light && ndef->getHotProperties(n).solidness != 2) {
+			u8 light_level_day = n.getLight(LIGHTBANK_DAY, f);
+			u8 light_level_night = n.getLight(LIGHTBANK_NIGHT, f);
 			if (light_level_day == LIGHT_SUN)
 				direct_sunlight = true;
 			light_day += decode_light(light_level_day);
@@ -265,6 +292,27 @@ u16 getSmoothLightSolid(const v3s16 &p, const v3s16 &face_dir, const v3s16 &corn
 */
 u16 getSmoothLightTransparent(const v3s16 &p, const v3s16 &corner, MeshMakeData *data)
 {
+	u16 *cached = nullptr;
+	u8 *known = nullptr;
+	u8 corner_bit = 0;
+	if (!data->m_smooth_light_known.empty()) {
+		const s32 extent = data->side_length + 2;
+		v3s16 rel = p - data->m_blockpos * MAP_BLOCKSIZE + v3s16(1, 1, 1);
+		if (rel.X >= 0 && rel.Y >= 0 && rel.Z >= 0 &&
+				rel.X < extent && rel.Y < extent && rel.Z < extent &&
+				std::abs(corner.X) == 1 && std::abs(corner.Y) == 1 &&
+				std::abs(corner.Z) == 1) {
+			// Same order as light_dirs in content_mapblock.cpp
+			u32 corner_index = (corner.X > 0) << 2 | (corner.Y > 0) << 1 | (corner.Z > 0);
+			u32 node_index = (rel.Z * extent + rel.Y) * extent + rel.X;
+			cached = &data->m_smooth_light_cache[node_index * 8 + corner_index];
+			known = &data->m_smooth_light_known[node_index];
+			corner_bit = 1 << corner_index;
+			if (*known & corner_bit)
+				return *cached;
+		}
+	}
+
 	const std::array<v3s16,8> dirs = {{
 		// Always shine light
 		v3s16(0,0,0),
@@ -278,7 +326,12 @@ u16 getSmoothLightTransparent(const v3s16 &p, const v3s16 &corner, MeshMakeData
 		v3s16(0,corner.Y,corner.Z),
 		v3s16(corner.X,corner.Y,corner.Z)
 	}};
-	return getSmoothLightCombined(p, dirs, data);
+	u16 light = getSmoothLightCombined(p, dirs, data);
+	if (cached) {
+		*cached = light;
+		*known |= corner_bit;
+	}
+	return light;
 }
 
 void get_sunlight_color(video::SColorf *sunlight, u32 daynight_ratio){
@@ -360,7 +413,7 @@ static const v3s16 vertex_dirs_table[] = {
 */
 void getNodeTileN(MapNode mn, const v3s16 &p, u8 tileindex, MeshMakeData *data, TileSpec &tile)
 {
-	const NodeDefManager *ndef = data->m_client->ndef();
+	const NodeDefManager *ndef = data->m_nodedef;
 	const ContentFeatures &f = ndef->get(mn);
 	tile = f.tiles[tileindex];
 	bool has_crack = p == data->m_crack_pos_relative;
@@ -380,7 +433,7 @@ void getNodeTileN(MapNode mn, const v3s16 &p, u8 tileindex, MeshMakeData *data,
 */
 void getNodeTile(MapNode mn, const v3s16 &p, const v3s16 &dir, MeshMakeData *data, TileSpec &tile)
 {
-	const NodeDefManager *ndef = data->m_client->ndef();
+	const NodeDefManager *ndef = data->m_nodedef;
 
 	// Direction must be (1,0,0), (-1,0,0), (0,1,0), (0,-1,0),
 	// (0,0,1), (0,0,-1) or (0,0,0)
@@ -635,7 +688,29 @@ void PartialMeshBuffer::afterDraw() const
 	MapBlockMesh
 */
 
-MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
+/*
+	Hash of all inputs of mesh generation. The whole voxel area is hashed
+	since the generator looks well beyond the mesh borders (lighting,
+	liquids, connected nodeboxes). Day and night light are both baked into
+	the vertices, so the time of day is not part of the key.
+*/
+static u64 get_mesh_geometry_key(const MeshMakeData *data)
+{
+	const VoxelManipulator &vmanip = data->m_vmanip;
+	u64 hash = murmur_hash_64_ua(vmanip.m_data,
+			vmanip.m_area.getVolume() * sizeof(MapNode), 0x5eed);
+
+	s16 params[] = {
+		data->m_blockpos.X, data->m_blockpos.Y, data->m_blockpos.Z,
+		data->m_crack_pos_relative.X, data->m_crack_pos_relative.Y,
+		data->m_crack_pos_relative.Z,
+		data->m_smooth_lighting, data->m_use_shaders,
+	};
+	return murmur_hash_64_ua(params, sizeof(params), (unsigned int)hash) ^ hash;
+}
+
+MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset,
+		MeshGeometryCache *geometry_cache):
 	m_tsrc(data->m_client->getTextureSource()),
 	m_shdrsrc(data->m_client->getShaderSource()),
 	m_bounding_sphere_center((data->side_length * 0.5f - 0.5f) * BS),
@@ -677,9 +752,27 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 		- whatever
 	*/
 
-	{
+	u64 geometry_key = 0;
+	std::shared_ptr<const MeshGeometryCache::Geometry> cached_geometry;
+	if (geometry_cache) {
+		geometry_key = get_mesh_geometry_key(data);
+		cached_geometry = geometry_cache->get(geometry_key);
+	}
+
+	if (cached_geometry) {
+		collector.prebuffers = cached_geometry->prebuffers;
+		collector.m_bounding_radius_sq = cached_geometry->bounding_radius_sq;
+	} else {
 		MapblockMeshGenerator(data, &collector,
 			data->m_client->getSceneManager()->getMeshManipulator()).generate();
+
+		// Store before the buffers are modified below
+		if (geometry_cache) {
+			auto geometry = std::make_shared<MeshGeometryCache::Geometry>();
+			geometry->prebuffers = collector.prebuffers;
+			geometry->bounding_radius_sq = collector.m_bounding_radius_sq;
+			geometry_cache->put(geometry_key, std::move(geometry));
+		}
 	}
 
 	/*
@@ -1011,7 +1104,7 @@ u8 get_solid_sides(MeshMakeData *data)
 	std::unordered_map<v3s16, u8> results;
 	v3s16 ofs;
 	v3s16 blockpos_nodes = data->m_blockpos * MAP_BLOCKSIZE;
-	const NodeDefManager *ndef = data->m_client->ndef();
+	const NodeDefManager *ndef = data->m_nodedef;
 
 	u8 result = 0x3F; // all sides solid;
 
@@ -1028,7 +1121,7 @@ u8 get_solid_sides(MeshMakeData *data)
 
 		for (u8 k = 0; k < 6; k++) {
 			const MapNode &top = data->m_vmanip.getNodeRefUnsafe(blockpos_nodes + positions[k]);
-			if (ndef->get(top).solidness != 2)
+			if (ndef->getHotProperties(top).solidness != 2)
 				result &= ~(1 << k);
 		}
 	}
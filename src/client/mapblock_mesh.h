@@ -25,9 +25,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <array>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 class Client;
 class IShaderSource;
+class MeshGeometryCache;
+class NodeDefManager;
 
 /*
 	Mesh making stuff
@@ -47,9 +50,25 @@ struct MeshMakeData
 	u16 side_length;
 
 	Client *m_client;
+	const NodeDefManager *m_nodedef;
 	bool m_use_shaders;
 
+	/*
+		Smooth light values per node and corner (see getSmoothLightTransparent)
+		covering the mesh and one node around it. Filled lazily while a mesh is
+		generated; a node corner is shared by many faces of neighboring nodes.
+		Left empty for meshes too large to be worth the memory.
+	*/
+	std::vector<u16> m_smooth_light_cache;
+	// One bit per corner of each node, set once its value is in the cache
+	std::vector<u8> m_smooth_light_known;
+
 	MeshMakeData(Client *client, bool use_shaders);
+	/*
+		Without a client, only the mesh generation itself is available
+		(MapblockMeshGenerator), not a full MapBlockMesh.
+	*/
+	MeshMakeData(const NodeDefManager *ndef, u16 side_length, bool use_shaders);
 
 	/*
 		Copy block data manually (to allow optimizations by the caller)
@@ -66,6 +85,11 @@ struct MeshMakeData
 		Enable or disable smooth lighting
 	*/
 	void setSmoothLighting(bool smooth_lighting);
+
+	/*
+		Empty the smooth light cache, to be called before generating a mesh
+	*/
+	void resetSmoothLightCache();
 };
 
 // represents a triangle as indexes into the vertex buffer in SMeshBuffer
@@ -178,8 +202,9 @@ class PartialMeshBuffer
 class MapBlockMesh
 {
 public:
-	// Builds the mesh given
-	MapBlockMesh(MeshMakeData *data, v3s16 camera_offset);
+	// Builds the mesh given, reusing geometry from the cache if possible
+	MapBlockMesh(MeshMakeData *data, v3s16 camera_offset,
+			MeshGeometryCache *geometry_cache = nullptr);
 	~MapBlockMesh();
 
 	// Main animation function, parameters:
@@ -227,9 +227,8 @@ void MeshUpdateWorkerThread::doUpdate()
 			sleep_ms(m_generation_interval);
 		ScopeProfiler sp(g_profiler, "Client: Mesh making (sum)");
 
-		MapBlockMesh *mesh_new = new MapBlockMesh(q->data, *m_camera_offset);
-
-
+		MapBlockMesh *mesh_new = new MapBlockMesh(q->data, *m_camera_offset,
+				m_manager->getGeometryCache());
 
 		MeshUpdateResult r;
 		r.p = q->p;
@@ -264,6 +263,10 @@ MeshUpdateManager::MeshUpdateManager(Client *client):
 
 	for (int i = 0; i < number_of_threads; i++)
 		m_workers.push_back(std::make_unique<MeshUpdateWorkerThread>(&m_queue_in, this, &m_camera_offset));
+
+	int geometry_cache_size = rangelim(g_settings->getS32("mesh_geometry_cache_size"), 0, 1000);
+	if (geometry_cache_size > 0)
+		m_geometry_cache = std::make_unique<MeshGeometryCache>((size_t)geometry_cache_size << 20);
 }
 
 void MeshUpdateManager::updateBlock(Map *map, v3s16 p, bool ack_block_to_server,
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <unordered_map>
 #include <unordered_set>
 #include "mapblock_mesh.h"
+#include "client/meshgen/collector.h"
 #include "threading/mutex_auto_lock.h"
 #include "util/thread.h"
 #include <vector>
@@ -145,6 +146,9 @@ class MeshUpdateManager
 
 	bool isRunning();
 
+	// nullptr if disabled
+	MeshGeometryCache *getGeometryCache() { return m_geometry_cache.get(); }
+
 private:
 	void deferUpdate();
 
@@ -154,4 +158,6 @@ class MeshUpdateManager
 	MutexedQueue<MeshUpdateResult> m_queue_out_urgent;
 
 	std::vector<std::unique_ptr<MeshUpdateWorkerThread>> m_workers;
+
+	std::unique_ptr<MeshGeometryCache> m_geometry_cache;
 };
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "collector.h"
 #include <stdexcept>
 #include "log.h"
+#include "profiler.h"
 #include "client/mesh.h"
 
 void MeshCollector::append(const TileSpec &tile, const video::S3DVertex *vertices,
@@ -108,3 +109,58 @@ PreMeshBuffer &MeshCollector::findBuffer(
 	buffers.emplace_back(layer);
 	return buffers.back();
 }
+
+std::shared_ptr<const MeshGeometryCache::Geometry> MeshGeometryCache::get(u64 key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(key);
+	if (it == m_entries.end()) {
+		g_profiler->avg("Client: Mesh geometry cache hits [%]", 0);
+		return nullptr;
+	}
+
+	g_profiler->avg("Client: Mesh geometry cache hits [%]", 100);
+	m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+	return it->second.geometry;
+}
+
+void MeshGeometryCache::put(u64 key, std::shared_ptr<const Geometry> geometry)
+{
+	size_t bytes = getMemoryUsage(*geometry);
+	if (bytes > m_max_bytes)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(key);
+	if (it != m_entries.end()) {
+		// Another thread meshed the same data at the same time
+		m_bytes -= it->second.bytes;
+		m_lru.erase(it->second.lru_it);
+		m_entries.erase(it);
+	}
+
+	while (m_bytes + bytes > m_max_bytes && !m_lru.empty()) {
+		auto oldest = m_entries.find(m_lru.back());
+		m_bytes -= oldest->second.bytes;
+		m_entries.erase(oldest);
+		m_lru.pop_back();
+	}
+
+	m_lru.push_front(key);
+	m_entries[key] = {std::move(geometry), bytes, m_lru.begin()};
+	m_bytes += bytes;
+	g_profiler->avg("Client: Mesh geometry cache size [KiB]", m_bytes / 1024);
+}
+
+size_t MeshGeometryCache::getMemoryUsage(const Geometry &geometry)
+{
+	size_t bytes = sizeof(Geometry) + sizeof(Entry) + sizeof(u64) * 4;
+	for (const auto &prebuffers : geometry.prebuffers) {
+		for (const PreMeshBuffer &p : prebuffers) {
+			bytes += sizeof(PreMeshBuffer) +
+					p.vertices.capacity() * sizeof(video::S3DVertex) +
+					p.indices.capacity() * sizeof(u16);
+		}
+	}
+	return bytes;
+}
@@ -19,6 +19,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 #include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include "irrlichttypes.h"
 #include "irr_v3d.h"
@@ -68,3 +72,42 @@ struct MeshCollector
 
 	PreMeshBuffer &findBuffer(const TileLayer &layer, u8 layernum, u32 numVertices);
 };
+
+/*
+	Keeps the output of mesh generation around, so that blocks which come
+	back unchanged (e.g. when walking back and forth) don't have to be
+	meshed again. Keyed by a hash of everything the generator reads.
+	Thread-safe; the least recently used entries are dropped when the
+	memory budget is exceeded.
+*/
+class MeshGeometryCache
+{
+public:
+	struct Geometry
+	{
+		std::array<std::vector<PreMeshBuffer>, MAX_TILE_LAYERS> prebuffers;
+		f32 bounding_radius_sq;
+	};
+
+	MeshGeometryCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+	std::shared_ptr<const Geometry> get(u64 key);
+	void put(u64 key, std::shared_ptr<const Geometry> geometry);
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<const Geometry> geometry;
+		size_t bytes;
+		std::list<u64>::iterator lru_it;
+	};
+
+	static size_t getMemoryUsage(const Geometry &geometry);
+
+	const size_t m_max_bytes;
+	size_t m_bytes = 0;
+	std::unordered_map<u64, Entry> m_entries;
+	// Most recently used first
+	std::list<u64> m_lru;
+	std::mutex m_mutex;
+};
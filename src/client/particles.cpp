@@ -49,9 +49,6 @@ Particle::Particle(
 		ParticleSpawner *parent,
 		std::unique_ptr<ClientParticleTexture> owned_texture
 	) :
-		scene::ISceneNode(((Client *)gamedef)->getSceneManager()->getRootSceneNode(),
-				((Client *)gamedef)->getSceneManager()),
-
 		m_expiration(p.expirationtime),
 
 		m_env(env),
@@ -72,91 +69,82 @@ Particle::Particle(
 		m_parent(parent),
 		m_owned_texture(std::move(owned_texture))
 {
-	// Set material
-	{
-		// translate blend modes to GL blend functions
-		video::E_BLEND_FACTOR bfsrc, bfdst;
-		video::E_BLEND_OPERATION blendop;
-		const auto blendmode = texture.tex != nullptr
-				? texture.tex->blendmode
-				: ParticleParamTypes::BlendMode::alpha;
-
-		switch (blendmode) {
-			case ParticleParamTypes::BlendMode::add:
-				bfsrc = video::EBF_SRC_ALPHA;
-				bfdst = video::EBF_DST_ALPHA;
-				blendop = video::EBO_ADD;
-			break;
-
-			case ParticleParamTypes::BlendMode::sub:
-				bfsrc = video::EBF_SRC_ALPHA;
-				bfdst = video::EBF_DST_ALPHA;
-				blendop = video::EBO_REVSUBTRACT;
-			break;
-
-			case ParticleParamTypes::BlendMode::screen:
-				bfsrc = video::EBF_ONE;
-				bfdst = video::EBF_ONE_MINUS_SRC_COLOR;
-				blendop = video::EBO_ADD;
-			break;
-
-			default: // includes ParticleParamTypes::BlendMode::alpha
-				bfsrc = video::EBF_SRC_ALPHA;
-				bfdst = video::EBF_ONE_MINUS_SRC_ALPHA;
-				blendop = video::EBO_ADD;
-			break;
-		}
+}
 
-		// Texture
-		m_material.Lighting = false;
-		m_material.BackfaceCulling = false;
-		m_material.FogEnable = true;
-		m_material.forEachTexture([] (auto &tex) {
-			tex.MinFilter = video::ETMINF_NEAREST_MIPMAP_NEAREST;
-			tex.MagFilter = video::ETMAGF_NEAREST;
-		});
-
-		// correctly render layered transparent particles -- see #10398
-		m_material.ZWriteEnable = video::EZW_AUTO;
-
-		// enable alpha blending and set blend mode
-		m_material.MaterialType = video::EMT_ONETEXTURE_BLEND;
-		m_material.MaterialTypeParam = video::pack_textureBlendFunc(
-				bfsrc, bfdst,
-				video::EMFN_MODULATE_1X,
-				video::EAS_TEXTURE | video::EAS_VERTEX_COLOR);
-		m_material.BlendOperation = blendop;
-		m_material.setTexture(0, m_texture.ref);
+video::SMaterial Particle::getMaterial() const
+{
+	video::SMaterial material;
+
+	// translate blend modes to GL blend functions
+	video::E_BLEND_FACTOR bfsrc, bfdst;
+	video::E_BLEND_OPERATION blendop;
+	const auto blendmode = m_texture.tex != nullptr
+			? m_texture.tex->blendmode
+			: ParticleParamTypes::BlendMode::alpha;
+
+	switch (blendmode) {
+		case ParticleParamTypes::BlendMode::add:
+			bfsrc = video::EBF_SRC_ALPHA;
+			bfdst = video::EBF_DST_ALPHA;
+			blendop = video::EBO_ADD;
+		break;
+
+		case ParticleParamTypes::BlendMode::sub:
+			bfsrc = video::EBF_SRC_ALPHA;
+			bfdst = video::EBF_DST_ALPHA;
+			blendop = video::EBO_REVSUBTRACT;
+		break;
+
+		case ParticleParamTypes::BlendMode::screen:
+			bfsrc = video::EBF_ONE;
+			bfdst = video::EBF_ONE_MINUS_SRC_COLOR;
+			blendop = video::EBO_ADD;
+		break;
+
+		default: // includes ParticleParamTypes::BlendMode::alpha
+			bfsrc = video::EBF_SRC_ALPHA;
+			bfdst = video::EBF_ONE_MINUS_SRC_ALPHA;
+			blendop = video::EBO_ADD;
+		break;
 	}
 
-	// Irrlicht stuff
-	this->setAutomaticCulling(scene::EAC_OFF);
-
-	// Init lighting
-	updateLight();
-
-	// Init model
-	updateVertices();
+	// Texture
+	material.Lighting = false;
+	material.BackfaceCulling = false;
+	material.FogEnable = true;
+	material.forEachTexture([] (auto &tex) {
+		tex.MinFilter = video::ETMINF_NEAREST_MIPMAP_NEAREST;
+		tex.MagFilter = video::ETMAGF_NEAREST;
+	});
+
+	// correctly render layered transparent particles -- see #10398
+	material.ZWriteEnable = video::EZW_AUTO;
+
+	// enable alpha blending and set blend mode
+	material.MaterialType = video::EMT_ONETEXTURE_BLEND;
+	material.MaterialTypeParam = video::pack_textureBlendFunc(
+			bfsrc, bfdst,
+			video::EMFN_MODULATE_1X,
+			video::EAS_TEXTURE | video::EAS_VERTEX_COLOR);
+	material.BlendOperation = blendop;
+	material.setTexture(0, m_texture.ref);
+
+	return material;
 }
 
-void Particle::OnRegisterSceneNode()
+bool Particle::attachToBuffer(ParticleBuffer *buffer)
 {
-	if (IsVisible)
-		SceneManager->registerNodeForRendering(this, scene::ESNRP_TRANSPARENT_EFFECT);
-
-	ISceneNode::OnRegisterSceneNode();
+	if (!buffer->allocate(&m_index))
+		return false;
+	m_buffer = buffer;
+	return true;
 }
 
-void Particle::render()
+void Particle::detachFromBuffer()
 {
-	video::IVideoDriver *driver = SceneManager->getVideoDriver();
-	driver->setMaterial(m_material);
-	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
-
-	u16 indices[] = {0,1,2, 2,3,0};
-	driver->drawVertexPrimitiveList(m_vertices, 4,
-			indices, 2, video::EVT_STANDARD,
-			scene::EPT_TRIANGLES, video::EIT_16BIT);
+	if (m_buffer)
+		m_buffer->release(m_index);
+	m_buffer = nullptr;
 }
 
 void Particle::step(float dtime)
@@ -215,7 +203,7 @@ void Particle::step(float dtime)
 		m_animation_time += dtime;
 		int frame_length_i, frame_count;
 		m_p.animation.determineParams(
-				m_material.getTexture(0)->getSize(),
+				m_texture.ref->getSize(),
 				&frame_count, &frame_length_i, NULL);
 		float frame_length = frame_length_i / 1000.0;
 		while (m_animation_time > frame_length) {
@@ -229,35 +217,19 @@ void Particle::step(float dtime)
 		m_alpha = m_texture.tex -> alpha.blend(m_time / (m_expiration+0.1f));
 	else
 		m_alpha = 1.f;
-
-	// Update lighting
-	updateLight();
-
-	// Update model
-	updateVertices();
-
-	// Update position -- see #10398
-	v3s16 camera_offset = m_env->getCameraOffset();
-	setPosition(m_pos*BS - intToFloat(camera_offset, BS));
 }
 
-void Particle::updateLight()
+v3s16 Particle::getLightPos() const
 {
-	u8 light = 0;
-	bool pos_ok;
-
-	v3s16 p = v3s16(
+	return v3s16(
 		floor(m_pos.X+0.5),
 		floor(m_pos.Y+0.5),
 		floor(m_pos.Z+0.5)
 	);
-	MapNode n = m_env->getClientMap().getNode(p, &pos_ok);
-	if (pos_ok)
-		light = n.getLightBlend(m_env->getDayNightRatio(),
-				m_gamedef->ndef()->getLightingFlags(n));
-	else
-		light = blend_light(m_env->getDayNightRatio(), LIGHT_SUN, 0);
+}
 
+void Particle::updateLight(u8 light)
+{
 	u8 m_light = decode_light(light + m_p.glow);
 	m_color.set(m_alpha*255,
 		m_light * m_base_color.getRed() / 255,
@@ -265,7 +237,7 @@ void Particle::updateLight()
 		m_light * m_base_color.getBlue() / 255);
 }
 
-void Particle::updateVertices()
+void Particle::updateVertices(v3s16 camera_offset)
 {
 	f32 tx0, tx1, ty0, ty1;
 	v2f scale;
@@ -276,7 +248,7 @@ void Particle::updateVertices()
 		scale = v2f(1.f, 1.f);
 
 	if (m_p.animation.type != TAT_NONE) {
-		const v2u32 texsize = m_material.getTexture(0)->getSize();
+		const v2u32 texsize = m_texture.ref->getSize();
 		v2f texcoord, framesize_f;
 		v2u32 framesize;
 		texcoord = m_p.animation.getTextureCoords(texsize, m_animation_frame);
@@ -294,25 +266,25 @@ void Particle::updateVertices()
 		ty1 = m_texpos.Y + m_texsize.Y;
 	}
 
+	video::S3DVertex *vertices = m_buffer->getVertices(m_index);
+
 	auto half = m_p.size * .5f,
 	     hx   = half * scale.X,
 	     hy   = half * scale.Y;
-	m_vertices[0] = video::S3DVertex(-hx, -hy,
+	vertices[0] = video::S3DVertex(-hx, -hy,
 		0, 0, 0, 0, m_color, tx0, ty1);
-	m_vertices[1] = video::S3DVertex(hx, -hy,
+	vertices[1] = video::S3DVertex(hx, -hy,
 		0, 0, 0, 0, m_color, tx1, ty1);
-	m_vertices[2] = video::S3DVertex(hx, hy,
+	vertices[2] = video::S3DVertex(hx, hy,
 		0, 0, 0, 0, m_color, tx1, ty0);
-	m_vertices[3] = video::S3DVertex(-hx, hy,
+	vertices[3] = video::S3DVertex(-hx, hy,
 		0, 0, 0, 0, m_color, tx0, ty0);
 
+	// Vertices are in world space, relative to the camera offset -- see #10398
+	v3f pos = m_pos * BS - intToFloat(camera_offset, BS);
 
-	// see #10398
-	// v3s16 camera_offset = m_env->getCameraOffset();
-	// particle position is now handled by step()
-	m_box.reset(v3f());
-
-	for (video::S3DVertex &vertex : m_vertices) {
+	for (u16 i = 0; i < 4; i++) {
+		video::S3DVertex &vertex = vertices[i];
 		if (m_p.vertical) {
 			v3f ppos = m_player->getPosition()/BS;
 			vertex.Pos.rotateXZBy(std::atan2(ppos.Z - m_pos.Z, ppos.X - m_pos.X) /
@@ -321,8 +293,92 @@ void Particle::updateVertices()
 			vertex.Pos.rotateYZBy(m_player->getPitch());
 			vertex.Pos.rotateXZBy(m_player->getYaw());
 		}
-		m_box.addInternalPoint(vertex.Pos);
+		vertex.Pos += pos;
+	}
+}
+
+/*
+	ParticleBuffer
+*/
+
+ParticleBuffer::ParticleBuffer(ClientEnvironment *env, const video::SMaterial &material) :
+		scene::ISceneNode(
+				env->getGameDef()->getSceneManager()->getRootSceneNode(),
+				env->getGameDef()->getSceneManager()),
+		m_mesh_buffer(new scene::SMeshBuffer())
+{
+	m_mesh_buffer->getMaterial() = material;
+	// Vertices change every step
+	m_mesh_buffer->setHardwareMappingHint(scene::EHM_STREAM, scene::EBT_VERTEX);
+	m_mesh_buffer->setHardwareMappingHint(scene::EHM_STATIC, scene::EBT_INDEX);
+
+	// Vertices are in world space, the bounding box is not kept up to date
+	this->setAutomaticCulling(scene::EAC_OFF);
+}
+
+bool ParticleBuffer::allocate(u16 *index)
+{
+	if (!m_free_list.empty()) {
+		*index = m_free_list.back();
+		m_free_list.pop_back();
+		unused_time = 0.0f;
+		return true;
 	}
+
+	if (m_count >= MAX_PARTICLES)
+		return false;
+
+	*index = m_count++;
+	for (u16 i = 0; i < 4; i++)
+		m_mesh_buffer->Vertices.push_back(video::S3DVertex());
+	u16 first = *index * 4;
+	for (u16 i : {0, 1, 2, 2, 3, 0})
+		m_mesh_buffer->Indices.push_back(first + i);
+	m_mesh_buffer->setDirty(scene::EBT_INDEX);
+	unused_time = 0.0f;
+	return true;
+}
+
+void ParticleBuffer::release(u16 index)
+{
+	assert(index < m_count);
+	// Collapse the quad, so it is not visible until reused
+	video::S3DVertex *vertices = getVertices(index);
+	for (u16 i = 0; i < 4; i++)
+		vertices[i] = video::S3DVertex();
+	m_free_list.push_back(index);
+}
+
+video::S3DVertex *ParticleBuffer::getVertices(u16 index)
+{
+	m_mesh_buffer->setDirty(scene::EBT_VERTEX);
+	m_bounding_box_dirty = true;
+	return &m_mesh_buffer->Vertices[index * 4];
+}
+
+const aabb3f &ParticleBuffer::getBoundingBox() const
+{
+	if (m_bounding_box_dirty) {
+		m_mesh_buffer->recalculateBoundingBox();
+		m_bounding_box_dirty = false;
+	}
+	return m_mesh_buffer->getBoundingBox();
+}
+
+void ParticleBuffer::OnRegisterSceneNode()
+{
+	if (IsVisible && !isEmpty())
+		SceneManager->registerNodeForRendering(this, scene::ESNRP_TRANSPARENT_EFFECT);
+
+	ISceneNode::OnRegisterSceneNode();
+}
+
+void ParticleBuffer::render()
+{
+	video::IVideoDriver *driver = SceneManager->getVideoDriver();
+	driver->setMaterial(m_mesh_buffer->getMaterial());
+	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
+	driver->drawMeshBuffer(m_mesh_buffer.get());
 }
 
 /*
@@ -564,7 +620,7 @@ void ParticleSpawner::spawnParticle(ClientEnvironment *env, float radius,
 		pp.size = r_size.pickWithin();
 
 	++m_active;
-	m_particlemanager->addParticle(std::make_unique<Particle>(
+	m_particlemanager->addParticle(Particle(
 			m_gamedef,
 			m_player,
 			env,
@@ -676,26 +732,63 @@ void ParticleManager::stepParticles(float dtime)
 {
 	MutexAutoLock lock(m_particle_list_lock);
 
+	// Particles are usually crowded in a few nodes
+	m_light_cache.clear();
+	const v3s16 camera_offset = m_env->getCameraOffset();
+
 	for (size_t i = 0; i < m_particles.size();) {
-		Particle &p = *m_particles[i];
+		Particle &p = m_particles[i];
 		if (p.isExpired()) {
 			ParticleSpawner *parent = p.getParent();
 			if (parent) {
 				assert(parent->hasActive());
 				parent->decrActive();
 			}
-			// remove scene node
-			p.remove();
+			p.detachFromBuffer();
 			// delete
 			m_particles[i] = std::move(m_particles.back());
 			m_particles.pop_back();
 		} else {
 			p.step(dtime);
+			p.updateLight(getLight(p.getLightPos()));
+			p.updateVertices(camera_offset);
+			++i;
+		}
+	}
+
+	// Remove buffers that have not been used for a while
+	for (size_t i = 0; i < m_particle_buffers.size();) {
+		ParticleBuffer *buffer = m_particle_buffers[i].get();
+		buffer->unused_time = buffer->isEmpty() ? buffer->unused_time + dtime : 0.0f;
+		if (buffer->unused_time > 5.0f) {
+			buffer->remove();
+			m_particle_buffers[i] = std::move(m_particle_buffers.back());
+			m_particle_buffers.pop_back();
+		} else {
 			++i;
 		}
 	}
 }
 
+u8 ParticleManager::getLight(v3s16 p)
+{
+	auto it = m_light_cache.find(p);
+	if (it != m_light_cache.end())
+		return it->second;
+
+	u8 light;
+	bool pos_ok;
+	MapNode n = m_env->getClientMap().getNode(p, &pos_ok);
+	if (pos_ok)
+		light = n.getLightBlend(m_env->getDayNightRatio(),
+				m_env->getGameDef()->ndef()->getLightingFlags(n));
+	else
+		light = blend_light(m_env->getDayNightRatio(), LIGHT_SUN, 0);
+
+	m_light_cache.emplace(p, light);
+	return light;
+}
+
 void ParticleManager::clearAll()
 {
 	MutexAutoLock lock(m_spawner_list_lock);
@@ -706,13 +799,10 @@ void ParticleManager::clearAll()
 	m_dying_particle_spawners.clear();
 
 	// clear particles
-	for (std::unique_ptr<Particle> &p : m_particles) {
-		// remove scene node
-		p->remove();
-		// delete
-		p.reset();
-	}
 	m_particles.clear();
+	for (auto &buffer : m_particle_buffers)
+		buffer->remove();
+	m_particle_buffers.clear();
 }
 
 void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client,
@@ -785,7 +875,7 @@ void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client,
 				p.size = oldsize;
 
 			if (texture.ref) {
-				addParticle(std::make_unique<Particle>(client, player, m_env,
+				addParticle(Particle(client, player, m_env,
 						p, texture, texpos, texsize, color, nullptr,
 						std::move(texstore)));
 			}
@@ -884,7 +974,7 @@ void ParticleManager::addNodeParticle(IGameDef *gamedef,
 		(f32)pos.Z + myrand_range(0.f, .5f) - .25f
 	);
 
-	addParticle(std::make_unique<Particle>(
+	addParticle(Particle(
 		gamedef,
 		player,
 		m_env,
@@ -902,10 +992,29 @@ void ParticleManager::reserveParticleSpace(size_t max_estimate)
 	m_particles.reserve(m_particles.size() + max_estimate);
 }
 
-void ParticleManager::addParticle(std::unique_ptr<Particle> toadd)
+void ParticleManager::addParticle(Particle &&toadd)
 {
 	MutexAutoLock lock(m_particle_list_lock);
 
+	// Find a buffer with the same material and free space
+	video::SMaterial material = toadd.getMaterial();
+	bool attached = false;
+	for (auto &buffer : m_particle_buffers) {
+		if (buffer->getMaterial(0) == material && toadd.attachToBuffer(buffer.get())) {
+			attached = true;
+			break;
+		}
+	}
+	if (!attached) {
+		m_particle_buffers.emplace_back(new ParticleBuffer(m_env, material));
+		attached = toadd.attachToBuffer(m_particle_buffers.back().get());
+		assert(attached);
+	}
+
+	// Make the particle visible right away
+	toadd.updateLight(getLight(toadd.getLightPos()));
+	toadd.updateVertices(m_env->getCameraOffset());
+
 	m_particles.push_back(std::move(toadd));
 }
 
@@ -23,7 +23,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes_extrabloated.h"
 #include "client/tile.h"
 #include "localplayer.h"
+#include "irr_ptr.h"
 #include "../particles.h"
+#include <unordered_map>
 
 struct ClientEvent;
 class ParticleManager;
@@ -62,8 +64,9 @@ struct ClientParticleTexRef
 };
 
 class ParticleSpawner;
+class ParticleBuffer;
 
-class Particle : public scene::ISceneNode
+class Particle
 {
 public:
 	Particle(
@@ -79,52 +82,44 @@ class Particle : public scene::ISceneNode
 		std::unique_ptr<ClientParticleTexture> owned_texture = nullptr
 	);
 
-	virtual const aabb3f &getBoundingBox() const
-	{
-		return m_box;
-	}
-
-	virtual u32 getMaterialCount() const
-	{
-		return 1;
-	}
-
-	virtual video::SMaterial& getMaterial(u32 i)
-	{
-		return m_material;
-	}
+	// Material of the buffer this particle has to be drawn with
+	video::SMaterial getMaterial() const;
 
-	virtual void OnRegisterSceneNode();
-	virtual void render();
+	// Takes a free slot in the buffer. Returns false if the buffer is full.
+	bool attachToBuffer(ParticleBuffer *buffer);
+	// Gives the slot back to the buffer
+	void detachFromBuffer();
 
 	void step(float dtime);
 
+	// Node the light is sampled from
+	v3s16 getLightPos() const;
+	// Applies the blended light of the node the particle is in
+	void updateLight(u8 light);
+	// Writes the quad into the buffer
+	void updateVertices(v3s16 camera_offset);
+
 	bool isExpired ()
 	{ return m_expiration < m_time; }
 
 	ParticleSpawner *getParent() { return m_parent; }
 
 private:
-	void updateLight();
-	void updateVertices();
 	void setVertexAlpha(float a);
 
-	video::S3DVertex m_vertices[4];
 	float m_time = 0.0f;
 	float m_expiration;
 
 	ClientEnvironment *m_env;
 	IGameDef *m_gamedef;
-	aabb3f m_box;
 	aabb3f m_collisionbox;
 	ClientParticleTexRef m_texture;
-	video::SMaterial m_material;
 	v2f m_texpos;
 	v2f m_texsize;
 	v3f m_pos;
 	v3f m_velocity;
 	v3f m_acceleration;
-	const ParticleParameters m_p;
+	ParticleParameters m_p;
 	LocalPlayer *m_player;
 
 	//! Color without lighting
@@ -135,11 +130,66 @@ class Particle : public scene::ISceneNode
 	int m_animation_frame = 0;
 	float m_alpha = 0.0f;
 
+	ParticleBuffer *m_buffer = nullptr;
+	u16 m_index = 0;
+
 	ParticleSpawner *m_parent = nullptr;
 	// Used if not spawned from a particlespawner
 	std::unique_ptr<ClientParticleTexture> m_owned_texture;
 };
 
+/**
+ * Holds the quads of all particles sharing one material, so that they
+ * can be drawn with a single draw call.
+ */
+class ParticleBuffer : public scene::ISceneNode
+{
+public:
+	ParticleBuffer(ClientEnvironment *env, const video::SMaterial &material);
+	DISABLE_CLASS_COPY(ParticleBuffer)
+
+	// Reserves the four vertices of a particle. Returns false if full.
+	bool allocate(u16 *index);
+	// Frees the vertices of a particle for reuse
+	void release(u16 index);
+
+	// Returns the four vertices of a particle and marks them as changed.
+	// The pointer is only valid until the next allocate().
+	video::S3DVertex *getVertices(u16 index);
+
+	bool isEmpty() const
+	{ return m_free_list.size() == m_count; }
+
+	virtual const aabb3f &getBoundingBox() const;
+
+	virtual u32 getMaterialCount() const
+	{
+		return 1;
+	}
+
+	virtual video::SMaterial &getMaterial(u32 i)
+	{
+		return m_mesh_buffer->getMaterial();
+	}
+
+	virtual void OnRegisterSceneNode();
+	virtual void render();
+
+	// Indices are 16 bit, each particle needs four vertices
+	static constexpr u16 MAX_PARTICLES = 16000;
+
+	// Time since the buffer became empty
+	float unused_time = 0.0f;
+
+private:
+	irr_ptr<scene::SMeshBuffer> m_mesh_buffer;
+	// Released particle slots
+	std::vector<u16> m_free_list;
+	// Number of allocated slots, including released ones
+	u16 m_count = 0;
+	mutable bool m_bounding_box_dirty = true;
+};
+
 class ParticleSpawner
 {
 public:
@@ -214,7 +264,7 @@ friend class ParticleSpawner;
 		ParticleParameters &p, video::ITexture **texture, v2f &texpos,
 		v2f &texsize, video::SColor *color, u8 tilenum = 0);
 
-	void addParticle(std::unique_ptr<Particle> toadd);
+	void addParticle(Particle &&toadd);
 
 private:
 	void addParticleSpawner(u64 id, std::unique_ptr<ParticleSpawner> toadd);
@@ -223,9 +273,14 @@ friend class ParticleSpawner;
 	void stepParticles(float dtime);
 	void stepSpawners(float dtime);
 
+	// Blended light at the given node, looked up once per step
+	u8 getLight(v3s16 p);
+
 	void clearAll();
 
-	std::vector<std::unique_ptr<Particle>> m_particles;
+	std::vector<Particle> m_particles;
+	std::vector<irr_ptr<ParticleBuffer>> m_particle_buffers;
+	std::unordered_map<v3s16, u8> m_light_cache;
 	std::unordered_map<u64, std::unique_ptr<ParticleSpawner>> m_particle_spawners;
 	std::vector<std::unique_ptr<ParticleSpawner>> m_dying_particle_spawners;
 	// Start the particle spawner ids generated from here after u32_max. lower values are
@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "tile.h"
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <ICameraSceneNode.h>
 #include <IVideoDriver.h>
 #include "util/string.h"
@@ -194,6 +196,20 @@ struct TextureInfo
 	}
 };
 
+/*
+	Irrlicht's file system and image loaders are not thread-safe, so all
+	image decoding is serialized through this mutex.
+*/
+static std::mutex g_image_loader_mutex;
+
+static video::IImage *copyImage(video::IImage *img)
+{
+	video::IImage *copy = RenderingEngine::get_video_driver()->
+		createImage(img->getColorFormat(), img->getDimension());
+	img->copyTo(copy);
+	return copy;
+}
+
 /*
 	SourceImageCache: A cache used for storing source images.
 */
@@ -210,6 +226,7 @@ class SourceImageCache
 	void insert(const std::string &name, video::IImage *img, bool prefer_local)
 	{
 		assert(img); // Pre-condition
+		MutexAutoLock lock(m_mutex);
 		// Remove old image
 		std::map<std::string, video::IImage*>::iterator n;
 		n = m_images.find(name);
@@ -227,6 +244,7 @@ class SourceImageCache
 			std::string path = getTexturePath(name, &is_base_pack);
 			// Ignore base pack
 			if (!path.empty() && !is_base_pack) {
+				MutexAutoLock loader_lock(g_image_loader_mutex);
 				video::IImage *img2 = RenderingEngine::get_video_driver()->
 					createImageFromFile(path.c_str());
 				if (img2){
@@ -242,18 +260,24 @@ class SourceImageCache
 	}
 	video::IImage* get(const std::string &name)
 	{
+		MutexAutoLock lock(m_mutex);
 		std::map<std::string, video::IImage*>::iterator n;
 		n = m_images.find(name);
 		if (n != m_images.end())
 			return n->second;
 		return NULL;
 	}
-	// Primarily fetches from cache, secondarily tries to read from filesystem
-	video::IImage *getOrLoad(const std::string &name)
+	// Primarily fetches from cache, secondarily tries to read from filesystem.
+	// The reference counts of cached images are not atomic, so other threads
+	// than the main thread must ask for a private copy.
+	video::IImage *getOrLoad(const std::string &name, bool copy = false)
 	{
+		MutexAutoLock lock(m_mutex);
 		std::map<std::string, video::IImage*>::iterator n;
 		n = m_images.find(name);
 		if (n != m_images.end()){
+			if (copy)
+				return copyImage(n->second);
 			n->second->grab(); // Grab for caller
 			return n->second;
 		}
@@ -266,16 +290,112 @@ class SourceImageCache
 		}
 		infostream<<"SourceImageCache::getOrLoad(): Loading path \""<<path
 				<<"\""<<std::endl;
-		video::IImage *img = driver->createImageFromFile(path.c_str());
+		video::IImage *img;
+		{
+			MutexAutoLock loader_lock(g_image_loader_mutex);
+			img = driver->createImageFromFile(path.c_str());
+		}
 
 		if (img){
 			m_images[name] = img;
+			if (copy)
+				return copyImage(img);
 			img->grab(); // Grab for caller
 		}
 		return img;
 	}
 private:
 	std::map<std::string, video::IImage*> m_images;
+	std::mutex m_mutex;
+};
+
+/*
+	IntermediateImageCache: Stores images generated from texture strings
+	that other textures are built upon, e.g. "default_dirt.png^grass_side.png"
+	for every "default_dirt.png^grass_side.png^..." variant.
+	A texture string fully describes how its image is built, so it serves
+	as the content key. Images are copied in and out, so callers may modify
+	the returned image and the cache can be shared between threads.
+*/
+
+class IntermediateImageCache
+{
+public:
+	~IntermediateImageCache()
+	{
+		clear();
+	}
+
+	// Returns a copy of the cached image and adds its source images to
+	// source_image_names, or returns NULL if not cached.
+	video::IImage *get(const std::string &name,
+			std::set<std::string> &source_image_names)
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_images.find(name);
+		if (it == m_images.end())
+			return NULL;
+		source_image_names.insert(it->second.source_image_names.begin(),
+				it->second.source_image_names.end());
+		return copyImage(it->second.image);
+	}
+
+	void insert(const std::string &name, video::IImage *img,
+			const std::set<std::string> &source_image_names)
+	{
+		u32 size = img->getPitch() * img->getDimension().Height;
+		MutexAutoLock lock(m_mutex);
+		if (m_images.find(name) != m_images.end())
+			return;
+		// Everything can be regenerated, so simply start over when full
+		if (m_size + size > MAX_SIZE)
+			clearUnlocked();
+		m_images[name] = {copyImage(img), source_image_names};
+		m_size += size;
+	}
+
+	// Removes all images that were built using the given source image
+	void invalidate(const std::string &source_name)
+	{
+		MutexAutoLock lock(m_mutex);
+		for (auto it = m_images.begin(); it != m_images.end();) {
+			if (it->second.source_image_names.count(source_name) == 0) {
+				++it;
+				continue;
+			}
+			video::IImage *img = it->second.image;
+			m_size -= img->getPitch() * img->getDimension().Height;
+			img->drop();
+			it = m_images.erase(it);
+		}
+	}
+
+	void clear()
+	{
+		MutexAutoLock lock(m_mutex);
+		clearUnlocked();
+	}
+
+private:
+	static const u32 MAX_SIZE = 64 * 1024 * 1024;
+
+	struct CachedImage
+	{
+		video::IImage *image;
+		std::set<std::string> source_image_names;
+	};
+
+	void clearUnlocked()
+	{
+		for (auto &it : m_images)
+			it.second.image->drop();
+		m_images.clear();
+		m_size = 0;
+	}
+
+	std::unordered_map<std::string, CachedImage> m_images;
+	u32 m_size = 0;
+	std::mutex m_mutex;
 };
 
 /*
@@ -352,6 +472,14 @@ class TextureSource : public IWritableTextureSource
 	*/
 	video::ITexture* getTextureForMesh(const std::string &name, u32 *id);
 
+	/*
+		Generates the images of the given mesh textures on worker threads
+		and uploads them on the main thread, so that the following
+		getTextureForMesh() calls are served from the cache.
+		Shall be called from the main thread.
+	*/
+	void prefetchTexturesForMesh(const std::vector<std::string> &names);
+
 	virtual Palette* getPalette(const std::string &name);
 
 	bool isKnownSourceImage(const std::string &name)
@@ -383,14 +511,26 @@ class TextureSource : public IWritableTextureSource
 	video::ITexture *getShaderFlagsTexture(bool normamap_present);
 
 private:
+	class GenerateImageThread;
 
 	// The id of the thread that is allowed to use irrlicht directly
 	std::thread::id m_main_thread;
 
 	// Cache of source images
-	// This should be only accessed from the main thread
 	SourceImageCache m_sourcecache;
 
+	// Cache of images that other textures are built upon
+	IntermediateImageCache m_intermediate_cache;
+
+	// Returns the name getTextureForMesh() uses for the given texture
+	std::string getMeshTextureName(const std::string &name) const;
+
+	// Uploads a generated image and adds it to the texture caches.
+	// Takes ownership of img, which may be NULL.
+	// Shall be called from the main thread.
+	u32 addTexture(const std::string &name, video::IImage *img,
+			const std::set<std::string> &source_image_names);
+
 	// Rebuild images and textures from the current set of source images
 	// Shall be called from the main thread.
 	// You ARE expected to be holding m_textureinfo_cache_mutex
@@ -406,12 +546,20 @@ class TextureSource : public IWritableTextureSource
 
 	/*! Generates an image from a full string like
 	 * "stone.png^mineral_coal.png^[crack:1:0".
-	 * Shall be called from the main thread.
+	 * Shall be called from the main thread or a GenerateImageThread.
 	 * The returned Image should be dropped.
 	 * source_image_names is important to determine when to flush the image from a cache (dynamic media)
 	 */
 	video::IImage* generateImage(const std::string &name, std::set<std::string> &source_image_names);
 
+	/*! Like generateImage(), but shares the image with all other textures
+	 * built upon the same texture string.
+	 */
+	video::IImage *generateSharedImage(const std::string &name, std::set<std::string> &source_image_names);
+
+	// Fetches a source image, copying it when called from another thread
+	video::IImage *getSourceImage(const std::string &name);
+
 	// Thread-safe cache of what source images are known (true = known)
 	MutexedMap<std::string, bool> m_source_image_existence;
 
@@ -440,6 +588,50 @@ class TextureSource : public IWritableTextureSource
 	bool m_setting_anisotropic_filter;
 };
 
+/*
+	Generates images for TextureSource::prefetchTexturesForMesh().
+	The threads share one list of names and take the next one until
+	all are done.
+*/
+
+class TextureSource::GenerateImageThread : public Thread
+{
+public:
+	struct Result
+	{
+		video::IImage *image = nullptr;
+		std::set<std::string> source_image_names;
+	};
+
+	GenerateImageThread(TextureSource *tsrc,
+			const std::vector<std::string> &names,
+			std::vector<Result> &results, std::atomic<size_t> &next) :
+		Thread("TextureGen"),
+		m_tsrc(tsrc),
+		m_names(names),
+		m_results(results),
+		m_next(next)
+	{}
+
+protected:
+	void *run()
+	{
+		size_t i;
+		while ((i = m_next++) < m_names.size()) {
+			Result &result = m_results[i];
+			result.image = m_tsrc->generateImage(m_names[i],
+					result.source_image_names);
+		}
+		return nullptr;
+	}
+
+private:
+	TextureSource *m_tsrc;
+	const std::vector<std::string> &m_names;
+	std::vector<Result> &m_results;
+	std::atomic<size_t> &m_next;
+};
+
 IWritableTextureSource *createTextureSource()
 {
 	return new TextureSource();
@@ -636,13 +828,19 @@ u32 TextureSource::generateTexture(const std::string &name)
 		return 0;
 	}
 
-	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
-	sanity_check(driver);
-
 	// passed into texture info for dynamic media tracking
 	std::set<std::string> source_image_names;
 	video::IImage *img = generateImage(name, source_image_names);
 
+	return addTexture(name, img, source_image_names);
+}
+
+u32 TextureSource::addTexture(const std::string &name, video::IImage *img,
+		const std::set<std::string> &source_image_names)
+{
+	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
+	sanity_check(driver);
+
 	video::ITexture *tex = NULL;
 
 	if (img != NULL) {
@@ -701,15 +899,66 @@ video::ITexture* TextureSource::getTexture(const std::string &name, u32 *id)
 	return getTexture(actual_id);
 }
 
-video::ITexture* TextureSource::getTextureForMesh(const std::string &name, u32 *id)
+std::string TextureSource::getMeshTextureName(const std::string &name) const
 {
 	// Avoid duplicating texture if it won't actually change
 	const bool filter_needed =
 		m_setting_mipmap || m_setting_trilinear_filter ||
 		m_setting_bilinear_filter || m_setting_anisotropic_filter;
 	if (filter_needed)
-		return getTexture(name + "^[applyfiltersformesh", id);
-	return getTexture(name, id);
+		return name + "^[applyfiltersformesh";
+	return name;
+}
+
+video::ITexture* TextureSource::getTextureForMesh(const std::string &name, u32 *id)
+{
+	return getTexture(getMeshTextureName(name), id);
+}
+
+void TextureSource::prefetchTexturesForMesh(const std::vector<std::string> &names)
+{
+	sanity_check(std::this_thread::get_id() == m_main_thread);
+
+	// Collect the textures that are not generated yet
+	std::vector<std::string> missing;
+	{
+		std::set<std::string> seen;
+		MutexAutoLock lock(m_textureinfo_cache_mutex);
+		for (const std::string &name : names) {
+			if (name.empty())
+				continue;
+			std::string mesh_name = getMeshTextureName(name);
+			if (m_name_to_id.find(mesh_name) == m_name_to_id.end() &&
+					seen.insert(mesh_name).second)
+				missing.push_back(std::move(mesh_name));
+		}
+	}
+
+	unsigned int num_threads = MYMIN(8U, Thread::getNumberOfProcessors());
+	num_threads = std::min<size_t>(num_threads, missing.size() / 16);
+	// Not worth spawning threads, generate on demand instead
+	if (num_threads < 2)
+		return;
+
+	u64 t_start = porting::getTimeMs();
+
+	std::vector<GenerateImageThread::Result> results(missing.size());
+	std::atomic<size_t> next(0);
+	std::vector<std::unique_ptr<GenerateImageThread>> threads;
+	for (unsigned int i = 0; i < num_threads; i++) {
+		threads.emplace_back(new GenerateImageThread(this, missing, results, next));
+		threads.back()->start();
+	}
+	for (auto &thread : threads)
+		thread->wait();
+
+	// Only the upload to the GPU has to happen on the main thread
+	for (size_t i = 0; i < missing.size(); i++)
+		addTexture(missing[i], results[i].image, results[i].source_image_names);
+
+	infostream << "TextureSource: prefetched " << missing.size()
+		<< " textures using " << num_threads << " threads in "
+		<< (porting::getTimeMs() - t_start) << "ms" << std::endl;
 }
 
 Palette* TextureSource::getPalette(const std::string &name)
@@ -796,6 +1045,7 @@ void TextureSource::insertSourceImage(const std::string &name, video::IImage *im
 
 	m_sourcecache.insert(name, img, true);
 	m_source_image_existence.set(name, true);
+	m_intermediate_cache.invalidate(name);
 
 	// now we need to check for any textures that need updating
 	MutexAutoLock lock(m_textureinfo_cache_mutex);
@@ -820,6 +1070,8 @@ void TextureSource::insertSourceImage(const std::string &name, video::IImage *im
 
 void TextureSource::rebuildImagesAndTextures()
 {
+	m_intermediate_cache.clear();
+
 	MutexAutoLock lock(m_textureinfo_cache_mutex);
 
 	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
@@ -1030,7 +1282,7 @@ video::IImage* TextureSource::generateImage(const std::string &name, std::set<st
 		using a recursive call.
 	*/
 	if (last_separator_pos != -1) {
-		baseimg = generateImage(name.substr(0, last_separator_pos), source_image_names);
+		baseimg = generateSharedImage(name.substr(0, last_separator_pos), source_image_names);
 	}
 
 	/*
@@ -1048,7 +1300,7 @@ video::IImage* TextureSource::generateImage(const std::string &name, std::set<st
 			&& last_part_of_name[last_part_of_name.size() - 1] == paren_close) {
 		std::string name2 = last_part_of_name.substr(1,
 				last_part_of_name.size() - 2);
-		video::IImage *tmp = generateImage(name2, source_image_names);
+		video::IImage *tmp = generateSharedImage(name2, source_image_names);
 		if (!tmp) {
 			errorstream << "generateImage(): "
 				"Failed to generate \"" << name2 << "\""
@@ -1079,6 +1331,32 @@ video::IImage* TextureSource::generateImage(const std::string &name, std::set<st
 	return baseimg;
 }
 
+video::IImage *TextureSource::generateSharedImage(const std::string &name,
+		std::set<std::string> &source_image_names)
+{
+	// Plain source images are cached by m_sourcecache already
+	if (name.find('^') == std::string::npos && !str_starts_with(name, "["))
+		return generateImage(name, source_image_names);
+
+	video::IImage *img = m_intermediate_cache.get(name, source_image_names);
+	if (img)
+		return img;
+
+	std::set<std::string> own_source_image_names;
+	img = generateImage(name, own_source_image_names);
+	if (img)
+		m_intermediate_cache.insert(name, img, own_source_image_names);
+	source_image_names.insert(own_source_image_names.begin(),
+			own_source_image_names.end());
+	return img;
+}
+
+video::IImage *TextureSource::getSourceImage(const std::string &name)
+{
+	return m_sourcecache.getOrLoad(name,
+			std::this_thread::get_id() != m_main_thread);
+}
+
 /**
  * Check and align image to npot2 if required by hardware
  * @param image image to check for npot2 alignment
@@ -1192,7 +1470,7 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 	// Stuff starting with [ are special commands
 	if (part_of_name.empty() || part_of_name[0] != '[') {
 		source_image_names.insert(part_of_name);
-		video::IImage *image = m_sourcecache.getOrLoad(part_of_name);
+		video::IImage *image = getSourceImage(part_of_name);
 		if (image == NULL) {
 			if (!part_of_name.empty()) {
 
@@ -1296,8 +1574,7 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 					It is an image with a number of cracking stages
 					horizontally tiled.
 				*/
-				video::IImage *img_crack = m_sourcecache.getOrLoad(
-					"crack_anylength.png");
+				video::IImage *img_crack = getSourceImage("crack_anylength.png");
 
 				if (img_crack) {
 					draw_crack(img_crack, baseimg,
@@ -1942,12 +2219,16 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 				png = base64_decode(blob);
 			}
 
-			auto *device = RenderingEngine::get_raw_device();
-			auto *fs = device->getFileSystem();
-			auto *vd = device->getVideoDriver();
-			auto *memfile = fs->createMemoryReadFile(png.data(), png.size(), "__temp_png");
-			video::IImage* pngimg = vd->createImageFromFile(memfile);
-			memfile->drop();
+			video::IImage *pngimg;
+			{
+				MutexAutoLock loader_lock(g_image_loader_mutex);
+				auto *device = RenderingEngine::get_raw_device();
+				auto *fs = device->getFileSystem();
+				auto *vd = device->getVideoDriver();
+				auto *memfile = fs->createMemoryReadFile(png.data(), png.size(), "__temp_png");
+				pngimg = vd->createImageFromFile(memfile);
+				memfile->drop();
+			}
 
 			if (!pngimg) {
 				errorstream << "generateImagePart(): Invalid PNG data" << std::endl;
@@ -94,6 +94,12 @@ class ITextureSource : public ISimpleTextureSource
 			const std::string &name, u32 *id = nullptr)=0;
 	virtual video::ITexture* getTextureForMesh(
 			const std::string &name, u32 *id = nullptr) = 0;
+	/*!
+	 * Generates the given mesh textures in parallel, so that later
+	 * getTextureForMesh() calls for them are cheap.
+	 * Should be called from the main thread.
+	 */
+	virtual void prefetchTexturesForMesh(const std::vector<std::string> &names) = 0;
 	/*!
 	 * Returns a palette from the given texture name.
 	 * The pointer is valid until the texture source is
@@ -53,7 +53,7 @@ std::string ClientInterface::state2Name(ClientState state)
 	return statenames[state];
 }
 
-RemoteClient::RemoteClient() :
+RemoteClient::RemoteClient(const SettingHandle<float> &unload_unused_data_timeout) :
 	m_max_simul_sends(g_settings->getU16("max_simultaneous_block_sends_per_client")),
 	m_min_time_from_building(
 		g_settings->getFloat("full_block_send_enable_min_time_from_building")),
@@ -61,7 +61,8 @@ RemoteClient::RemoteClient() :
 	m_block_optimize_distance(g_settings->getS16("block_send_optimize_distance")),
 	m_block_cull_optimize_distance(g_settings->getS16("block_cull_optimize_distance")),
 	m_max_gen_distance(g_settings->getS16("max_block_generate_distance")),
-	m_occ_cull(g_settings->getBool("server_side_occlusion_culling"))
+	m_occ_cull(g_settings->getBool("server_side_occlusion_culling")),
+	m_unload_unused_data_timeout(unload_unused_data_timeout)
 {
 }
 
@@ -102,7 +103,7 @@ void RemoteClient::GetNextBlocks (
 	m_nothing_to_send_pause_timer -= dtime;
 	m_map_send_completion_timer += dtime;
 
-	if (m_map_send_completion_timer > g_settings->getFloat("server_unload_unused_data_timeout") * 0.8f) {
+	if (m_map_send_completion_timer > m_unload_unused_data_timeout.get() * 0.8f) {
 		infostream << "Server: Player " << m_name << ", peer_id=" << peer_id
 				<< ": full map send is taking too long ("
 				<< m_map_send_completion_timer
@@ -641,6 +642,12 @@ u64 RemoteClient::uptime() const
 	return porting::getTimeS() - m_connection_time;
 }
 
+struct ClientInterface::CachedSettings
+{
+	SettingHandle<u16> max_users{"max_users"};
+	SettingHandle<float> unload_unused_data_timeout{"server_unload_unused_data_timeout"};
+};
+
 ClientInterface::ClientInterface(const std::shared_ptr<con::Connection> & con)
 :
 	m_con(con),
@@ -664,6 +671,11 @@ ClientInterface::~ClientInterface()
 	}
 }
 
+void ClientInterface::initSettings()
+{
+	m_cached_settings = std::make_unique<CachedSettings>();
+}
+
 std::vector<session_t> ClientInterface::getClientIDs(ClientState min_state)
 {
 	std::vector<session_t> reply;
@@ -693,7 +705,7 @@ void ClientInterface::markBlockposAsNotSent(const v3s16 &pos)
  */
 bool ClientInterface::isUserLimitReached()
 {
-	return getClientIDs(CS_HelloSent).size() >= g_settings->getU16("max_users");
+	return getClientIDs(CS_HelloSent).size() >= m_cached_settings->max_users.get();
 }
 
 void ClientInterface::step(float dtime)
@@ -845,7 +857,8 @@ void ClientInterface::CreateClient(session_t peer_id)
 	if (n != m_clients.end()) return;
 
 	// Create client
-	RemoteClient *client = new RemoteClient();
+	RemoteClient *client = new RemoteClient(
+			m_cached_settings->unload_unused_data_timeout);
 	client->peer_id = peer_id;
 	m_clients[client->peer_id] = client;
 }
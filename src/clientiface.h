@@ -40,6 +40,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class MapBlock;
 class ServerEnvironment;
 class EmergeManager;
+template <typename T> class SettingHandle;
 
 /*
  * State Transitions
@@ -252,7 +253,7 @@ class RemoteClient
 	bool isMechAllowed(AuthMechanism mech)
 	{ return allowed_auth_mechs & mech; }
 
-	RemoteClient();
+	RemoteClient(const SettingHandle<float> &unload_unused_data_timeout);
 	~RemoteClient() = default;
 
 	/*
@@ -309,6 +310,12 @@ class RemoteClient
 	*/
 	std::set<u16> m_known_objects;
 
+	/*
+		Added objects that were not sent yet due to the per-step budget,
+		so that each deferral is counted once.
+	*/
+	std::set<u16> m_deferred_objects;
+
 	ClientState getState() const { return m_state; }
 
 	std::string getName() const { return m_name; }
@@ -400,6 +407,8 @@ class RemoteClient
 	const s16 m_block_cull_optimize_distance;
 	const s16 m_max_gen_distance;
 	const bool m_occ_cull;
+	// Owned by the ClientInterface
+	const SettingHandle<float> &m_unload_unused_data_timeout;
 
 	/*
 		Blocks that are currently on the line.
@@ -517,6 +526,9 @@ class ClientInterface {
 	/* event to update client state */
 	void event(session_t peer_id, ClientStateEvent event);
 
+	/* create the setting handles; to be called once the game settings are loaded */
+	void initSettings();
+
 	/* Set environment. Do not call this function if environment is already set */
 	void setEnv(ServerEnvironment *env)
 	{
@@ -550,6 +562,9 @@ class ClientInterface {
 	// Environment
 	ServerEnvironment *m_env;
 
+	struct CachedSettings;
+	std::unique_ptr<CachedSettings> m_cached_settings;
+
 	float m_print_info_timer;
 
 	static const char *statenames[];
@@ -215,13 +215,33 @@ bool wouldCollideWithCeiling(
 }
 
 static inline void getNeighborConnectingFace(const v3s16 &p,
-	const NodeDefManager *nodedef, Map *map, MapNode n, int v, int *neighbors)
+	const NodeDefManager *nodedef, Map *map, MapNode n, u8 v, u8 *neighbors)
 {
 	MapNode n2 = map->getNode(p);
 	if (nodedef->nodeboxConnects(n, n2, v))
 		*neighbors |= v;
 }
 
+const CollisionBoxCache::Entry &CollisionBoxCache::get(
+		const NodeDefManager *nodedef, MapNode n, u8 neighbors)
+{
+	u32 key = ((u32)n.getContent() << 16) | ((u32)n.getParam2() << 8) | neighbors;
+	auto it = m_entries.find(key);
+	if (it != m_entries.end())
+		return it->second;
+
+	// Nodes with many param2 values (e.g. colored or leveled) could make
+	// this grow a lot, start over in that case
+	if (m_entries.size() >= 65536)
+		m_entries.clear();
+
+	Entry &entry = m_entries[key];
+	n.getCollisionBoxes(nodedef, &entry.boxes, neighbors);
+	// Negative bouncy may have a meaning, but we need +value here.
+	entry.bouncy = abs(itemgroup_get(nodedef->get(n).groups, "bouncy"));
+	return entry;
+}
+
 collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		f32 pos_max_d, const aabb3f &box_0,
 		f32 stepheight, f32 dtime,
@@ -289,30 +309,40 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 	v3s16 max = floatToInt(maxpos_f + box_0.MaxEdge, BS) + v3s16(1, 1, 1);
 
 	bool any_position_valid = false;
+	const NodeDefManager *nodedef = gamedef->getNodeDefManager();
+	CollisionBoxCache &box_cache = env->getCollisionBoxCache();
+
+	// Consecutive nodes are mostly in the same block, look it up only once
+	v3s16 last_blockpos;
+	MapBlock *last_block = nullptr;
+	bool have_last_block = false;
 
 	v3s16 p;
 	for (p.X = min.X; p.X <= max.X; p.X++)
 	for (p.Y = min.Y; p.Y <= max.Y; p.Y++)
 	for (p.Z = min.Z; p.Z <= max.Z; p.Z++) {
-		bool is_position_valid;
-		MapNode n = map->getNode(p, &is_position_valid);
+		v3s16 blockpos = getNodeBlockPos(p);
+		if (!have_last_block || blockpos != last_blockpos) {
+			last_block = map->getBlockNoCreateNoEx(blockpos);
+			last_blockpos = blockpos;
+			have_last_block = true;
+		}
+		bool is_position_valid = last_block != nullptr;
+		MapNode n(CONTENT_IGNORE);
+		if (is_position_valid)
+			n = last_block->getNodeNoCheck(p - blockpos * MAP_BLOCKSIZE);
 
 		if (is_position_valid && n.getContent() != CONTENT_IGNORE) {
 			// Object collides into walkable nodes
 
 			any_position_valid = true;
-			const NodeDefManager *nodedef = gamedef->getNodeDefManager();
-			const ContentFeatures &f = nodedef->get(n);
+			const ContentHotProperties props = nodedef->getHotProperties(n);
 
-			if (!f.walkable)
+			if (!props.walkable)
 				continue;
 
-			// Negative bouncy may have a meaning, but we need +value here.
-			int n_bouncy_value = abs(itemgroup_get(f.groups, "bouncy"));
-
-			int neighbors = 0;
-			if (f.drawtype == NDT_NODEBOX &&
-				f.node_box.type == NODEBOX_CONNECTED) {
+			u8 neighbors = 0;
+			if (props.connected_nodebox) {
 				v3s16 p2 = p;
 
 				p2.Y++;
@@ -338,15 +368,15 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 				p2.X++;
 				getNeighborConnectingFace(p2, nodedef, map, n, 32, &neighbors);
 			}
-			std::vector<aabb3f> nodeboxes;
-			n.getCollisionBoxes(gamedef->ndef(), &nodeboxes, neighbors);
+			const CollisionBoxCache::Entry &entry =
+					box_cache.get(nodedef, n, neighbors);
 
 			// Calculate float position only once
 			v3f posf = intToFloat(p, BS);
-			for (auto box : nodeboxes) {
+			for (auto box : entry.boxes) {
 				box.MinEdge += posf;
 				box.MaxEdge += posf;
-				cinfo.emplace_back(false, n_bouncy_value, p, box);
+				cinfo.emplace_back(false, entry.bouncy, p, box);
 			}
 		} else {
 			// Collide with unloaded nodes (position invalid) and loaded
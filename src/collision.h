@@ -20,12 +20,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include "irrlichttypes_bloated.h"
+#include "mapnode.h"
+#include <unordered_map>
 #include <vector>
 
 class Map;
 class IGameDef;
 class Environment;
 class ActiveObject;
+class NodeDefManager;
 
 enum CollisionType
 {
@@ -64,6 +67,26 @@ struct collisionMoveResult
 	std::vector<CollisionInfo> collisions;
 };
 
+/*
+	Collision boxes of nodes relative to the node position, by content,
+	param2 and connected neighbors. Each Environment has one, so it is only
+	used by a single thread.
+*/
+class CollisionBoxCache
+{
+public:
+	struct Entry
+	{
+		std::vector<aabb3f> boxes;
+		int bouncy;
+	};
+
+	const Entry &get(const NodeDefManager *nodedef, MapNode n, u8 neighbors);
+
+private:
+	std::unordered_map<u32, Entry> m_entries;
+};
+
 // Moves using a single iteration; speed should not exceed pos_max_d/dtime
 collisionMoveResult collisionMoveSimple(Environment *env,IGameDef *gamedef,
 		f32 pos_max_d, const aabb3f &box_0,
@@ -24,6 +24,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sstream>
 #include <unordered_set>
 #include <algorithm>
+#include <functional>
+#include <set>
 #include "gamedef.h"
 #include "inventory.h"
 #include "util/serialize.h"
@@ -108,6 +110,46 @@ static bool inputItemMatchesRecipe(const std::string &inp_name,
 	return false;
 }
 
+// Finds the items of which any input matching the recipe names contains one:
+// an item name of the recipe if it has one, otherwise the items matching
+// the recipe's smallest group
+static bool craftGetRequiredItems(const std::vector<std::string> &rec_names,
+		const CraftGroupItems &group_items, IItemDefManager *idef,
+		std::vector<std::string> &result)
+{
+	const std::string *best_name = nullptr;
+	const std::vector<std::string> *best_items = nullptr;
+	static const std::vector<std::string> no_items;
+	for (const std::string &rec_name : rec_names) {
+		if (rec_name.empty())
+			continue;
+		if (!isGroupRecipeStr(rec_name)) {
+			result.push_back(rec_name);
+			return true;
+		}
+
+		Strfnd f(rec_name.substr(6));
+		do {
+			auto it = group_items.find(f.next(","));
+			const std::vector<std::string> &items =
+				it != group_items.end() ? it->second : no_items;
+			if (!best_items || items.size() < best_items->size()) {
+				best_name = &rec_name;
+				best_items = &items;
+			}
+		} while (!f.at_end());
+	}
+	if (!best_items)
+		return false;
+
+	// The items must be in all groups of the recipe item
+	for (const std::string &item : *best_items) {
+		if (inputItemMatchesRecipe(item, *best_name, idef))
+			result.push_back(item);
+	}
+	return true;
+}
+
 // Deserialize an itemstring then return the name of the item
 static std::string craftGetItemName(const std::string &itemstring, IGameDef *gamedef)
 {
@@ -463,6 +505,13 @@ void CraftDefinitionShaped::initHash(IGameDef *gamedef)
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
 }
 
+bool CraftDefinitionShaped::getRequiredItems(const CraftGroupItems &group_items,
+		IItemDefManager *idef, std::vector<std::string> &result) const
+{
+	assert(hash_inited); // Pre-condition
+	return craftGetRequiredItems(recipe_names, group_items, idef, result);
+}
+
 std::string CraftDefinitionShaped::dump() const
 {
 	std::ostringstream os(std::ios::binary);
@@ -715,6 +764,13 @@ void CraftDefinitionShapeless::initHash(IGameDef *gamedef)
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
 }
 
+bool CraftDefinitionShapeless::getRequiredItems(const CraftGroupItems &group_items,
+		IItemDefManager *idef, std::vector<std::string> &result) const
+{
+	assert(hash_inited); // Pre-condition
+	return craftGetRequiredItems(recipe_names, group_items, idef, result);
+}
+
 std::string CraftDefinitionShapeless::dump() const
 {
 	std::ostringstream os(std::ios::binary);
@@ -868,7 +924,7 @@ bool CraftDefinitionCooking::check(const CraftInput &input, IGameDef *gamedef) c
 	}
 
 	// Check the single input item
-	std::string rec_name = craftGetItemName(recipe, gamedef);
+	std::string rec_name = hash_inited ? recipe_name : craftGetItemName(recipe, gamedef);
 	return inputItemMatchesRecipe(input_filtered[0], rec_name, gamedef->idef());
 }
 
@@ -918,6 +974,13 @@ void CraftDefinitionCooking::initHash(IGameDef *gamedef)
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
 }
 
+bool CraftDefinitionCooking::getRequiredItems(const CraftGroupItems &group_items,
+		IItemDefManager *idef, std::vector<std::string> &result) const
+{
+	assert(hash_inited); // Pre-condition
+	return craftGetRequiredItems({recipe_name}, group_items, idef, result);
+}
+
 std::string CraftDefinitionCooking::dump() const
 {
 	std::ostringstream os(std::ios::binary);
@@ -971,7 +1034,7 @@ bool CraftDefinitionFuel::check(const CraftInput &input, IGameDef *gamedef) cons
 	}
 
 	// Check the single input item
-	std::string rec_name = craftGetItemName(recipe, gamedef);
+	std::string rec_name = hash_inited ? recipe_name : craftGetItemName(recipe, gamedef);
 	return inputItemMatchesRecipe(input_filtered[0], rec_name, gamedef->idef());
 }
 
@@ -1021,6 +1084,13 @@ void CraftDefinitionFuel::initHash(IGameDef *gamedef)
 		hash_type = CRAFT_HASH_TYPE_ITEM_NAMES;
 }
 
+bool CraftDefinitionFuel::getRequiredItems(const CraftGroupItems &group_items,
+		IItemDefManager *idef, std::vector<std::string> &result) const
+{
+	assert(hash_inited); // Pre-condition
+	return craftGetRequiredItems({recipe_name}, group_items, idef, result);
+}
+
 std::string CraftDefinitionFuel::dump() const
 {
 	std::ostringstream os(std::ios::binary);
@@ -1063,6 +1133,28 @@ class CCraftDefManager: public IWritableCraftDefManager
 		CraftDefinition::RecipePriority priority_best =
 			CraftDefinition::PRIORITY_NO_RECIPE;
 		CraftDefinition *def_best = nullptr;
+		auto try_def = [&] (CraftDefinition *def) {
+			/*errorstream << "Checking " << input.dump() << std::endl
+				<< " against " << def->dump() << std::endl;*/
+
+			CraftDefinition::RecipePriority priority = def->getPriority();
+			if (priority > priority_best
+					&& def->check(input, gamedef)) {
+				// Check if the crafted node/item exists
+				CraftOutput out = def->getOutput(input, gamedef);
+				ItemStack is;
+				is.deSerialize(out.item, gamedef->idef());
+				if (!is.isKnown(gamedef->idef())) {
+					infostream << "trying to craft non-existent "
+						<< out.item << ", ignoring recipe" << std::endl;
+					return;
+				}
+
+				output = out;
+				priority_best = priority;
+				def_best = def;
+			}
+		};
 		for (int type = 0; type <= craft_hash_type_max; type++) {
 			u64 hash = getHashForGrid((CraftHashType) type, input_names);
 
@@ -1076,32 +1168,35 @@ class CCraftDefManager: public IWritableCraftDefManager
 				continue;
 
 			const std::vector<CraftDefinition*> &hash_collisions = col_iter->second;
+
+			auto index_iter = m_count_index.find(hash);
+			if (type == CRAFT_HASH_TYPE_COUNT && index_iter != m_count_index.end()) {
+				// Only try the recipes that can use one of the input items,
+				// in the same order as below
+				const CountIndex &index = index_iter->second;
+				std::vector<u32> candidates = index.unindexed;
+				for (size_t i = 0; i < input_names.size(); i++) {
+					if (input_names[i].empty() ||
+							(i > 0 && input_names[i] == input_names[i - 1]))
+						continue;
+					auto it = index.by_item.find(input_names[i]);
+					if (it != index.by_item.end())
+						candidates.insert(candidates.end(),
+							it->second.begin(), it->second.end());
+				}
+				std::sort(candidates.begin(), candidates.end(), std::greater<u32>());
+				candidates.erase(std::unique(candidates.begin(), candidates.end()),
+					candidates.end());
+				for (u32 i : candidates)
+					try_def(hash_collisions[i]);
+				continue;
+			}
+
 			// Walk crafting definitions from back to front, so that later
 			// definitions can override earlier ones.
 			for (std::vector<CraftDefinition*>::size_type
 					i = hash_collisions.size(); i > 0; i--) {
-				CraftDefinition *def = hash_collisions[i - 1];
-
-				/*errorstream << "Checking " << input.dump() << std::endl
-					<< " against " << def->dump() << std::endl;*/
-
-				CraftDefinition::RecipePriority priority = def->getPriority();
-				if (priority > priority_best
-						&& def->check(input, gamedef)) {
-					// Check if the crafted node/item exists
-					CraftOutput out = def->getOutput(input, gamedef);
-					ItemStack is;
-					is.deSerialize(out.item, gamedef->idef());
-					if (!is.isKnown(gamedef->idef())) {
-						infostream << "trying to craft non-existent "
-							<< out.item << ", ignoring recipe" << std::endl;
-						continue;
-					}
-
-					output = out;
-					priority_best = priority;
-					def_best = def;
-				}
+				try_def(hash_collisions[i - 1]);
 			}
 		}
 		if (priority_best == CraftDefinition::PRIORITY_NO_RECIPE)
@@ -1228,6 +1323,7 @@ class CCraftDefManager: public IWritableCraftDefManager
 			m_craft_defs[type].clear();
 		}
 		m_output_craft_definitions.clear();
+		m_count_index.clear();
 	}
 	virtual void initHashes(IGameDef *gamedef)
 	{
@@ -1244,12 +1340,61 @@ class CCraftDefManager: public IWritableCraftDefManager
 			m_craft_defs[type][hash].push_back(def);
 		}
 		unhashed.clear();
+
+		updateCountIndex(gamedef);
 	}
 private:
+	// Indexes the recipes with groups by the items they require, as there
+	// are too many of them with the same number of items to check them all
+	void updateCountIndex(IGameDef *gamedef)
+	{
+		IItemDefManager *idef = gamedef->idef();
+		CraftGroupItems group_items;
+		std::set<std::string> names;
+		idef->getAll(names);
+		for (const std::string &name : names) {
+			const ItemDefinition &def = idef->get(name);
+			// Skip aliases
+			if (def.name != name)
+				continue;
+			for (const auto &group : def.groups) {
+				if (group.second != 0)
+					group_items[group.first].push_back(name);
+			}
+		}
+
+		m_count_index.clear();
+		std::vector<std::string> required;
+		for (const auto &it : m_craft_defs[(int) CRAFT_HASH_TYPE_COUNT]) {
+			CountIndex &index = m_count_index[it.first];
+			for (u32 i = 0; i < it.second.size(); i++) {
+				required.clear();
+				if (!it.second[i]->getRequiredItems(group_items, idef, required)) {
+					index.unindexed.push_back(i);
+					continue;
+				}
+				std::sort(required.begin(), required.end());
+				required.erase(std::unique(required.begin(), required.end()),
+					required.end());
+				for (const std::string &name : required)
+					index.by_item[name].push_back(i);
+			}
+		}
+	}
+
+	// Positions of recipes in m_craft_defs[CRAFT_HASH_TYPE_COUNT][hash]
+	struct CountIndex
+	{
+		std::unordered_map<std::string, std::vector<u32>> by_item;
+		// Recipes that can not be indexed, always tried
+		std::vector<u32> unindexed;
+	};
+
 	std::vector<std::unordered_map<u64, std::vector<CraftDefinition*> > >
 		m_craft_defs;
 	std::unordered_map<std::string, std::vector<CraftDefinition*> >
 		m_output_craft_definitions;
+	std::unordered_map<u64, CountIndex> m_count_index;
 };
 
 IWritableCraftDefManager* createCraftDefManager()
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <string>
 #include <iostream>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include "gamedef.h"
@@ -64,6 +65,9 @@ enum CraftHashType
 };
 const int craft_hash_type_max = (int) CRAFT_HASH_TYPE_UNHASHED;
 
+// Names of the known items in each group, to index group recipes with
+typedef std::unordered_map<std::string, std::vector<std::string>> CraftGroupItems;
+
 /*
 	Input: The contents of the crafting slots, arranged in matrix form
 */
@@ -179,6 +183,15 @@ class CraftDefinition
 	// to be called after all mods are loaded, so that we catch all aliases
 	virtual void initHash(IGameDef *gamedef) = 0;
 
+	// Adds the item names of which every input matching this recipe
+	// contains at least one to result. Returns false if there are none
+	// to tell. Can only be called after initHash().
+	virtual bool getRequiredItems(const CraftGroupItems &group_items,
+			IItemDefManager *idef, std::vector<std::string> &result) const
+	{
+		return false;
+	}
+
 	virtual std::string dump() const=0;
 
 protected:
@@ -215,6 +228,9 @@ class CraftDefinitionShaped: public CraftDefinition
 
 	virtual void initHash(IGameDef *gamedef);
 
+	virtual bool getRequiredItems(const CraftGroupItems &group_items,
+			IItemDefManager *idef, std::vector<std::string> &result) const;
+
 	virtual std::string dump() const;
 
 private:
@@ -259,6 +275,9 @@ class CraftDefinitionShapeless: public CraftDefinition
 
 	virtual void initHash(IGameDef *gamedef);
 
+	virtual bool getRequiredItems(const CraftGroupItems &group_items,
+			IItemDefManager *idef, std::vector<std::string> &result) const;
+
 	virtual std::string dump() const;
 
 private:
@@ -340,6 +359,9 @@ class CraftDefinitionCooking: public CraftDefinition
 
 	virtual void initHash(IGameDef *gamedef);
 
+	virtual bool getRequiredItems(const CraftGroupItems &group_items,
+			IItemDefManager *idef, std::vector<std::string> &result) const;
+
 	virtual std::string dump() const;
 
 private:
@@ -383,6 +405,9 @@ class CraftDefinitionFuel: public CraftDefinition
 
 	virtual void initHash(IGameDef *gamedef);
 
+	virtual bool getRequiredItems(const CraftGroupItems &group_items,
+			IItemDefManager *idef, std::vector<std::string> &result) const;
+
 	virtual std::string dump() const;
 
 private:
@@ -0,0 +1,563 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "database-async.h"
+#include "debug.h"
+#include "exceptions.h"
+#include "log.h"
+#include "porting.h"
+#include "profiler.h"
+#include "remoteplayer.h"
+#include "server/player_sao.h"
+#include "threading/mutex_auto_lock.h"
+
+/*
+	DatabaseWriteThread
+*/
+
+DatabaseWriteThread::DatabaseWriteThread(PlayerDatabase *player_db,
+		AuthDatabase *auth_db, float interval, MetricsBackend *mb) :
+	Thread("DatabaseWrite"),
+	m_player_db(player_db),
+	m_auth_db(auth_db),
+	m_interval_ms(MYMAX(interval, 0.001f) * 1000)
+{
+	m_write_time_counter = mb->addCounter("minetest_core_database_write_time",
+		"Time spent writing player and auth data (in microseconds)");
+	m_write_count_counter = mb->addCounter("minetest_core_database_writes",
+		"Number of player and auth entries written");
+	m_write_latency_gauge = mb->addGauge("minetest_core_database_write_latency",
+		"Time the last player and auth data write took (in seconds)");
+
+	start();
+}
+
+DatabaseWriteThread::~DatabaseWriteThread()
+{
+	stop();
+	m_wake_sem.post();
+	wait();
+
+	// Write what was queued since the last round
+	writeQueued();
+	if (!m_error.empty())
+		errorstream << "DatabaseWriteThread: data was lost: " << m_error << std::endl;
+}
+
+void *DatabaseWriteThread::run()
+{
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	while (!stopRequested()) {
+		m_wake_sem.wait(m_interval_ms);
+		writeQueued();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+
+	return nullptr;
+}
+
+void DatabaseWriteThread::queuePlayer(RemotePlayer *player)
+{
+	PlayerSAO *sao = player->getPlayerSAO();
+	sanity_check(sao);
+
+	// The databases read the player through its SAO, copy both
+	PlayerCopy copy;
+	copy.player = std::make_unique<RemotePlayer>(player->getName(), nullptr);
+	copy.player->inventory = player->inventory;
+	copy.sao = std::make_unique<PlayerSAO>(nullptr, copy.player.get(), 1, false);
+	*copy.sao->accessObjectProperties() = *sao->accessObjectProperties();
+	copy.sao->setBasePosition(sao->getBasePosition());
+	copy.sao->setLookPitch(sao->getLookPitch());
+	copy.sao->setPlayerYaw(sao->getRotation().Y);
+	copy.sao->setHPRaw(sao->getHP());
+	copy.sao->setBreath(sao->getBreath(), false);
+	copy.sao->getMeta() = sao->getMeta();
+	copy.player->setPlayerSAO(copy.sao.get());
+
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		m_players[player->getName()] = std::move(copy);
+	}
+
+	// As far as the server is concerned, the player is saved now
+	player->onSuccessfulSave();
+}
+
+void DatabaseWriteThread::queueAuth(const AuthEntry &entry)
+{
+	MutexAutoLock lock(m_queue_mutex);
+	m_auths[entry.name] = entry;
+}
+
+bool DatabaseWriteThread::isPlayerQueued(const std::string &name)
+{
+	MutexAutoLock lock(m_queue_mutex);
+	return m_players.find(name) != m_players.end();
+}
+
+bool DatabaseWriteThread::getQueuedAuth(const std::string &name, AuthEntry &res)
+{
+	MutexAutoLock lock(m_queue_mutex);
+	auto it = m_auths.find(name);
+	if (it == m_auths.end())
+		return false;
+	res = it->second;
+	return true;
+}
+
+void DatabaseWriteThread::flush()
+{
+	MutexAutoLock lock(m_queue_mutex);
+	if (m_players.empty() && m_auths.empty() && !m_writing)
+		return;
+
+	// Failed entries stay queued, don't wait for them forever
+	const u32 failed_writes = m_failed_writes;
+	m_wake_sem.post();
+	m_written_cv.wait(lock, [&] {
+		return !m_writing && ((m_players.empty() && m_auths.empty()) ||
+			m_failed_writes != failed_writes);
+	});
+}
+
+void DatabaseWriteThread::checkError()
+{
+	std::string error;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		error.swap(m_error);
+	}
+	if (!error.empty())
+		throw DatabaseException("Failed to write player or auth data: " + error);
+}
+
+void DatabaseWriteThread::writeQueued()
+{
+	// Hold the database while taking the queue, so that anyone who does not
+	// find their data in the queue any more waits for it to be written
+	MutexAutoLock db_lock(m_db_mutex);
+
+	std::map<std::string, PlayerCopy> players;
+	std::map<std::string, AuthEntry> auths;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		if (m_players.empty() && m_auths.empty())
+			return;
+		players.swap(m_players);
+		auths.swap(m_auths);
+		m_writing = true;
+	}
+
+	const u64 start_time = porting::getTimeUs();
+	const size_t count = players.size() + auths.size();
+	std::string error;
+	try {
+		if (!players.empty()) {
+			DatabaseSaveGuard<PlayerDatabase> save(m_player_db.get());
+			for (auto &it : players)
+				m_player_db->savePlayer(it.second.player.get());
+			save.commit();
+			players.clear();
+		}
+		if (!auths.empty()) {
+			DatabaseSaveGuard<AuthDatabase> save(m_auth_db.get());
+			for (const auto &it : auths)
+				m_auth_db->saveAuth(it.second);
+			save.commit();
+			auths.clear();
+		}
+	} catch (BaseException &e) {
+		errorstream << "DatabaseWriteThread: " << e.what() << std::endl;
+		error = e.what();
+	}
+	const u64 end_time = porting::getTimeUs();
+
+	m_write_time_counter->increment(end_time - start_time);
+	m_write_count_counter->increment(count - players.size() - auths.size());
+	m_write_latency_gauge->set((end_time - start_time) / 1e6);
+
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		if (!error.empty()) {
+			// What was not committed is queued again, unless a newer copy
+			// came in since. The players were already told they are saved.
+			m_players.merge(players);
+			m_auths.merge(auths);
+			m_error = error;
+			m_failed_writes++;
+		}
+		m_writing = false;
+	}
+	m_written_cv.notify_all();
+}
+
+/*
+	PlayerDatabaseAsync
+*/
+
+void PlayerDatabaseAsync::savePlayer(RemotePlayer *player)
+{
+	m_thread->queuePlayer(player);
+}
+
+bool PlayerDatabaseAsync::loadPlayer(RemotePlayer *player, PlayerSAO *sao)
+{
+	if (m_thread->isPlayerQueued(player->getName()))
+		m_thread->flush();
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	return m_thread->getPlayerDatabase()->loadPlayer(player, sao);
+}
+
+bool PlayerDatabaseAsync::removePlayer(const std::string &name)
+{
+	if (m_thread->isPlayerQueued(name))
+		m_thread->flush();
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	return m_thread->getPlayerDatabase()->removePlayer(name);
+}
+
+void PlayerDatabaseAsync::listPlayers(std::vector<std::string> &res)
+{
+	// New players may not be written yet
+	m_thread->flush();
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	m_thread->getPlayerDatabase()->listPlayers(res);
+}
+
+/*
+	AuthDatabaseAsync
+*/
+
+bool AuthDatabaseAsync::getAuth(const std::string &name, AuthEntry &res)
+{
+	if (m_thread->getQueuedAuth(name, res))
+		return true;
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	return m_thread->getAuthDatabase()->getAuth(name, res);
+}
+
+bool AuthDatabaseAsync::saveAuth(const AuthEntry &authEntry)
+{
+	m_thread->queueAuth(authEntry);
+	return true;
+}
+
+bool AuthDatabaseAsync::createAuth(AuthEntry &authEntry)
+{
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	return m_thread->getAuthDatabase()->createAuth(authEntry);
+}
+
+bool AuthDatabaseAsync::deleteAuth(const std::string &name)
+{
+	m_thread->flush();
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	return m_thread->getAuthDatabase()->deleteAuth(name);
+}
+
+void AuthDatabaseAsync::listNames(std::vector<std::string> &res)
+{
+	m_thread->flush();
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	m_thread->getAuthDatabase()->listNames(res);
+}
+
+void AuthDatabaseAsync::reload()
+{
+	m_thread->flush();
+
+	MutexAutoLock lock(m_thread->getDatabaseMutex());
+	m_thread->getAuthDatabase()->reload();
+}
+
+/*
+	ModStorageDatabaseAsync
+*/
+
+ModStorageDatabaseAsync::ModStorageDatabaseAsync(ModStorageDatabase *db,
+		MetricsBackend *mb) :
+	Thread("ModStorageWrite"),
+	m_db(db),
+	m_metrics_backend(mb)
+{
+	start();
+}
+
+ModStorageDatabaseAsync::~ModStorageDatabaseAsync()
+{
+	endSave();
+
+	stop();
+	m_wake_sem.post();
+	wait();
+
+	writeQueued();
+	if (!m_error.empty())
+		errorstream << "ModStorageDatabaseAsync: data was lost: " << m_error << std::endl;
+}
+
+void *ModStorageDatabaseAsync::run()
+{
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	while (!stopRequested()) {
+		m_wake_sem.wait();
+		writeQueued();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+
+	return nullptr;
+}
+
+ModStorageDatabaseAsync::ModState &ModStorageDatabaseAsync::getMod(
+		const std::string &modname)
+{
+	auto it = m_mods.find(modname);
+	if (it != m_mods.end())
+		return it->second;
+
+	// Changes only come from this object, so the database is up to date
+	// for mods that were not loaded yet
+	ModState &state = m_mods[modname];
+	{
+		MutexAutoLock lock(m_db_mutex);
+		m_db->getModEntries(modname, &state.entries);
+	}
+	state.write_counter = m_metrics_backend->addCounter(
+		"minetest_mod_storage_writes", "Number of mod storage changes by mod",
+		{{"mod", modname}});
+	state.written_counter = m_metrics_backend->addCounter(
+		"minetest_mod_storage_written", "Number of mod storage entries written by mod",
+		{{"mod", modname}});
+	return state;
+}
+
+void ModStorageDatabaseAsync::getModEntries(const std::string &modname,
+		StringMap *storage)
+{
+	const ModState &state = getMod(modname);
+	for (const auto &it : state.entries)
+		(*storage)[it.first] = it.second;
+}
+
+void ModStorageDatabaseAsync::getModKeys(const std::string &modname,
+		std::vector<std::string> *storage)
+{
+	const ModState &state = getMod(modname);
+	storage->reserve(storage->size() + state.entries.size());
+	for (const auto &it : state.entries)
+		storage->push_back(it.first);
+}
+
+bool ModStorageDatabaseAsync::hasModEntry(const std::string &modname,
+		const std::string &key)
+{
+	const ModState &state = getMod(modname);
+	return state.entries.find(key) != state.entries.end();
+}
+
+bool ModStorageDatabaseAsync::getModEntry(const std::string &modname,
+		const std::string &key, std::string *value)
+{
+	const ModState &state = getMod(modname);
+	auto it = state.entries.find(key);
+	if (it == state.entries.end())
+		return false;
+	*value = it->second;
+	return true;
+}
+
+bool ModStorageDatabaseAsync::setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value)
+{
+	ModState &state = getMod(modname);
+	state.writes++;
+	state.write_counter->increment();
+
+	auto it = state.entries.find(key);
+	if (it != state.entries.end() && it->second == value)
+		return true;
+	state.entries[key] = value;
+	state.changes.entries[key] = value;
+	return true;
+}
+
+bool ModStorageDatabaseAsync::removeModEntry(const std::string &modname,
+		const std::string &key)
+{
+	ModState &state = getMod(modname);
+	state.writes++;
+	state.write_counter->increment();
+
+	auto it = state.entries.find(key);
+	if (it == state.entries.end())
+		return false;
+	state.entries.erase(it);
+	state.changes.entries[key] = std::nullopt;
+	return true;
+}
+
+bool ModStorageDatabaseAsync::removeModEntries(const std::string &modname)
+{
+	ModState &state = getMod(modname);
+	state.writes++;
+	state.write_counter->increment();
+
+	if (state.entries.empty())
+		return false;
+	state.entries.clear();
+	state.changes.cleared = true;
+	state.changes.entries.clear();
+	return true;
+}
+
+void ModStorageDatabaseAsync::listMods(std::vector<std::string> *res)
+{
+	endSave();
+	flush();
+
+	MutexAutoLock lock(m_db_mutex);
+	m_db->listMods(res);
+}
+
+void ModStorageDatabaseAsync::endSave()
+{
+	bool queued = false;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		for (auto &it : m_mods) {
+			ModState &state = it.second;
+			if (state.writes > 0)
+				g_profiler->add("ModStorage: writes by " + it.first + " [#]", state.writes);
+			state.writes = 0;
+			if (!state.changes.cleared && state.changes.entries.empty())
+				continue;
+
+			state.written_counter->increment(state.changes.entries.size() +
+				(state.changes.cleared ? 1 : 0));
+
+			// Merge with what the thread did not get to yet
+			ModChanges &changes = m_queued[it.first];
+			if (state.changes.cleared) {
+				changes = std::move(state.changes);
+			} else {
+				for (auto &entry : state.changes.entries)
+					changes.entries[entry.first] = std::move(entry.second);
+			}
+			state.changes = ModChanges();
+		}
+		// This also retries the changes of a failed write
+		queued = !m_queued.empty();
+	}
+
+	if (queued)
+		m_wake_sem.post();
+}
+
+void ModStorageDatabaseAsync::flush()
+{
+	MutexAutoLock lock(m_queue_mutex);
+	if (m_queued.empty() && !m_writing)
+		return;
+
+	// Failed changes stay queued, don't wait for them forever
+	const u32 failed_writes = m_failed_writes;
+	m_wake_sem.post();
+	m_written_cv.wait(lock, [&] {
+		return !m_writing && (m_queued.empty() || m_failed_writes != failed_writes);
+	});
+}
+
+void ModStorageDatabaseAsync::checkError()
+{
+	std::string error;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		error.swap(m_error);
+	}
+	if (!error.empty())
+		throw DatabaseException("Failed to write mod storage: " + error);
+}
+
+void ModStorageDatabaseAsync::writeQueued()
+{
+	MutexAutoLock db_lock(m_db_mutex);
+
+	std::unordered_map<std::string, ModChanges> queued;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		if (m_queued.empty())
+			return;
+		queued.swap(m_queued);
+		m_writing = true;
+	}
+
+	std::string error;
+	try {
+		DatabaseSaveGuard<ModStorageDatabase> save(m_db.get());
+		for (const auto &it : queued) {
+			const std::string &modname = it.first;
+			if (it.second.cleared)
+				m_db->removeModEntries(modname);
+			for (const auto &entry : it.second.entries) {
+				if (entry.second)
+					m_db->setModEntry(modname, entry.first, *entry.second);
+				else
+					m_db->removeModEntry(modname, entry.first);
+			}
+		}
+		save.commit();
+	} catch (BaseException &e) {
+		errorstream << "ModStorageDatabaseAsync: failed to write mod storage: "
+			<< e.what() << std::endl;
+		error = e.what();
+	}
+
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		if (!error.empty()) {
+			// The transaction was rolled back, queue the changes again
+			// below the ones that came in since
+			for (auto &it : queued) {
+				auto newer = m_queued.find(it.first);
+				if (newer != m_queued.end()) {
+					if (newer->second.cleared)
+						continue;
+					for (auto &entry : newer->second.entries)
+						it.second.entries[entry.first] = std::move(entry.second);
+				}
+				m_queued[it.first] = std::move(it.second);
+			}
+			m_error = error;
+			m_failed_writes++;
+		}
+		m_writing = false;
+	}
+	m_written_cv.notify_all();
+}
@@ -0,0 +1,206 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "database.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include "util/metricsbackend.h"
+
+/*
+	Writes player and auth data in a background thread.
+
+	The server thread queues copies of the data, which are written every
+	interval in one transaction per database, so that a slow database
+	does not block the server step. Only the latest copy of each player
+	or auth entry is written. Reads wait for pending writes they depend on.
+*/
+class DatabaseWriteThread : public Thread
+{
+public:
+	DatabaseWriteThread(PlayerDatabase *player_db, AuthDatabase *auth_db,
+			float interval, MetricsBackend *mb);
+	// Writes everything that is still queued
+	~DatabaseWriteThread();
+
+	void *run();
+
+	void queuePlayer(RemotePlayer *player);
+	void queueAuth(const AuthEntry &entry);
+
+	bool isPlayerQueued(const std::string &name);
+	// Looks up an auth entry that has not been written yet
+	bool getQueuedAuth(const std::string &name, AuthEntry &res);
+
+	// Writes everything queued so far and waits for it, or for it to fail
+	void flush();
+
+	// Throws the error of a failed write on the calling thread.
+	// The entries of a failed write are kept and written with the next ones.
+	void checkError();
+
+	// Must be held while using the databases outside of this thread
+	std::mutex &getDatabaseMutex() { return m_db_mutex; }
+	PlayerDatabase *getPlayerDatabase() { return m_player_db.get(); }
+	AuthDatabase *getAuthDatabase() { return m_auth_db.get(); }
+
+private:
+	// Copy of a player with everything that is saved
+	struct PlayerCopy
+	{
+		std::unique_ptr<RemotePlayer> player;
+		std::unique_ptr<PlayerSAO> sao;
+	};
+
+	void writeQueued();
+
+	std::unique_ptr<PlayerDatabase> m_player_db;
+	std::unique_ptr<AuthDatabase> m_auth_db;
+	const u32 m_interval_ms;
+
+	std::mutex m_db_mutex;
+
+	std::mutex m_queue_mutex;
+	std::condition_variable m_written_cv;
+	std::map<std::string, PlayerCopy> m_players;
+	std::map<std::string, AuthEntry> m_auths;
+	bool m_writing = false;
+	std::string m_error;
+	u32 m_failed_writes = 0;
+
+	Semaphore m_wake_sem;
+
+	MetricCounterPtr m_write_time_counter;
+	MetricCounterPtr m_write_count_counter;
+	MetricGaugePtr m_write_latency_gauge;
+};
+
+// Player database that saves through a DatabaseWriteThread
+class PlayerDatabaseAsync : public PlayerDatabase
+{
+public:
+	PlayerDatabaseAsync(DatabaseWriteThread *thread) : m_thread(thread) {}
+
+	void savePlayer(RemotePlayer *player);
+	bool loadPlayer(RemotePlayer *player, PlayerSAO *sao);
+	bool removePlayer(const std::string &name);
+	void listPlayers(std::vector<std::string> &res);
+
+private:
+	DatabaseWriteThread *m_thread;
+};
+
+// Auth database that saves through a DatabaseWriteThread
+class AuthDatabaseAsync : public AuthDatabase
+{
+public:
+	AuthDatabaseAsync(DatabaseWriteThread *thread) : m_thread(thread) {}
+
+	bool getAuth(const std::string &name, AuthEntry &res);
+	bool saveAuth(const AuthEntry &authEntry);
+	bool createAuth(AuthEntry &authEntry);
+	bool deleteAuth(const std::string &name);
+	void listNames(std::vector<std::string> &res);
+	void reload();
+
+private:
+	DatabaseWriteThread *m_thread;
+};
+
+/*
+	Mod storage that keeps the entries of the mods in use in memory.
+
+	Changes are collected per key until endSave(), so that repeated writes
+	to the same key reach the database only once, and are then written by
+	a background thread in one transaction.
+*/
+class ModStorageDatabaseAsync : public ModStorageDatabase, private Thread
+{
+public:
+	ModStorageDatabaseAsync(ModStorageDatabase *db, MetricsBackend *mb);
+	// Writes all changes
+	~ModStorageDatabaseAsync();
+
+	void getModEntries(const std::string &modname, StringMap *storage);
+	void getModKeys(const std::string &modname, std::vector<std::string> *storage);
+	bool hasModEntry(const std::string &modname, const std::string &key);
+	bool getModEntry(const std::string &modname,
+		const std::string &key, std::string *value);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+	bool removeModEntries(const std::string &modname);
+	void listMods(std::vector<std::string> *res);
+
+	void beginSave() {}
+	// Hands the changes since the last call to the background thread
+	void endSave();
+
+	// Waits for the changes handed over so far to be written, or to fail
+	void flush();
+
+	// Throws the error of a failed write on the calling thread.
+	// The changes of a failed write are kept and written with the next ones.
+	void checkError();
+
+private:
+	// Changes to the entries of a mod, removed entries have no value
+	struct ModChanges
+	{
+		bool cleared = false;
+		std::unordered_map<std::string, std::optional<std::string>> entries;
+	};
+
+	struct ModState
+	{
+		StringMap entries;
+		ModChanges changes;
+		// Calls that changed entries since the last endSave()
+		u32 writes = 0;
+		MetricCounterPtr write_counter;
+		MetricCounterPtr written_counter;
+	};
+
+	void *run();
+	void writeQueued();
+	ModState &getMod(const std::string &modname);
+
+	std::unique_ptr<ModStorageDatabase> m_db;
+	MetricsBackend *m_metrics_backend;
+	std::unordered_map<std::string, ModState> m_mods;
+
+	std::mutex m_db_mutex;
+
+	std::mutex m_queue_mutex;
+	std::condition_variable m_written_cv;
+	std::unordered_map<std::string, ModChanges> m_queued;
+	bool m_writing = false;
+	std::string m_error;
+	u32 m_failed_writes = 0;
+
+	Semaphore m_wake_sem;
+};
@@ -153,19 +153,34 @@ void Database_PostgreSQL::createTableIfNotExists(const std::string &table_name,
 void Database_PostgreSQL::beginSave()
 {
 	verifyDatabase();
+	if (m_save_depth > 0) {
+		m_save_depth++;
+		return;
+	}
 	checkResults(PQexec(m_conn, "BEGIN;"));
+	m_save_depth = 1;
 }
 
 void Database_PostgreSQL::endSave()
 {
+	if (m_save_depth == 0 || --m_save_depth > 0)
+		return;
 	checkResults(PQexec(m_conn, "COMMIT;"));
 }
 
 void Database_PostgreSQL::rollback()
 {
+	m_save_depth = 0;
 	checkResults(PQexec(m_conn, "ROLLBACK;"));
 }
 
+void Database_PostgreSQL::abortSave()
+{
+	m_save_depth = 0;
+	if (m_conn && PQtransactionStatus(m_conn) != PQTRANS_IDLE)
+		rollback();
+}
+
 MapDatabasePostgreSQL::MapDatabasePostgreSQL(const std::string &connect_string):
 	Database_PostgreSQL(connect_string, ""),
 	MapDatabase()
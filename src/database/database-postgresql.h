@@ -35,6 +35,8 @@ class Database_PostgreSQL: public Database
 	void beginSave();
 	void endSave();
 	void rollback();
+	// Rolls back the open transaction, if any
+	void abortSave();
 
 	bool initialized() const;
 
@@ -112,6 +114,8 @@ class Database_PostgreSQL: public Database
 	std::string m_connect_string;
 	PGconn *m_conn = nullptr;
 	int m_pgversion = 0;
+	// Nested beginSave() calls are part of the outermost transaction
+	u32 m_save_depth = 0;
 };
 
 class MapDatabasePostgreSQL : private Database_PostgreSQL, public MapDatabase
@@ -127,6 +131,7 @@ class MapDatabasePostgreSQL : private Database_PostgreSQL, public MapDatabase
 
 	void beginSave() { Database_PostgreSQL::beginSave(); }
 	void endSave() { Database_PostgreSQL::endSave(); }
+	void abortSave() { Database_PostgreSQL::abortSave(); }
 
 protected:
 	virtual void createDatabase();
@@ -144,6 +149,10 @@ class PlayerDatabasePostgreSQL : private Database_PostgreSQL, public PlayerDatab
 	bool removePlayer(const std::string &name);
 	void listPlayers(std::vector<std::string> &res);
 
+	void beginSave() { Database_PostgreSQL::beginSave(); }
+	void endSave() { Database_PostgreSQL::endSave(); }
+	void abortSave() { Database_PostgreSQL::abortSave(); }
+
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
@@ -167,6 +176,10 @@ class AuthDatabasePostgreSQL : private Database_PostgreSQL, public AuthDatabase
 	virtual void listNames(std::vector<std::string> &res);
 	virtual void reload();
 
+	virtual void beginSave() { Database_PostgreSQL::beginSave(); }
+	virtual void endSave() { Database_PostgreSQL::endSave(); }
+	virtual void abortSave() { Database_PostgreSQL::abortSave(); }
+
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
@@ -193,6 +206,7 @@ class ModStorageDatabasePostgreSQL : private Database_PostgreSQL, public ModStor
 
 	void beginSave() { Database_PostgreSQL::beginSave(); }
 	void endSave() { Database_PostgreSQL::endSave(); }
+	void abortSave() { Database_PostgreSQL::abortSave(); }
 
 protected:
 	virtual void createDatabase();
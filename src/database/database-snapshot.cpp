@@ -0,0 +1,479 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "database-snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include "exceptions.h"
+#include "filesys.h"
+#include "log.h"
+#include "porting.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_DATA_FILE "map_snapshot.dat"
+#define SNAPSHOT_INDEX_FILE "map_snapshot.idx"
+#define SNAPSHOT_LOG_FILE "map_snapshot.log"
+
+static const char SNAPSHOT_DATA_MAGIC[8] = {'M', 'T', 'S', 'N', 'A', 'P', 'D', '1'};
+static const char SNAPSHOT_INDEX_MAGIC[8] = {'M', 'T', 'S', 'N', 'A', 'P', 'I', '2'};
+static const char SNAPSHOT_LOG_MAGIC[8] = {'M', 'T', 'S', 'N', 'A', 'P', 'L', '1'};
+
+/*
+	data header:  magic[8], u64 generation
+	index header: magic[8], u64 generation, u64 data length, u32 index serial,
+	              u32 count
+	log header:   magic[8], u64 generation, u32 index serial
+	index entry:  v3s16 pos, u32 size, u64 offset
+	log entry:    same as index entry, offset 0 if the block was deleted
+*/
+static const size_t DATA_HEADER_SIZE = 8 + 8;
+static const size_t INDEX_HEADER_SIZE = 8 + 8 + 8 + 4 + 4;
+static const size_t LOG_HEADER_SIZE = 8 + 8 + 4;
+static const size_t INDEX_ENTRY_SIZE = 6 + 4 + 8;
+
+// The index is rewritten once the log has more entries than this, or
+// than a quarter of the index, whichever is larger
+static const size_t LOG_MIN_ENTRIES = 1024;
+
+/*
+	MappedFile
+*/
+
+// Whole file mapped read-only into memory
+class MappedFile
+{
+public:
+	MappedFile(const std::string &path)
+	{
+#ifdef _WIN32
+		// No mmap, read the file instead
+		if (fs::ReadFile(path, m_buffer)) {
+			m_data = reinterpret_cast<const u8 *>(m_buffer.data());
+			m_size = m_buffer.size();
+		}
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		struct stat statbuf{};
+		if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0) {
+			void *p = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED) {
+				m_data = static_cast<const u8 *>(p);
+				m_size = statbuf.st_size;
+			}
+		}
+		// The mapping stays valid after closing
+		close(fd);
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifndef _WIN32
+		if (m_data)
+			munmap(const_cast<u8 *>(m_data), m_size);
+#endif
+	}
+
+	DISABLE_CLASS_COPY(MappedFile);
+
+	const u8 *data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	const u8 *m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	std::string m_buffer;
+#endif
+};
+
+/*
+	MapSnapshotReader
+*/
+
+MapSnapshotReader::MapSnapshotReader(const std::string &savedir)
+{
+	m_index_file = std::make_unique<MappedFile>(savedir + DIR_DELIM SNAPSHOT_INDEX_FILE);
+	const u8 *index = m_index_file->data();
+	size_t index_size = m_index_file->size();
+	if (!index || index_size < INDEX_HEADER_SIZE ||
+			memcmp(index, SNAPSHOT_INDEX_MAGIC, 8) != 0)
+		return;
+
+	u64 generation = readU64(&index[8]);
+	u64 data_length = readU64(&index[16]);
+	u32 index_serial = readU32(&index[24]);
+	u32 count = readU32(&index[28]);
+	if (index_size != INDEX_HEADER_SIZE + (size_t)count * INDEX_ENTRY_SIZE)
+		return;
+	m_generation = generation;
+
+	// Before mapping the data file, so that it holds all the log points to
+	readLog(savedir, index_serial);
+
+	m_data_file = std::make_unique<MappedFile>(savedir + DIR_DELIM SNAPSHOT_DATA_FILE);
+	const u8 *data = m_data_file->data();
+	if (!data || m_data_file->size() < data_length ||
+			data_length < DATA_HEADER_SIZE ||
+			memcmp(data, SNAPSHOT_DATA_MAGIC, 8) != 0 ||
+			readU64(&data[8]) != generation) {
+		m_log.clear();
+		m_generation = 0;
+		return;
+	}
+
+	m_entries = &index[INDEX_HEADER_SIZE];
+	m_count = count;
+	m_index_serial = index_serial;
+
+	m_block_count = m_count;
+	for (const auto &it : m_log) {
+		bool in_index = findEntry(it.first) != nullptr;
+		if (it.second.offset != 0 && !in_index)
+			m_block_count++;
+		else if (it.second.offset == 0 && in_index)
+			m_block_count--;
+	}
+}
+
+MapSnapshotReader::~MapSnapshotReader() = default;
+
+void MapSnapshotReader::readLog(const std::string &savedir, u32 index_serial)
+{
+	MappedFile log_file(savedir + DIR_DELIM SNAPSHOT_LOG_FILE);
+	const u8 *log = log_file.data();
+	if (!log || log_file.size() < LOG_HEADER_SIZE ||
+			memcmp(log, SNAPSHOT_LOG_MAGIC, 8) != 0 ||
+			readU64(&log[8]) != m_generation ||
+			readU32(&log[16]) != index_serial)
+		return;
+
+	// An entry that is still being written is left out
+	size_t count = (log_file.size() - LOG_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+	for (size_t i = 0; i < count; i++) {
+		const u8 *entry = &log[LOG_HEADER_SIZE + i * INDEX_ENTRY_SIZE];
+		s64 key = MapDatabase::getBlockAsInteger(readV3S16(entry));
+		m_log[key] = {readU64(&entry[10]), readU32(&entry[6])};
+	}
+}
+
+const u8 *MapSnapshotReader::findEntry(s64 key) const
+{
+	// Binary search in the sorted index
+	u32 lo = 0, hi = m_count;
+	while (lo < hi) {
+		u32 mid = lo + (hi - lo) / 2;
+		const u8 *entry = &m_entries[(size_t)mid * INDEX_ENTRY_SIZE];
+		s64 mid_key = MapDatabase::getBlockAsInteger(readV3S16(entry));
+		if (mid_key < key)
+			lo = mid + 1;
+		else if (mid_key > key)
+			hi = mid;
+		else
+			return entry;
+	}
+	return nullptr;
+}
+
+bool MapSnapshotReader::getEntry(const u8 *entry, const char **data,
+		size_t *size) const
+{
+	u32 entry_size = readU32(&entry[6]);
+	u64 offset = readU64(&entry[10]);
+	if (offset + entry_size > m_data_file->size())
+		return false;
+	*data = reinterpret_cast<const char *>(m_data_file->data() + offset);
+	*size = entry_size;
+	return true;
+}
+
+bool MapSnapshotReader::getBlock(const v3s16 &pos, const char **data,
+		size_t *size) const
+{
+	s64 key = MapDatabase::getBlockAsInteger(pos);
+
+	// Changes since the index was written come first
+	auto it = m_log.find(key);
+	if (it != m_log.end()) {
+		const LogEntry &entry = it->second;
+		if (entry.offset == 0 || entry.offset + entry.size > m_data_file->size())
+			return false;
+		*data = reinterpret_cast<const char *>(m_data_file->data() + entry.offset);
+		*size = entry.size;
+		return true;
+	}
+
+	const u8 *entry = findEntry(key);
+	return entry && getEntry(entry, data, size);
+}
+
+void MapSnapshotReader::forEachBlock(const std::function<void(const v3s16 &pos,
+		const char *data, size_t size)> &f) const
+{
+	const char *data;
+	size_t size;
+	for (u32 i = 0; i < m_count; i++) {
+		const u8 *entry = &m_entries[(size_t)i * INDEX_ENTRY_SIZE];
+		v3s16 pos = readV3S16(entry);
+		if (m_log.find(MapDatabase::getBlockAsInteger(pos)) != m_log.end())
+			continue;
+		if (getEntry(entry, &data, &size))
+			f(pos, data, size);
+	}
+
+	for (const auto &it : m_log) {
+		const LogEntry &entry = it.second;
+		if (entry.offset == 0 || entry.offset + entry.size > m_data_file->size())
+			continue;
+		f(MapDatabase::getIntegerAsBlock(it.first),
+			reinterpret_cast<const char *>(m_data_file->data() + entry.offset),
+			entry.size);
+	}
+}
+
+/*
+	MapDatabaseSnapshot
+*/
+
+MapDatabaseSnapshot::MapDatabaseSnapshot(const std::string &savedir) :
+	m_savedir(savedir)
+{
+	{
+		MapSnapshotReader reader(savedir);
+		if (reader.isOpen()) {
+			m_generation = reader.getGeneration();
+			m_index_serial = reader.m_index_serial;
+			reader.forEachBlock([&] (const v3s16 &pos, const char *data, size_t size) {
+				u64 offset = reinterpret_cast<const u8 *>(data) -
+						reader.m_data_file->data();
+				m_index[getBlockAsInteger(pos)] = {offset, (u32)size};
+			});
+		}
+	}
+
+	if (m_generation == 0 || !openDataFile(false)) {
+		clear();
+		return;
+	}
+
+	// Anything written after the last index is unreachable, but appending
+	// after it is harmless
+	m_data.seekp(0, std::ios::end);
+	m_data_length = m_data.tellp();
+
+	// The end of the log may be torn, start a new one with the first save
+	m_index_modified = true;
+}
+
+MapDatabaseSnapshot::~MapDatabaseSnapshot()
+{
+	endSave();
+}
+
+bool MapDatabaseSnapshot::openDataFile(bool truncate)
+{
+	std::string path = m_savedir + DIR_DELIM SNAPSHOT_DATA_FILE;
+	m_data.close();
+	m_data.clear();
+	if (truncate) {
+		// Readers may have the old file mapped, give them a new one
+		// instead of truncating it under their feet
+		fs::DeleteSingleFileOrEmptyDirectory(path);
+		m_data.open(path, std::ios::in | std::ios::out | std::ios::binary |
+				std::ios::trunc);
+	} else {
+		m_data.open(path, std::ios::in | std::ios::out | std::ios::binary);
+	}
+	return m_data.good();
+}
+
+void MapDatabaseSnapshot::clear()
+{
+	m_index.clear();
+	m_changed.clear();
+	m_generation = ((u64)porting::getTimeS() << 32) | myrand();
+	if (!openDataFile(true))
+		throw DatabaseException("Failed to create map snapshot in " + m_savedir);
+
+	u8 header[DATA_HEADER_SIZE];
+	memcpy(header, SNAPSHOT_DATA_MAGIC, 8);
+	writeU64(&header[8], m_generation);
+	m_data.write(reinterpret_cast<const char *>(header), DATA_HEADER_SIZE);
+	m_data_length = DATA_HEADER_SIZE;
+
+	m_index_modified = true;
+	endSave();
+}
+
+bool MapDatabaseSnapshot::saveBlock(const v3s16 &pos, const std::string &data)
+{
+	m_data.seekp(m_data_length);
+	m_data.write(data.c_str(), data.size());
+	if (!m_data.good()) {
+		errorstream << "MapDatabaseSnapshot: failed to write block "
+				<< pos.X << "," << pos.Y << "," << pos.Z << std::endl;
+		m_data.clear();
+		return false;
+	}
+
+	s64 key = getBlockAsInteger(pos);
+	m_index[key] = {m_data_length, (u32)data.size()};
+	m_data_length += data.size();
+	m_changed.push_back(key);
+	return true;
+}
+
+void MapDatabaseSnapshot::loadBlock(const v3s16 &pos, std::string *block)
+{
+	block->clear();
+	auto it = m_index.find(getBlockAsInteger(pos));
+	if (it == m_index.end())
+		return;
+
+	block->resize(it->second.size);
+	m_data.seekg(it->second.offset);
+	m_data.read(&(*block)[0], it->second.size);
+	if (!m_data.good()) {
+		m_data.clear();
+		block->clear();
+	}
+}
+
+bool MapDatabaseSnapshot::deleteBlock(const v3s16 &pos)
+{
+	s64 key = getBlockAsInteger(pos);
+	if (m_index.erase(key))
+		m_changed.push_back(key);
+	return true;
+}
+
+void MapDatabaseSnapshot::listAllLoadableBlocks(std::vector<v3s16> &dst)
+{
+	dst.reserve(dst.size() + m_index.size());
+	for (const auto &it : m_index)
+		dst.push_back(getIntegerAsBlock(it.first));
+}
+
+void MapDatabaseSnapshot::endSave()
+{
+	if (!m_index_modified && m_changed.empty())
+		return;
+
+	// Readers must find all data the index points to
+	m_data.flush();
+
+	const size_t max_log_count = std::max(LOG_MIN_ENTRIES, m_index.size() / 4);
+	if (m_index_modified || m_log_count + m_changed.size() > max_log_count) {
+		if (!writeIndex())
+			return;
+	} else if (!appendLog()) {
+		return;
+	}
+	m_changed.clear();
+}
+
+bool MapDatabaseSnapshot::writeIndex()
+{
+	// Failing anywhere below leaves the next save to try again
+	m_index_modified = true;
+	m_log.close();
+	m_log.clear();
+
+	const u32 index_serial = m_index_serial + 1;
+	std::string index(INDEX_HEADER_SIZE + m_index.size() * INDEX_ENTRY_SIZE, '\0');
+	u8 *p = reinterpret_cast<u8 *>(&index[0]);
+	memcpy(p, SNAPSHOT_INDEX_MAGIC, 8);
+	writeU64(&p[8], m_generation);
+	writeU64(&p[16], m_data_length);
+	writeU32(&p[24], index_serial);
+	writeU32(&p[28], m_index.size());
+	p += INDEX_HEADER_SIZE;
+	for (const auto &it : m_index) {
+		writeV3S16(p, getIntegerAsBlock(it.first));
+		writeU32(&p[6], it.second.size);
+		writeU64(&p[10], it.second.offset);
+		p += INDEX_ENTRY_SIZE;
+	}
+
+	if (!fs::safeWriteToFile(m_savedir + DIR_DELIM SNAPSHOT_INDEX_FILE, index)) {
+		errorstream << "MapDatabaseSnapshot: failed to write index" << std::endl;
+		return false;
+	}
+	m_index_serial = index_serial;
+
+	// Readers ignore the old log from here on, as it belongs to another index
+	std::string header(LOG_HEADER_SIZE, '\0');
+	p = reinterpret_cast<u8 *>(&header[0]);
+	memcpy(p, SNAPSHOT_LOG_MAGIC, 8);
+	writeU64(&p[8], m_generation);
+	writeU32(&p[16], m_index_serial);
+	const std::string log_path = m_savedir + DIR_DELIM SNAPSHOT_LOG_FILE;
+	if (!fs::safeWriteToFile(log_path, header)) {
+		errorstream << "MapDatabaseSnapshot: failed to write log" << std::endl;
+		return false;
+	}
+	m_log.open(log_path, std::ios::binary | std::ios::app);
+	if (!m_log.good()) {
+		errorstream << "MapDatabaseSnapshot: failed to open log" << std::endl;
+		return false;
+	}
+
+	m_log_count = 0;
+	m_index_modified = false;
+	return true;
+}
+
+bool MapDatabaseSnapshot::appendLog()
+{
+	std::sort(m_changed.begin(), m_changed.end());
+	m_changed.erase(std::unique(m_changed.begin(), m_changed.end()), m_changed.end());
+
+	std::string entries(m_changed.size() * INDEX_ENTRY_SIZE, '\0');
+	u8 *p = reinterpret_cast<u8 *>(&entries[0]);
+	for (s64 key : m_changed) {
+		writeV3S16(p, getIntegerAsBlock(key));
+		auto it = m_index.find(key);
+		if (it != m_index.end()) {
+			writeU32(&p[6], it->second.size);
+			writeU64(&p[10], it->second.offset);
+		}
+		p += INDEX_ENTRY_SIZE;
+	}
+
+	m_log.write(entries.c_str(), entries.size());
+	m_log.flush();
+	if (!m_log.good()) {
+		errorstream << "MapDatabaseSnapshot: failed to append to log" << std::endl;
+		// The log may end in a partial entry now
+		m_index_modified = true;
+		return false;
+	}
+	m_log_count += m_changed.size();
+	return true;
+}
@@ -0,0 +1,141 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "database.h"
+#include "irrlichttypes.h"
+
+/*
+	Map snapshot: a block store meant to be read by other processes (mappers,
+	backups, analytics) while the server keeps running.
+
+	It consists of three files in the world directory:
+	- map_snapshot.dat: header followed by serialized blocks. Only ever
+	  appended to, so data a reader has mapped never changes.
+	- map_snapshot.idx: header and the blocks' offsets into the data file,
+	  sorted by MapDatabase::getBlockAsInteger(). Replaced atomically.
+	- map_snapshot.log: header and the index entries changed since the
+	  index was written, appended on every save. Once it grows too long
+	  compared to the index, both are rewritten.
+
+	All headers carry the same generation number; a reader that sees
+	differing generations raced with a full re-export and should retry.
+	The index and log headers also carry the number of the index the log
+	belongs to. A log of another index is ignored, which only leaves the
+	reader with an older but complete state.
+*/
+
+class MappedFile;
+
+// Read-only, zero-copy view of a map snapshot
+class MapSnapshotReader
+{
+public:
+	MapSnapshotReader(const std::string &savedir);
+	~MapSnapshotReader();
+
+	// False if the snapshot does not exist or is damaged
+	bool isOpen() const { return m_entries != nullptr; }
+
+	u32 getBlockCount() const { return m_block_count; }
+	u64 getGeneration() const { return m_generation; }
+
+	// The data pointers stay valid as long as the reader exists
+	bool getBlock(const v3s16 &pos, const char **data, size_t *size) const;
+	void forEachBlock(const std::function<void(const v3s16 &pos,
+			const char *data, size_t size)> &f) const;
+
+private:
+	friend class MapDatabaseSnapshot;
+
+	// Entry of the log, the offset is 0 for a deleted block
+	struct LogEntry
+	{
+		u64 offset;
+		u32 size;
+	};
+
+	void readLog(const std::string &savedir, u32 index_serial);
+	// Index entry of a block, nullptr if not in the index
+	const u8 *findEntry(s64 key) const;
+	bool getEntry(const u8 *entry, const char **data, size_t *size) const;
+
+	std::unique_ptr<MappedFile> m_index_file;
+	std::unique_ptr<MappedFile> m_data_file;
+	const u8 *m_entries = nullptr;
+	u32 m_count = 0;
+	u32 m_block_count = 0;
+	u64 m_generation = 0;
+	u32 m_index_serial = 0;
+	std::unordered_map<s64, LogEntry> m_log;
+};
+
+// Snapshot as map database, used to keep a snapshot up to date
+// while the map is saved and to read blocks from it
+class MapDatabaseSnapshot : public MapDatabase
+{
+public:
+	MapDatabaseSnapshot(const std::string &savedir);
+	~MapDatabaseSnapshot();
+
+	bool saveBlock(const v3s16 &pos, const std::string &data);
+	void loadBlock(const v3s16 &pos, std::string *block);
+	bool deleteBlock(const v3s16 &pos);
+	void listAllLoadableBlocks(std::vector<v3s16> &dst);
+
+	void beginSave() {}
+	// Writes the changed index entries, making the saved blocks visible to
+	// readers
+	void endSave();
+
+	// Starts over with an empty data file, dropping unreachable data
+	void clear();
+
+private:
+	struct Entry
+	{
+		u64 offset;
+		u32 size;
+	};
+
+	bool openDataFile(bool truncate);
+	// Rewrites the index and starts a new log
+	bool writeIndex();
+	bool appendLog();
+
+	const std::string m_savedir;
+	std::map<s64, Entry> m_index;
+	u64 m_generation = 0;
+	u64 m_data_length = 0;
+	u32 m_index_serial = 0;
+	// Entries in the log, and changed entries not written yet
+	size_t m_log_count = 0;
+	std::vector<s64> m_changed;
+	bool m_index_modified = false;
+	std::fstream m_data;
+	std::ofstream m_log;
+};
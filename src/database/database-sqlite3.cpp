@@ -123,19 +123,40 @@ Database_SQLite3::Database_SQLite3(const std::string &savedir, const std::string
 void Database_SQLite3::beginSave()
 {
 	verifyDatabase();
+	if (m_save_depth > 0) {
+		m_save_depth++;
+		return;
+	}
 	SQLRES(sqlite3_step(m_stmt_begin), SQLITE_DONE,
 		"Failed to start SQLite3 transaction");
 	sqlite3_reset(m_stmt_begin);
+	m_save_depth = 1;
 }
 
 void Database_SQLite3::endSave()
 {
 	verifyDatabase();
+	if (m_save_depth == 0 || --m_save_depth > 0)
+		return;
 	SQLRES(sqlite3_step(m_stmt_end), SQLITE_DONE,
 		"Failed to commit SQLite3 transaction");
 	sqlite3_reset(m_stmt_end);
 }
 
+void Database_SQLite3::abortSave()
+{
+	m_save_depth = 0;
+	if (!m_database)
+		return;
+	// A failed step leaves its statement to be reset
+	sqlite3_reset(m_stmt_begin);
+	sqlite3_reset(m_stmt_end);
+	if (sqlite3_get_autocommit(m_database))
+		return;
+	SQLOK(sqlite3_exec(m_database, "ROLLBACK;", NULL, NULL, NULL),
+		"Failed to roll back SQLite3 transaction");
+}
+
 void Database_SQLite3::openDatabase()
 {
 	if (m_database) return;
@@ -35,6 +35,8 @@ class Database_SQLite3 : public Database
 
 	void beginSave();
 	void endSave();
+	// Rolls back the open transaction, if any
+	void abortSave();
 
 	bool initialized() const { return m_initialized; }
 protected:
@@ -134,6 +136,8 @@ class Database_SQLite3 : public Database
 
 	sqlite3_stmt *m_stmt_begin = nullptr;
 	sqlite3_stmt *m_stmt_end = nullptr;
+	// Nested beginSave() calls are part of the outermost transaction
+	u32 m_save_depth = 0;
 
 	s64 m_busy_handler_data[2];
 
@@ -153,6 +157,7 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 
 	void beginSave() { Database_SQLite3::beginSave(); }
 	void endSave() { Database_SQLite3::endSave(); }
+	void abortSave() { Database_SQLite3::abortSave(); }
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
@@ -178,6 +183,10 @@ class PlayerDatabaseSQLite3 : private Database_SQLite3, public PlayerDatabase
 	bool removePlayer(const std::string &name);
 	void listPlayers(std::vector<std::string> &res);
 
+	void beginSave() { Database_SQLite3::beginSave(); }
+	void endSave() { Database_SQLite3::endSave(); }
+	void abortSave() { Database_SQLite3::abortSave(); }
+
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
@@ -215,6 +224,10 @@ class AuthDatabaseSQLite3 : private Database_SQLite3, public AuthDatabase
 	virtual void listNames(std::vector<std::string> &res);
 	virtual void reload();
 
+	virtual void beginSave() { Database_SQLite3::beginSave(); }
+	virtual void endSave() { Database_SQLite3::endSave(); }
+	virtual void abortSave() { Database_SQLite3::abortSave(); }
+
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
@@ -252,6 +265,7 @@ class ModStorageDatabaseSQLite3 : private Database_SQLite3, public ModStorageDat
 
 	virtual void beginSave() { Database_SQLite3::beginSave(); }
 	virtual void endSave() { Database_SQLite3::endSave(); }
+	virtual void abortSave() { Database_SQLite3::abortSave(); }
 
 protected:
 	virtual void createDatabase();
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <vector>
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
+#include "log.h"
 #include "util/basic_macros.h"
 #include "util/string.h"
 
@@ -32,6 +33,8 @@ class Database
 public:
 	virtual void beginSave() = 0;
 	virtual void endSave() = 0;
+	// Discards the changes since the outermost beginSave() and ends the save
+	virtual void abortSave() {}
 	virtual bool initialized() const { return true; }
 };
 
@@ -58,6 +61,11 @@ class PlayerDatabase
 public:
 	virtual ~PlayerDatabase() = default;
 
+	// Make the saves in between one transaction, where supported
+	virtual void beginSave() {}
+	virtual void endSave() {}
+	virtual void abortSave() {}
+
 	virtual void savePlayer(RemotePlayer *player) = 0;
 	virtual bool loadPlayer(RemotePlayer *player, PlayerSAO *sao) = 0;
 	virtual bool removePlayer(const std::string &name) = 0;
@@ -78,6 +86,11 @@ class AuthDatabase
 public:
 	virtual ~AuthDatabase() = default;
 
+	// Make the saves in between one transaction, where supported
+	virtual void beginSave() {}
+	virtual void endSave() {}
+	virtual void abortSave() {}
+
 	virtual bool getAuth(const std::string &name, AuthEntry &res) = 0;
 	virtual bool saveAuth(const AuthEntry &authEntry) = 0;
 	virtual bool createAuth(AuthEntry &authEntry) = 0;
@@ -102,3 +115,39 @@ class ModStorageDatabase : public Database
 	virtual bool removeModEntries(const std::string &modname) = 0;
 	virtual void listMods(std::vector<std::string> *res) = 0;
 };
+
+/*
+	Begins a save and aborts it unless commit() is reached, so that an
+	exception does not leave a transaction open that never ends.
+*/
+template <typename DB>
+class DatabaseSaveGuard
+{
+public:
+	DatabaseSaveGuard(DB *db) : m_db(db)
+	{
+		m_db->beginSave();
+	}
+
+	~DatabaseSaveGuard()
+	{
+		if (!m_db)
+			return;
+		try {
+			m_db->abortSave();
+		} catch (std::exception &e) {
+			errorstream << "Failed to abort database save: " << e.what() << std::endl;
+		}
+	}
+
+	DISABLE_CLASS_COPY(DatabaseSaveGuard);
+
+	void commit()
+	{
+		m_db->endSave();
+		m_db = nullptr;
+	}
+
+private:
+	DB *m_db;
+};
@@ -37,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include "util/basic_macros.h"
 #include "line3d.h"
+#include "collision.h"
 
 class IGameDef;
 class Map;
@@ -111,6 +112,8 @@ class Environment
 
 	IGameDef *getGameDef() { return m_gamedef; }
 
+	CollisionBoxCache &getCollisionBoxCache() { return m_collision_box_cache; }
+
 protected:
 	std::atomic<float> m_time_of_day_speed;
 
@@ -153,4 +156,7 @@ class Environment
 
 private:
 	std::mutex m_time_lock;
+
+	// Node collision boxes for collisionMoveSimple
+	CollisionBoxCache m_collision_box_cache;
 };
@@ -130,6 +130,21 @@ bool IsExecutable(const std::string &path)
 	return GetBinaryType(path.c_str(), &type) != 0;
 }
 
+bool GetFileInfo(const std::string &path, uint64_t &size, int64_t &mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+	if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		return false;
+	size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	// FILETIME counts 100ns intervals, the epoch doesn't matter for comparing
+	uint64_t ticks = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+		data.ftLastWriteTime.dwLowDateTime;
+	mtime = (int64_t)(ticks * 100);
+	return true;
+}
+
 bool IsDirDelimiter(char c)
 {
 	return c == '/' || c == '\\';
@@ -317,6 +332,23 @@ bool IsExecutable(const std::string &path)
 	return access(path.c_str(), X_OK) == 0;
 }
 
+bool GetFileInfo(const std::string &path, uint64_t &size, int64_t &mtime)
+{
+	struct stat statbuf{};
+	if (stat(path.c_str(), &statbuf))
+		return false;
+	if ((statbuf.st_mode & S_IFDIR) == S_IFDIR)
+		return false;
+	size = statbuf.st_size;
+#ifdef __APPLE__
+	const struct timespec &ts = statbuf.st_mtimespec;
+#else
+	const struct timespec &ts = statbuf.st_mtim;
+#endif
+	mtime = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	return true;
+}
+
 bool IsDirDelimiter(char c)
 {
 	return c == '/';
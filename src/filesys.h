@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
+#include <cstdint>
 #include <set>
 #include <string>
 #include <vector>
@@ -62,6 +63,10 @@ bool IsDir(const std::string &path);
 
 bool IsExecutable(const std::string &path);
 
+// Gets size and last modification time (in nanoseconds) of a file.
+// Returns false if the file doesn't exist or is a directory.
+bool GetFileInfo(const std::string &path, uint64_t &size, int64_t &mtime);
+
 inline bool IsFile(const std::string &path)
 {
 	return PathExists(path) && !IsDir(path);
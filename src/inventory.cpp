@@ -51,7 +51,7 @@ ItemStack::ItemStack(const std::string &name_, u16 count_,
 {
 	if (name.empty() || count == 0)
 		clear();
-	else if (itemdef->get(name).type == ITEM_TOOL)
+	else if (getDefinition(itemdef).type == ITEM_TOOL)
 		count = 1;
 }
 
@@ -88,7 +88,7 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 	clear();
 
 	// Read name
-	name = deSerializeJsonStringIfNeeded(is);
+	std::string itemname = deSerializeJsonStringIfNeeded(is);
 
 	// Skip space
 	std::string tmp;
@@ -96,7 +96,7 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 	if(!tmp.empty())
 		throw SerializationError("Unexpected text after item name");
 
-	if(name == "MaterialItem")
+	if(itemname == "MaterialItem")
 	{
 		// Obsoleted on 2011-07-30
 
@@ -112,14 +112,14 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 		// Convert old id to name
 		NameIdMapping legacy_nimap;
 		content_mapnode_get_name_id_mapping(&legacy_nimap);
-		legacy_nimap.getName(material, name);
-		if(name.empty())
-			name = "unknown_block";
+		legacy_nimap.getName(material, itemname);
+		if(itemname.empty())
+			itemname = "unknown_block";
 		if (itemdef)
-			name = itemdef->getAlias(name);
+			itemname = itemdef->getAlias(itemname);
 		count = materialcount;
 	}
-	else if(name == "MaterialItem2")
+	else if(itemname == "MaterialItem2")
 	{
 		// Obsoleted on 2011-11-16
 
@@ -132,15 +132,15 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 		// Convert old id to name
 		NameIdMapping legacy_nimap;
 		content_mapnode_get_name_id_mapping(&legacy_nimap);
-		legacy_nimap.getName(material, name);
-		if(name.empty())
-			name = "unknown_block";
+		legacy_nimap.getName(material, itemname);
+		if(itemname.empty())
+			itemname = "unknown_block";
 		if (itemdef)
-			name = itemdef->getAlias(name);
+			itemname = itemdef->getAlias(itemname);
 		count = materialcount;
 	}
-	else if(name == "node" || name == "NodeItem" || name == "MaterialItem3"
-			|| name == "craft" || name == "CraftItem")
+	else if(itemname == "node" || itemname == "NodeItem" || itemname == "MaterialItem3"
+			|| itemname == "craft" || itemname == "CraftItem")
 	{
 		// Obsoleted on 2012-01-07
 
@@ -151,24 +151,24 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 		fnd.next("\"");
 		// If didn't skip to end, we have ""s
 		if(!fnd.at_end()){
-			name = fnd.next("\"");
+			itemname = fnd.next("\"");
 		} else { // No luck, just read a word then
 			fnd.start(all);
-			name = fnd.next(" ");
+			itemname = fnd.next(" ");
 		}
 		fnd.skip_over(" ");
 		if (itemdef)
-			name = itemdef->getAlias(name);
+			itemname = itemdef->getAlias(itemname);
 		count = stoi(trim(fnd.next("")));
 		if(count == 0)
 			count = 1;
 	}
-	else if(name == "MBOItem")
+	else if(itemname == "MBOItem")
 	{
 		// Obsoleted on 2011-10-14
 		throw SerializationError("MBOItem not supported anymore");
 	}
-	else if(name == "tool" || name == "ToolItem")
+	else if(itemname == "tool" || itemname == "ToolItem")
 	{
 		// Obsoleted on 2012-01-07
 
@@ -179,16 +179,16 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 		fnd.next("\"");
 		// If didn't skip to end, we have ""s
 		if(!fnd.at_end()){
-			name = fnd.next("\"");
+			itemname = fnd.next("\"");
 		} else { // No luck, just read a word then
 			fnd.start(all);
-			name = fnd.next(" ");
+			itemname = fnd.next(" ");
 		}
 		count = 1;
 		// Then read wear
 		fnd.skip_over(" ");
 		if (itemdef)
-			name = itemdef->getAlias(name);
+			itemname = itemdef->getAlias(itemname);
 		wear = stoi(trim(fnd.next("")));
 	}
 	else
@@ -199,7 +199,7 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 
 			// Apply item aliases
 			if (itemdef)
-				name = itemdef->getAlias(name);
+				itemname = itemdef->getAlias(itemname);
 
 			// Read the count
 			std::string count_str;
@@ -230,9 +230,10 @@ void ItemStack::deSerialize(std::istream &is, IItemDefManager *itemdef)
 		} while(false);
 	}
 
+	name = itemname;
 	if (name.empty() || count == 0)
 		clear();
-	else if (itemdef && itemdef->get(name).type == ITEM_TOOL)
+	else if (itemdef && getDefinition(itemdef).type == ITEM_TOOL)
 		count = 1;
 }
 
@@ -254,7 +255,7 @@ std::string ItemStack::getDescription(const IItemDefManager *itemdef) const
 	std::string desc = metadata.getString("description");
 	if (desc.empty())
 		desc = getDefinition(itemdef).description;
-	return desc.empty() ? name : desc;
+	return desc.empty() ? name.str() : desc;
 }
 
 std::string ItemStack::getShortDescription(const IItemDefManager *itemdef) const
@@ -392,7 +393,7 @@ bool ItemStack::itemFits(ItemStack newitem,
 	return newitem.empty();
 }
 
-bool ItemStack::stacksWith(ItemStack other) const
+bool ItemStack::stacksWith(const ItemStack &other) const
 {
 	return (this->name == other.name &&
 			this->wear == other.wear &&
@@ -484,16 +485,16 @@ void InventoryList::serialize(std::ostream &os, bool incremental) const
 
 	os<<"Width "<<m_width<<"\n";
 
-	for (const auto &item : m_items) {
-		if (item.empty()) {
+	for (u32 i = 0; i < m_items.size(); i++) {
+		const ItemStack &item = m_items[i];
+		if (incremental && !checkSlotModified(i)) {
+			os<<"Keep";
+		} else if (item.empty()) {
 			os<<"Empty";
 		} else {
 			os<<"Item ";
 			item.serialize(os);
 		}
-		// TODO: Implement this:
-		// if (!incremental || item.checkModified())
-		// os << "Keep";
 		os<<"\n";
 	}
 
@@ -566,6 +567,8 @@ InventoryList & InventoryList::operator = (const InventoryList &other)
 	m_name = other.m_name;
 	m_itemdef = other.m_itemdef;
 	//setDirty(true);
+	// The slots no longer say what changed
+	m_dirty_all = true;
 
 	return *this;
 }
@@ -602,7 +605,7 @@ ItemStack InventoryList::changeItem(u32 i, const ItemStack &newitem)
 
 	ItemStack olditem = m_items[i];
 	m_items[i] = newitem;
-	setModified();
+	setSlotModified(i);
 	return olditem;
 }
 
@@ -610,7 +613,7 @@ void InventoryList::deleteItem(u32 i)
 {
 	assert(i < m_items.size()); // Pre-condition
 	m_items[i].clear();
-	setModified();
+	setSlotModified(i);
 }
 
 ItemStack InventoryList::addItem(const ItemStack &newitem_)
@@ -659,7 +662,7 @@ ItemStack InventoryList::addItem(u32 i, const ItemStack &newitem)
 
 	ItemStack leftover = m_items[i].addItem(newitem, m_itemdef);
 	if (leftover != newitem)
-		setModified();
+		setSlotModified(i);
 	return leftover;
 }
 
@@ -718,13 +721,12 @@ ItemStack InventoryList::removeItem(const ItemStack &item)
 					m_itemdef);
 			// Allow oversized stacks
 			removed.count += leftover.count;
+			setSlotModified(m_items.rend() - i - 1);
 
 			if (removed.count == item.count)
 				break;
 		}
 	}
-	if (!removed.empty())
-		setModified();
 	return removed;
 }
 
@@ -735,7 +737,7 @@ ItemStack InventoryList::takeItem(u32 i, u32 takecount)
 
 	ItemStack taken = m_items[i].takeItem(takecount);
 	if (!taken.empty())
-		setModified();
+		setSlotModified(i);
 	return taken;
 }
 
@@ -806,6 +808,24 @@ u32 InventoryList::moveItem(u32 i, InventoryList *dest, u32 dest_i,
 	return (count - item1.count);
 }
 
+void InventoryList::setModified(bool dirty)
+{
+	m_dirty = dirty;
+	m_dirty_all = dirty;
+	if (!dirty)
+		m_dirty_slots.assign(m_items.size(), false);
+}
+
+void InventoryList::setSlotModified(u32 i)
+{
+	m_dirty = true;
+	if (m_dirty_all)
+		return;
+	if (i >= m_dirty_slots.size())
+		m_dirty_slots.resize(m_items.size(), false);
+	m_dirty_slots[i] = true;
+}
+
 void InventoryList::checkResizeLock()
 {
 	if (m_resize_locks == 0)
@@ -68,7 +68,7 @@ struct ItemStack
 
 	void clear()
 	{
-		name = "";
+		name = ItemName();
 		count = 0;
 		wear = 0;
 		metadata.clear();
@@ -90,7 +90,7 @@ struct ItemStack
 	// Maximum size of a stack
 	u16 getStackMax(const IItemDefManager *itemdef) const
 	{
-		return itemdef->get(name).stack_max;
+		return getDefinition(itemdef).stack_max;
 	}
 
 	// Number of items that can be added to this stack
@@ -105,6 +105,8 @@ struct ItemStack
 	// Returns false if item is not known and cannot be used
 	bool isKnown(const IItemDefManager *itemdef) const
 	{
+		if (name.isInterned())
+			return itemdef->isKnownById(name.getId());
 		return itemdef->isKnown(name);
 	}
 
@@ -113,6 +115,8 @@ struct ItemStack
 	const ItemDefinition& getDefinition(
 			const IItemDefManager *itemdef) const
 	{
+		if (name.isInterned())
+			return itemdef->getById(name.getId());
 		return itemdef->get(name);
 	}
 
@@ -121,7 +125,7 @@ struct ItemStack
 			const IItemDefManager *itemdef) const
 	{
 		const ToolCapabilities *item_cap =
-			itemdef->get(name).tool_capabilities;
+			getDefinition(itemdef).tool_capabilities;
 
 		if (item_cap == NULL)
 			// Fall back to the hand's tool capabilities
@@ -164,7 +168,7 @@ struct ItemStack
 
 	// Checks if another itemstack would stack with this one.
 	// Does not check if the item actually fits in the stack.
-	bool stacksWith(ItemStack other) const;
+	bool stacksWith(const ItemStack &other) const;
 
 	// Takes some items.
 	// If there are not enough, takes as many as it can.
@@ -190,7 +194,7 @@ struct ItemStack
 	/*
 		Properties
 	*/
-	std::string name = "";
+	ItemName name;
 	u16 count = 0;
 	u16 wear = 0;
 	ItemStackMetadata metadata;
@@ -286,7 +290,14 @@ class InventoryList
 	void moveItemSomewhere(u32 i, InventoryList *dest, u32 count);
 
 	inline bool checkModified() const { return m_dirty; }
-	inline void setModified(bool dirty = true) { m_dirty = dirty; }
+	// Whether the slot changed since the last setModified(false)
+	inline bool checkSlotModified(u32 i) const
+	{
+		return m_dirty_all || (i < m_dirty_slots.size() && m_dirty_slots[i]);
+	}
+	// Marks the whole list as modified, or nothing with dirty = false
+	void setModified(bool dirty = true);
+	void setSlotModified(u32 i);
 
 	// Problem: C++ keeps references to InventoryList and ItemStack indices
 	// until a better solution is found, this serves as a guard to prevent side-effects
@@ -313,6 +324,9 @@ class InventoryList
 	u32 m_width = 0;
 	IItemDefManager *m_itemdef;
 	bool m_dirty = true;
+	// Incremental updates send only these slots, unless all are dirty
+	bool m_dirty_all = true;
+	std::vector<bool> m_dirty_slots;
 	int m_resize_locks = 0; // Lua callback sanity
 };
 
@@ -36,7 +36,46 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/container.h"
 #include "util/thread.h"
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <unordered_map>
+
+/*
+	ItemName
+*/
+
+namespace {
+	std::mutex item_names_mutex;
+	std::unordered_map<std::string, std::unique_ptr<ItemName::Entry>> item_names;
+}
+
+const ItemName::Entry *ItemName::find(const std::string &name)
+{
+	if (name.empty())
+		return nullptr;
+
+	MutexAutoLock lock(item_names_mutex);
+	auto it = item_names.find(name);
+	return it != item_names.end() ? it->second.get() : nullptr;
+}
+
+ItemName ItemName::registered(const std::string &name)
+{
+	ItemName result;
+	if (name.empty())
+		return result;
+
+	MutexAutoLock lock(item_names_mutex);
+	std::unique_ptr<Entry> &entry = item_names[name];
+	if (!entry) {
+		entry = std::make_unique<Entry>();
+		entry->name = name;
+		entry->id = item_names.size();
+	}
+	result.m_entry = entry.get();
+	return result;
+}
 
 /*
 	ItemDefinition
@@ -337,6 +376,15 @@ class CItemDefManager: public IWritableItemDefManager
 		// Get the definition
 		return m_item_definitions.find(name) != m_item_definitions.cend();
 	}
+	virtual const ItemDefinition &getById(u32 id) const
+	{
+		const ItemDefinition *def = findById(id);
+		return def ? *def : *m_unknown_def;
+	}
+	virtual bool isKnownById(u32 id) const
+	{
+		return findById(id) != nullptr;
+	}
 #ifndef SERVER
 public:
 	ClientCached* createClientCachedDirect(const ItemStack &item, Client *client) const
@@ -422,7 +470,7 @@ class CItemDefManager: public IWritableItemDefManager
 		if (palette && !index.empty())
 			return (*palette)[mystoi(index, 0, 255)];
 		// Fallback color
-		return get(stack.name).color;
+		return stack.getDefinition(this).color;
 	}
 #endif
 	void applyTextureOverrides(const std::vector<TextureOverride> &overrides)
@@ -452,6 +500,8 @@ class CItemDefManager: public IWritableItemDefManager
 		}
 		m_item_definitions.clear();
 		m_aliases.clear();
+		m_definitions_by_id.clear();
+		m_aliases_by_id.clear();
 
 		// Add the four builtin items:
 		//   "" is the hand
@@ -465,21 +515,26 @@ class CItemDefManager: public IWritableItemDefManager
 		hand_def->wield_image = "wieldhand.png";
 		hand_def->tool_capabilities = new ToolCapabilities;
 		m_item_definitions.insert(std::make_pair("", hand_def));
+		setDefinitionById("", hand_def);
 
 		ItemDefinition* unknown_def = new ItemDefinition;
 		unknown_def->type = ITEM_NODE;
 		unknown_def->name = "unknown";
 		m_item_definitions.insert(std::make_pair("unknown", unknown_def));
+		setDefinitionById("unknown", unknown_def);
+		m_unknown_def = unknown_def;
 
 		ItemDefinition* air_def = new ItemDefinition;
 		air_def->type = ITEM_NODE;
 		air_def->name = "air";
 		m_item_definitions.insert(std::make_pair("air", air_def));
+		setDefinitionById("air", air_def);
 
 		ItemDefinition* ignore_def = new ItemDefinition;
 		ignore_def->type = ITEM_NODE;
 		ignore_def->name = "ignore";
 		m_item_definitions.insert(std::make_pair("ignore", ignore_def));
+		setDefinitionById("ignore", ignore_def);
 	}
 	virtual void registerItem(const ItemDefinition &def)
 	{
@@ -492,8 +547,10 @@ class CItemDefManager: public IWritableItemDefManager
 			m_item_definitions[def.name] = new ItemDefinition(def);
 		else
 			*(m_item_definitions[def.name]) = def;
+		setDefinitionById(def.name, m_item_definitions[def.name]);
 
 		// Remove conflicting alias if it exists
+		setAliasById(def.name, NO_ALIAS);
 		bool alias_removed = (m_aliases.erase(def.name) != 0);
 		if(alias_removed)
 			infostream<<"ItemDefManager: erased alias "<<def.name
@@ -505,6 +562,7 @@ class CItemDefManager: public IWritableItemDefManager
 
 		delete m_item_definitions[name];
 		m_item_definitions.erase(name);
+		setDefinitionById(name, nullptr);
 	}
 	virtual void registerAlias(const std::string &name,
 			const std::string &convert_to)
@@ -513,6 +571,7 @@ class CItemDefManager: public IWritableItemDefManager
 			TRACESTREAM(<< "ItemDefManager: setting alias " << name
 				<< " -> " << convert_to << std::endl);
 			m_aliases[name] = convert_to;
+			setAliasById(name, ItemName::registered(convert_to).getId());
 		}
 	}
 	void serialize(std::ostream &os, u16 protocol_version)
@@ -564,10 +623,41 @@ class CItemDefManager: public IWritableItemDefManager
 	}
 
 private:
+	static constexpr u32 NO_ALIAS = U32_MAX;
+
+	// Same as get(), without falling back to "unknown"
+	const ItemDefinition *findById(u32 id) const
+	{
+		if (id < m_aliases_by_id.size() && m_aliases_by_id[id] != NO_ALIAS)
+			id = m_aliases_by_id[id];
+		return id < m_definitions_by_id.size() ? m_definitions_by_id[id] : nullptr;
+	}
+	void setDefinitionById(const std::string &name, ItemDefinition *def)
+	{
+		u32 id = ItemName::registered(name).getId();
+		if (id >= m_definitions_by_id.size())
+			m_definitions_by_id.resize(id + 1, nullptr);
+		m_definitions_by_id[id] = def;
+	}
+	void setAliasById(const std::string &name, u32 convert_to)
+	{
+		u32 id = ItemName::registered(name).getId();
+		if (id >= m_aliases_by_id.size()) {
+			if (convert_to == NO_ALIAS)
+				return;
+			m_aliases_by_id.resize(id + 1, NO_ALIAS);
+		}
+		m_aliases_by_id[id] = convert_to;
+	}
+
 	// Key is name
 	std::map<std::string, ItemDefinition*> m_item_definitions;
 	// Aliases
 	StringMap m_aliases;
+	// The same as above, indexed by ItemName::getId()
+	std::vector<ItemDefinition*> m_definitions_by_id;
+	std::vector<u32> m_aliases_by_id;
+	ItemDefinition *m_unknown_def = nullptr;
 #ifndef SERVER
 	// The id of the thread that is allowed to use irrlicht directly
 	std::thread::id m_main_thread;
@@ -37,6 +37,83 @@ struct ItemMesh;
 struct ItemStack;
 #endif
 
+/*
+	Item name, as stored in ItemStack.
+	Names of registered items and aliases are interned: all ItemNames with
+	such a name share one string, so they are copied and compared like
+	pointers, and each name has a small id that IItemDefManager can look
+	definitions up by.
+	Other names (unknown items, or items not registered yet) are kept as
+	plain strings, so the interned names are bounded by the registered ones
+	and are never freed.
+*/
+class ItemName
+{
+public:
+	// Shared by all ItemNames with the same interned name
+	struct Entry
+	{
+		std::string name;
+		u32 id;
+	};
+
+	ItemName() = default;
+	ItemName(const std::string &name) : m_entry(find(name))
+	{
+		if (!m_entry)
+			m_name = name;
+	}
+	ItemName(const char *name) : ItemName(std::string(name)) {}
+
+	// Interns the name, used by IItemDefManager when registering it
+	static ItemName registered(const std::string &name);
+
+	const std::string &str() const { return m_entry ? m_entry->name : m_name; }
+	operator const std::string &() const { return str(); }
+	const char *c_str() const { return str().c_str(); }
+	size_t size() const { return str().size(); }
+	bool empty() const { return str().empty(); }
+
+	// Whether getId() can be used to look the definition up
+	bool isInterned() const { return m_entry || m_name.empty(); }
+	// 0 is the empty name (the hand), NO_ID a name that is not interned
+	static constexpr u32 NO_ID = U32_MAX;
+	u32 getId() const { return m_entry ? m_entry->id : m_name.empty() ? 0 : NO_ID; }
+
+	bool operator==(const ItemName &other) const
+	{
+		// A name registered after this was created may be on one side only
+		if (m_entry && other.m_entry)
+			return m_entry == other.m_entry;
+		return str() == other.str();
+	}
+	bool operator!=(const ItemName &other) const { return !(*this == other); }
+
+private:
+	static const Entry *find(const std::string &name);
+
+	const Entry *m_entry = nullptr;
+	// Only set if the name is not interned
+	std::string m_name;
+};
+
+inline bool operator==(const ItemName &a, const std::string &b) { return a.str() == b; }
+inline bool operator==(const std::string &a, const ItemName &b) { return a == b.str(); }
+inline bool operator==(const ItemName &a, const char *b) { return a.str() == b; }
+inline bool operator!=(const ItemName &a, const std::string &b) { return a.str() != b; }
+inline bool operator!=(const std::string &a, const ItemName &b) { return a != b.str(); }
+inline bool operator!=(const ItemName &a, const char *b) { return a.str() != b; }
+
+inline std::string operator+(const std::string &a, const ItemName &b) { return a + b.str(); }
+inline std::string operator+(const ItemName &a, const std::string &b) { return a.str() + b; }
+inline std::string operator+(const char *a, const ItemName &b) { return a + b.str(); }
+inline std::string operator+(const ItemName &a, const char *b) { return a.str() + b; }
+
+inline std::ostream &operator<<(std::ostream &os, const ItemName &name)
+{
+	return os << name.str();
+}
+
 /*
 	Base item definition
 */
@@ -119,6 +196,10 @@ class IItemDefManager
 	virtual void getAll(std::set<std::string> &result) const=0;
 	// Check if item is known
 	virtual bool isKnown(const std::string &name) const=0;
+	// Same as get() and isKnown(), by ItemName::getId() instead of the name.
+	// Only valid for interned names, see ItemName::isInterned().
+	virtual const ItemDefinition &getById(u32 id) const=0;
+	virtual bool isKnownById(u32 id) const=0;
 #ifndef SERVER
 	// Get item inventory texture
 	virtual video::ITexture* getInventoryTexture(const ItemStack &item, Client *client) const=0;
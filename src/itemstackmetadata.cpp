@@ -62,7 +62,7 @@ void ItemStackMetadata::serialize(std::ostream &os) const
 {
 	std::ostringstream os2(std::ios_base::binary);
 	os2 << DESERIALIZE_START;
-	for (const auto &stringvar : m_stringvars) {
+	for (const auto &stringvar : getVars()) {
 		if (!stringvar.first.empty() || !stringvar.second.empty())
 			os2 << stringvar.first << DESERIALIZE_KV_DELIM
 				<< stringvar.second << DESERIALIZE_PAIR_DELIM;
@@ -74,8 +74,7 @@ void ItemStackMetadata::deSerialize(std::istream &is)
 {
 	std::string in = deSerializeJsonStringIfNeeded(is);
 
-	m_stringvars.clear();
-
+	StringMap vars;
 	if (!in.empty()) {
 		if (in[0] == DESERIALIZE_START) {
 			Strfnd fnd(in);
@@ -83,25 +82,26 @@ void ItemStackMetadata::deSerialize(std::istream &is)
 			while (!fnd.at_end()) {
 				std::string name = fnd.next(DESERIALIZE_KV_DELIM_STR);
 				std::string var  = fnd.next(DESERIALIZE_PAIR_DELIM_STR);
-				m_stringvars[name] = var;
+				vars[name] = var;
 			}
 		} else {
 			// BACKWARDS COMPATIBILITY
-			m_stringvars[""] = in;
+			vars[""] = in;
 		}
 	}
+	setVars(std::move(vars));
 	updateToolCapabilities();
 }
 
 void ItemStackMetadata::updateToolCapabilities()
 {
 	if (contains(TOOLCAP_KEY)) {
-		toolcaps_overridden = true;
-		toolcaps_override = ToolCapabilities();
+		auto toolcaps = std::make_shared<ToolCapabilities>();
 		std::istringstream is(getString(TOOLCAP_KEY));
-		toolcaps_override.deserializeJson(is);
+		toolcaps->deserializeJson(is);
+		toolcaps_override = std::move(toolcaps);
 	} else {
-		toolcaps_overridden = false;
+		toolcaps_override.reset();
 	}
 }
 
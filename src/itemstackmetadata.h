@@ -28,7 +28,7 @@ class IItemDefManager;
 class ItemStackMetadata : public SimpleMetadata
 {
 public:
-	ItemStackMetadata() : toolcaps_overridden(false) {}
+	ItemStackMetadata() = default;
 
 	// Overrides
 	void clear() override;
@@ -40,7 +40,7 @@ class ItemStackMetadata : public SimpleMetadata
 	const ToolCapabilities &getToolCapabilities(
 			const ToolCapabilities &default_caps) const
 	{
-		return toolcaps_overridden ? toolcaps_override : default_caps;
+		return toolcaps_override ? *toolcaps_override : default_caps;
 	}
 
 	void setToolCapabilities(const ToolCapabilities &caps);
@@ -49,6 +49,6 @@ class ItemStackMetadata : public SimpleMetadata
 private:
 	void updateToolCapabilities();
 
-	bool toolcaps_overridden;
-	ToolCapabilities toolcaps_override;
+	// Shared by copies like the strings
+	std::shared_ptr<const ToolCapabilities> toolcaps_override;
 };
@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "httpfetch.h"
 #include "gameparams.h"
 #include "database/database.h"
+#include "database/database-snapshot.h"
 #include "config.h"
 #include "player.h"
 #include "porting.h"
@@ -127,6 +128,7 @@ static bool determine_subgame(GameParams *game_params);
 static bool run_dedicated_server(const GameParams &game_params, const Settings &cmd_args);
 static bool migrate_map_database(const GameParams &game_params, const Settings &cmd_args);
 static bool recompress_map_database(const GameParams &game_params, const Settings &cmd_args);
+static bool export_map_snapshot(const GameParams &game_params, const Settings &cmd_args);
 
 /**********************************************************************/
 
@@ -382,6 +384,8 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Feature an interactive terminal (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("recompress", ValueSpec(VALUETYPE_FLAG,
 			_("Recompress the blocks of the given map database."))));
+	allowed_options->insert(std::make_pair("export-snapshot", ValueSpec(VALUETYPE_FLAG,
+			_("Export the map to a snapshot that external tools can read while the server runs, and keep it up to date"))));
 #ifndef SERVER
 	allowed_options->insert(std::make_pair("speedtests", ValueSpec(VALUETYPE_FLAG,
 			_("Run speed tests"))));
@@ -1064,6 +1068,9 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	if (cmd_args.getFlag("recompress"))
 		return recompress_map_database(game_params, cmd_args);
 
+	if (cmd_args.getFlag("export-snapshot"))
+		return export_map_snapshot(game_params, cmd_args);
+
 	// Bind address
 	std::string bind_str = g_settings->get("bind_address");
 	Address bind_addr(0, 0, 0, 0, game_params.socket_port);
@@ -1299,3 +1306,63 @@ static bool recompress_map_database(const GameParams &game_params, const Setting
 	actionstream << "Done, " << count << " blocks were recompressed." << std::endl;
 	return true;
 }
+
+static bool export_map_snapshot(const GameParams &game_params, const Settings &cmd_args)
+{
+	Settings world_mt;
+	const std::string world_mt_path = game_params.world_path + DIR_DELIM + "world.mt";
+
+	if (!world_mt.readConfigFile(world_mt_path.c_str())) {
+		errorstream << "Cannot read world.mt at " << world_mt_path << std::endl;
+		return false;
+	}
+	const std::string &backend = world_mt.get("backend");
+	if (backend == "snapshot") {
+		errorstream << "Cannot export: the map backend already is the snapshot" << std::endl;
+		return false;
+	}
+
+	MapDatabase *db = ServerMap::createDatabase(backend, game_params.world_path, world_mt);
+	MapDatabaseSnapshot snapshot(game_params.world_path);
+	// Start over, this also drops data left over from earlier exports
+	snapshot.clear();
+
+	u32 count = 0;
+	u64 last_update_time = 0;
+	bool &kill = *porting::signal_handler_killstatus();
+
+	std::vector<v3s16> blocks;
+	db->listAllLoadableBlocks(blocks);
+	for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+		if (kill) {
+			delete db;
+			return false;
+		}
+
+		std::string data;
+		db->loadBlock(*it, &data);
+		if (!data.empty()) {
+			snapshot.saveBlock(*it, data);
+		} else {
+			errorstream << "Failed to load block " << *it << ", skipping it." << std::endl;
+		}
+		if (++count % 0xFF == 0 && porting::getTimeS() - last_update_time >= 1) {
+			std::cerr << " Exported " << count << " blocks, "
+				<< (100.0f * count / blocks.size()) << "% completed.\r";
+			snapshot.endSave();
+			last_update_time = porting::getTimeS();
+		}
+	}
+	std::cerr << std::endl;
+	snapshot.endSave();
+	delete db;
+
+	actionstream << "Successfully exported " << count << " blocks" << std::endl;
+	world_mt.setBool("snapshot_export", true);
+	if (!world_mt.updateConfigFile(world_mt_path.c_str()))
+		errorstream << "Failed to update world.mt!" << std::endl;
+	else
+		actionstream << "world.mt updated" << std::endl;
+
+	return true;
+}
@@ -42,9 +42,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 #include "database/database.h"
 #include "database/database-dummy.h"
+#include "database/database-snapshot.h"
 #include "database/database-sqlite3.h"
 #include "script/scripting_server.h"
 #include "irrlicht_changes/printing.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include <atomic>
 #include <deque>
 #include <queue>
 #if USE_LEVELDB
@@ -295,6 +299,9 @@ bool Map::removeNodeWithEvent(v3s16 p)
 	return succeeded;
 }
 
+// How long one timerUpdate() call may sweep sectors for
+static const u64 SWEEP_TIME_BUDGET_US = 20000;
+
 struct TimeOrderedMapBlock {
 	MapSector *sect;
 	MapBlock *block;
@@ -310,6 +317,12 @@ struct TimeOrderedMapBlock {
 	};
 };
 
+void Map::saveBlocks(const std::vector<MapBlock *> &blocks)
+{
+	for (MapBlock *block : blocks)
+		saveBlock(block);
+}
+
 /*
 	Updates usage timers
 */
@@ -332,48 +345,97 @@ void Map::timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 
 	// If there is no practical limit, we spare creation of mapblock_queue
 	if (max_loaded_blocks < 0) {
-		for (auto &sector_it : m_sectors) {
-			MapSector *sector = sector_it.second;
+		m_usage_clock += dtime;
+		if (!isSweepInProgress()) {
+			m_sweep_sectors.clear();
+			m_sweep_sectors.reserve(m_sectors.size());
+			for (auto &sector_it : m_sectors)
+				m_sweep_sectors.push_back(sector_it.first);
+			m_sweep_next = 0;
+			m_sweep_kept_blocks = 0;
+		}
 
-			bool all_blocks_deleted = true;
+		std::vector<std::pair<MapSector *, MapBlock *>> unload_blocks;
+		MapBlockVect blocks;
+		while (isSweepInProgress() &&
+				porting::getTimeUs() - start_time < SWEEP_TIME_BUDGET_US) {
+			// Sectors deleted since the sweep started are gone, those
+			// created since then wait for the next sweep
+			auto sector_it = m_sectors.find(m_sweep_sectors[m_sweep_next++]);
+			if (sector_it == m_sectors.end())
+				continue;
+			MapSector *sector = sector_it->second;
+			if (sector->empty()) {
+				sector_deletion_queue.push_back(sector_it->first);
+				continue;
+			}
 
-			MapBlockVect blocks;
+			// Catch up with the time since the sector was last swept
+			float sector_dtime = m_usage_clock - sector->getUsageClock();
+			sector->setUsageClock(m_usage_clock);
+
+			blocks.clear();
 			sector->getBlocks(blocks);
 
 			for (MapBlock *block : blocks) {
-				block->incrementUsageTimer(dtime);
+				block->incrementUsageTimer(sector_dtime);
 
 				if (block->refGet() == 0
 						&& block->getUsageTimer() > unload_timeout) {
-					v3s16 p = block->getPos();
-
-					// Save if modified
-					if (block->getModified() != MOD_STATE_CLEAN
-							&& save_before_unloading) {
-						modprofiler.add(block->getModifiedReasonString(), 1);
-						if (!saveBlock(block))
-							continue;
-						saved_blocks_count++;
-					}
+					unload_blocks.emplace_back(sector, block);
+				} else {
+					sweepBlock(block);
+					m_sweep_kept_blocks++;
+				}
+			}
+		}
 
-					// Delete from memory
-					sector->deleteBlock(block);
+		// Save modified blocks before unloading them, all at once
+		if (save_before_unloading) {
+			std::vector<MapBlock *> save_blocks;
+			for (auto &it : unload_blocks) {
+				MapBlock *block = it.second;
+				if (block->getModified() != MOD_STATE_CLEAN) {
+					modprofiler.add(block->getModifiedReasonString(), 1);
+					save_blocks.push_back(block);
+				}
+			}
+			saveBlocks(save_blocks);
+			for (MapBlock *block : save_blocks) {
+				if (block->getModified() == MOD_STATE_CLEAN)
+					saved_blocks_count++;
+			}
+		}
 
-					if (unloaded_blocks)
-						unloaded_blocks->push_back(p);
+		for (auto &it : unload_blocks) {
+			MapSector *sector = it.first;
+			MapBlock *block = it.second;
+			v3s16 p = block->getPos();
 
-					deleted_blocks_count++;
-				} else {
-					all_blocks_deleted = false;
-					block_count_all++;
-				}
+			if (save_before_unloading && block->getModified() != MOD_STATE_CLEAN) {
+				// Failed to save, keep it
+				m_sweep_kept_blocks++;
+				continue;
 			}
 
+			// Delete from memory
+			sector->deleteBlock(block);
+
+			if (unloaded_blocks)
+				unloaded_blocks->push_back(p);
+
+			deleted_blocks_count++;
+
 			// Delete sector if we emptied it
-			if (all_blocks_deleted) {
-				sector_deletion_queue.push_back(sector_it.first);
-			}
+			if (sector->empty())
+				sector_deletion_queue.push_back(sector->getPos());
 		}
+
+		if (!isSweepInProgress()) {
+			m_swept_block_count = m_sweep_kept_blocks;
+			finishSweep();
+		}
+		block_count_all = m_swept_block_count;
 	} else {
 		std::priority_queue<TimeOrderedMapBlock> mapblock_queue;
 		for (auto &sector_it : m_sectors) {
@@ -557,7 +619,7 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 
 	std::vector<v3s16> check_for_falling;
 
-	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
+	u32 liquid_loop_max = m_liquid_loop_max.get();
 	u32 loop_max = liquid_loop_max;
 
 	while (m_transforming_liquid.size() != 0)
@@ -634,12 +696,14 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 			}
 			v3s16 npos = p0 + liquid_6dirs[i];
 			NodeNeighbor nb(getNode(npos), nt, npos);
-			const ContentFeatures &cfnb = m_nodedef->get(nb.n);
-			if (nt == NEIGHBOR_UPPER && cfnb.floats)
+			// Most neighbors are not liquid, only look at the full
+			// definition when it is needed
+			const ContentHotProperties props_nb = m_nodedef->getHotProperties(nb.n);
+			if (nt == NEIGHBOR_UPPER && props_nb.floats)
 				floating_node_above = true;
-			switch (cfnb.liquid_type) {
+			switch (props_nb.getLiquidType()) {
 				case LIQUID_NONE:
-					if (cfnb.floodable) {
+					if (props_nb.floodable) {
 						airs[num_airs++] = nb;
 						// if the current node is a water source the neighbor
 						// should be enqueded for transformation regardless of whether the
@@ -662,7 +726,8 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 						}
 					}
 					break;
-				case LIQUID_SOURCE:
+				case LIQUID_SOURCE: {
+					const ContentFeatures &cfnb = m_nodedef->get(nb.n);
 					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
 					if (liquid_kind == CONTENT_AIR)
 						liquid_kind = cfnb.liquid_alternative_flowing_id;
@@ -674,7 +739,9 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 							sources[num_sources++] = nb;
 					}
 					break;
-				case LIQUID_FLOWING:
+				}
+				case LIQUID_FLOWING: {
+					const ContentFeatures &cfnb = m_nodedef->get(nb.n);
 					if (nb.t != NEIGHBOR_SAME_LEVEL ||
 						(nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK) {
 						// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
@@ -696,6 +763,7 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 							flowing_down = true;
 					}
 					break;
+				}
 			}
 		}
 
@@ -761,7 +829,7 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 			check if anything has changed. if not, just continue with the next node.
 		 */
 		if (new_node_content == n0.getContent() &&
-				(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+				(m_nodedef->getHotProperties(n0).getLiquidType() != LIQUID_FLOWING ||
 				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
 				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
 				== flowing_down)))
@@ -778,7 +846,7 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 		 */
 		MapNode n00 = n0;
 		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		if (m_nodedef->getHotProperties(new_node_content).getLiquidType() == LIQUID_FLOWING) {
 			// set level to last 3 bits, flowing down bit to 4th bit
 			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
 		} else {
@@ -832,7 +900,7 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 		/*
 			enqueue neighbors for update if necessary
 		 */
-		switch (m_nodedef->get(n0.getContent()).liquid_type) {
+		switch (m_nodedef->getHotProperties(n0).getLiquidType()) {
 			case LIQUID_SOURCE:
 			case LIQUID_FLOWING:
 				// make sure source flows into all neighboring nodes
@@ -866,7 +934,7 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 	/* ----------------------------------------------------------------------
 	 * Manage the queue so that it does not grow indefinitely
 	 */
-	u16 time_until_purge = g_settings->getU16("liquid_queue_purge_time");
+	u16 time_until_purge = m_liquid_queue_purge_time.get();
 
 	if (time_until_purge == 0)
 		return; // Feature disabled
@@ -1250,6 +1318,10 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 		std::string readonly_dir = savedir + DIR_DELIM + "readonly";
 		dbase_ro = createDatabase(conf.get("readonly_backend"), readonly_dir, conf);
 	}
+	// Keep the snapshot created by --export-snapshot up to date
+	if (conf.exists("snapshot_export") && conf.getBool("snapshot_export") &&
+			backend != "snapshot")
+		dbase_snapshot = new MapDatabaseSnapshot(savedir);
 	if (!conf.updateConfigFile(conf_path.c_str()))
 		errorstream << "ServerMap::ServerMap(): Failed to update world.mt!" << std::endl;
 
@@ -1262,6 +1334,15 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 		"minetest_map_saved_blocks", "Number of blocks saved");
 	m_loaded_blocks_gauge = mb->addGauge(
 		"minetest_map_loaded_blocks", "Number of loaded blocks");
+	const char *node_storage_names[] = {"full", "uniform", "palette"};
+	for (int i = 0; i < 3; i++) {
+		m_node_storage_blocks_gauge[i] = mb->addGauge(
+			"minetest_map_node_storage_blocks", "Number of loaded blocks by node storage",
+			{{"storage", node_storage_names[i]}});
+		m_node_storage_bytes_gauge[i] = mb->addGauge(
+			"minetest_map_node_storage_bytes", "Memory used for nodes by node storage",
+			{{"storage", node_storage_names[i]}});
+	}
 
 	m_map_compression_level = rangelim(g_settings->getS16("map_compression_level_disk"), -1, 9);
 
@@ -1330,6 +1411,7 @@ ServerMap::~ServerMap()
 	*/
 	delete dbase;
 	delete dbase_ro;
+	delete dbase_snapshot;
 
 	deleteDetachedBlocks();
 }
@@ -1747,6 +1829,8 @@ MapDatabase *ServerMap::createDatabase(
 		return new MapDatabaseSQLite3(savedir);
 	if (name == "dummy")
 		return new Database_Dummy();
+	if (name == "snapshot")
+		return new MapDatabaseSnapshot(savedir);
 	#if USE_LEVELDB
 	if (name == "leveldb")
 		return new Database_LevelDB(savedir);
@@ -1769,22 +1853,19 @@ MapDatabase *ServerMap::createDatabase(
 void ServerMap::beginSave()
 {
 	dbase->beginSave();
+	if (dbase_snapshot)
+		dbase_snapshot->beginSave();
 }
 
 void ServerMap::endSave()
 {
 	dbase->endSave();
+	if (dbase_snapshot)
+		dbase_snapshot->endSave();
 }
 
-bool ServerMap::saveBlock(MapBlock *block)
+static std::string serializeBlockForSave(MapBlock *block, int compression_level)
 {
-	return saveBlock(block, dbase, m_map_compression_level);
-}
-
-bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level)
-{
-	v3s16 p3d = block->getPos();
-
 	// Format used for writing
 	u8 version = SER_FMT_VER_HIGHEST_WRITE;
 
@@ -1795,8 +1876,162 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 	std::ostringstream o(std::ios_base::binary);
 	o.write((char*) &version, 1);
 	block->serialize(o, version, true, compression_level);
+	return o.str();
+}
+
+/*
+	Serializes blocks for saving on a few worker threads and the calling
+	thread. The blocks must not be used by anything else meanwhile.
+	Serializing does not change the nodes of a block, compacted ones are
+	read through a copy.
+*/
+class BlockSerializer
+{
+public:
+	BlockSerializer(unsigned int num_threads)
+	{
+		for (unsigned int i = 0; i < num_threads; i++) {
+			m_workers.emplace_back(new Worker(this));
+			m_workers.back()->start();
+		}
+	}
+
+	~BlockSerializer()
+	{
+		for (auto &worker : m_workers)
+			worker->stop();
+		for (size_t i = 0; i < m_workers.size(); i++)
+			m_start_sem.post();
+		for (auto &worker : m_workers)
+			worker->wait();
+	}
 
-	bool ret = db->saveBlock(p3d, o.str());
+	DISABLE_CLASS_COPY(BlockSerializer);
+
+	std::vector<std::string> serialize(const std::vector<MapBlock *> &blocks,
+			int compression_level)
+	{
+		std::vector<std::string> result(blocks.size());
+		m_blocks = &blocks;
+		m_result = &result;
+		m_compression_level = compression_level;
+		m_next = 0;
+
+		for (size_t i = 0; i < m_workers.size(); i++)
+			m_start_sem.post();
+		work();
+		for (size_t i = 0; i < m_workers.size(); i++)
+			m_done_sem.wait();
+
+		m_blocks = nullptr;
+		m_result = nullptr;
+		return result;
+	}
+
+private:
+	class Worker : public Thread
+	{
+	public:
+		Worker(BlockSerializer *serializer) :
+			Thread("BlockSerializer"),
+			m_serializer(serializer)
+		{}
+
+		void *run()
+		{
+			BEGIN_DEBUG_EXCEPTION_HANDLER
+
+			while (true) {
+				m_serializer->m_start_sem.wait();
+				if (stopRequested())
+					break;
+				m_serializer->work();
+				m_serializer->m_done_sem.post();
+			}
+
+			END_DEBUG_EXCEPTION_HANDLER
+			return nullptr;
+		}
+
+	private:
+		BlockSerializer *m_serializer;
+	};
+
+	// Blocks that fail to serialize are left empty in the result
+	void work()
+	{
+		size_t i;
+		while ((i = m_next++) < m_blocks->size()) {
+			MapBlock *block = (*m_blocks)[i];
+			try {
+				(*m_result)[i] = serializeBlockForSave(block, m_compression_level);
+			} catch (std::exception &e) {
+				errorstream << "BlockSerializer: failed to serialize block "
+						<< block->getPos() << ": " << e.what() << std::endl;
+			}
+		}
+	}
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	Semaphore m_start_sem;
+	Semaphore m_done_sem;
+
+	const std::vector<MapBlock *> *m_blocks = nullptr;
+	std::vector<std::string> *m_result = nullptr;
+	int m_compression_level = -1;
+	std::atomic<size_t> m_next{0};
+};
+
+void ServerMap::saveBlocks(const std::vector<MapBlock *> &blocks)
+{
+	// Not worth waking the workers for
+	if (blocks.size() < 4) {
+		Map::saveBlocks(blocks);
+		return;
+	}
+
+	if (!m_block_serializer) {
+		unsigned int num_threads = Thread::getNumberOfProcessors();
+		num_threads = rangelim(num_threads, 2U, 5U) - 1;
+		m_block_serializer = std::make_unique<BlockSerializer>(num_threads);
+	}
+
+	std::vector<std::string> data;
+	{
+		ScopeProfiler sp(g_profiler, "ServerMap: serialize blocks", SPT_AVG);
+		data = m_block_serializer->serialize(blocks, m_map_compression_level);
+	}
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		MapBlock *block = blocks[i];
+		// Unsaved blocks stay modified and are kept in memory
+		if (data[i].empty() || !dbase->saveBlock(block->getPos(), data[i]))
+			continue;
+		if (dbase_snapshot)
+			dbase_snapshot->saveBlock(block->getPos(), data[i]);
+		block->resetModified();
+	}
+}
+
+bool ServerMap::saveBlock(MapBlock *block)
+{
+	if (!dbase_snapshot)
+		return saveBlock(block, dbase, m_map_compression_level);
+
+	// Serialize once for both databases
+	std::string data = serializeBlockForSave(block, m_map_compression_level);
+	bool ret = dbase->saveBlock(block->getPos(), data);
+	if (ret) {
+		dbase_snapshot->saveBlock(block->getPos(), data);
+		block->resetModified();
+	}
+	return ret;
+}
+
+bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level)
+{
+	bool ret = db->saveBlock(block->getPos(),
+			serializeBlockForSave(block, compression_level));
 	if (ret) {
 		// We just wrote it to the disk so clear modified flag
 		block->resetModified();
@@ -1907,6 +2142,8 @@ bool ServerMap::deleteBlock(v3s16 blockpos)
 {
 	if (!dbase->deleteBlock(blockpos))
 		return false;
+	if (dbase_snapshot)
+		dbase_snapshot->deleteBlock(blockpos);
 
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
 	if (block) {
@@ -1939,6 +2176,28 @@ void ServerMap::step()
 	deleteDetachedBlocks();
 }
 
+void ServerMap::sweepBlock(MapBlock *block)
+{
+	const float compact_timeout = m_compact_timeout.get();
+	if (compact_timeout > 0 && block->refGet() == 0 &&
+			block->getUsageTimer() > compact_timeout)
+		block->compactNodes();
+
+	MapBlock::NodeStorage storage = block->getNodeStorage();
+	m_sweep_node_storage_blocks[storage]++;
+	m_sweep_node_storage_bytes[storage] += block->getNodeMemoryUsage();
+}
+
+void ServerMap::finishSweep()
+{
+	for (int i = 0; i < 3; i++) {
+		m_node_storage_blocks_gauge[i]->set(m_sweep_node_storage_blocks[i]);
+		m_node_storage_bytes_gauge[i]->set(m_sweep_node_storage_bytes[i]);
+		m_sweep_node_storage_blocks[i] = 0;
+		m_sweep_node_storage_bytes[i] = 0;
+	}
+}
+
 void ServerMap::PrintInfo(std::ostream &out)
 {
 	out<<"ServerMap: ";
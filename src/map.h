@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <set>
 #include <map>
 #include <list>
+#include <memory>
 
 #include "irrlichttypes_bloated.h"
 #include "mapblock.h"
@@ -36,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "nodetimer.h"
 #include "map_settings_manager.h"
+#include "settings.h"
 #include "debug.h"
 
 class Settings;
@@ -49,6 +51,7 @@ class IGameDef;
 class IRollbackManager;
 class EmergeManager;
 class MetricsBackend;
+class BlockSerializer;
 class ServerEnvironment;
 struct BlockMakeData;
 
@@ -211,14 +214,26 @@ class Map /*: public NodeContainer*/
 	// Client leaves them as no-op.
 	virtual bool saveBlock(MapBlock *block) { return false; }
 	virtual bool deleteBlock(v3s16 blockpos) { return false; }
+	// Saves many blocks, those saved are no longer modified afterwards
+	virtual void saveBlocks(const std::vector<MapBlock *> &blocks);
 
 	/*
 		Updates usage timers and unloads unused blocks and sectors.
 		Saves modified blocks before unloading if possible.
+
+		Without a limit on loaded blocks, only the sectors that can be
+		swept in a few milliseconds are, and the next calls continue with
+		the rest until the whole map was swept.
 	*/
 	void timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 			std::vector<v3s16> *unloaded_blocks=NULL);
 
+	// Whether timerUpdate() has sectors left to sweep
+	bool isSweepInProgress() const { return m_sweep_next < m_sweep_sectors.size(); }
+
+	// The time the usage timers of the blocks have been advanced by in total
+	double getUsageClock() const { return m_usage_clock; }
+
 	/*
 		Unloads all blocks with a zero refCount().
 		Saves modified blocks before unloading if possible.
@@ -317,11 +332,23 @@ class Map /*: public NodeContainer*/
 	MapSector *m_sector_cache = nullptr;
 	v2s16 m_sector_cache_p;
 
+	// State of the sweep done by timerUpdate()
+	double m_usage_clock = 0;
+	std::vector<v2s16> m_sweep_sectors;
+	size_t m_sweep_next = 0;
+	u32 m_sweep_kept_blocks = 0;
+	// Blocks kept in memory by the last complete sweep
+	u32 m_swept_block_count = 0;
+
 	// This stores the properties of the nodes on the map.
 	const NodeDefManager *m_nodedef;
 
 	// Can be implemented by child class
 	virtual void reportMetrics(u64 save_time_us, u32 saved_blocks, u32 all_blocks) {}
+	// Called by timerUpdate() for each block it keeps in memory, and when
+	// it has swept the whole map
+	virtual void sweepBlock(MapBlock *block) {}
+	virtual void finishSweep() {}
 
 	bool determineAdditionalOcclusionCheck(const v3s16 &pos_camera,
 		const core::aabbox3d<s16> &block_bounds, v3s16 &check);
@@ -408,6 +435,8 @@ class ServerMap : public Map
 
 	bool saveBlock(MapBlock *block) override;
 	static bool saveBlock(MapBlock *block, MapDatabase *db, int compression_level = -1);
+	// Serializes the blocks on worker threads, then writes them
+	void saveBlocks(const std::vector<MapBlock *> &blocks) override;
 	MapBlock* loadBlock(v3s16 p);
 	// Database version
 	void loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool save_after_load=false);
@@ -450,6 +479,9 @@ class ServerMap : public Map
 protected:
 
 	void reportMetrics(u64 save_time_us, u32 saved_blocks, u32 all_blocks) override;
+	// Compacts the nodes of idle blocks and reports the node memory
+	void sweepBlock(MapBlock *block) override;
+	void finishSweep() override;
 
 private:
 	friend class ModApiMapgen; // for m_transforming_liquid
@@ -473,6 +505,11 @@ class ServerMap : public Map
 	u32 m_unprocessed_count = 0;
 	u64 m_inc_trending_up_start_time = 0; // milliseconds
 	bool m_queue_size_timer_started = false;
+	SettingHandle<s32> m_liquid_loop_max{"liquid_loop_max"};
+	SettingHandle<u16> m_liquid_queue_purge_time{"liquid_queue_purge_time"};
+
+	// Idle blocks are compacted after this long, see MapBlock::compactNodes()
+	SettingHandle<float> m_compact_timeout{"mapblock_compact_timeout"};
 
 	/*
 		Metadata is re-written on disk only if this is true.
@@ -481,11 +518,20 @@ class ServerMap : public Map
 	bool m_map_metadata_changed = true;
 	MapDatabase *dbase = nullptr;
 	MapDatabase *dbase_ro = nullptr;
+	// Optional copy of the map for external readers, see database-snapshot.h
+	MapDatabase *dbase_snapshot = nullptr;
 
 	// Map metrics
 	MetricGaugePtr m_loaded_blocks_gauge;
 	MetricCounterPtr m_save_time_counter;
 	MetricCounterPtr m_save_count_counter;
+	// By MapBlock::NodeStorage
+	MetricGaugePtr m_node_storage_blocks_gauge[3];
+	MetricGaugePtr m_node_storage_bytes_gauge[3];
+	u32 m_sweep_node_storage_blocks[3] = {};
+	size_t m_sweep_node_storage_bytes[3] = {};
+
+	std::unique_ptr<BlockSerializer> m_block_serializer;
 };
 
 
@@ -19,7 +19,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <atomic>
+#include <memory>
 #include <sstream>
+#include <unordered_map>
 #include "map.h"
 #include "light.h"
 #include "nodedef.h"
@@ -39,6 +42,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/serialize.h"
 #include "util/basic_macros.h"
 
+// Source of MapBlock::m_serial
+static std::atomic<u32> next_block_serial(0);
+
 static const char *modified_reason_strings[] = {
 	"initial",
 	"reallocate",
@@ -70,7 +76,8 @@ MapBlock::MapBlock(v3s16 pos, IGameDef *gamedef):
 		m_pos(pos),
 		m_pos_relative(pos * MAP_BLOCKSIZE),
 		data(new MapNode[nodecount]),
-		m_gamedef(gamedef)
+		m_gamedef(gamedef),
+		m_serial(next_block_serial.fetch_add(1, std::memory_order_relaxed))
 {
 	reallocate();
 }
@@ -85,6 +92,7 @@ MapBlock::~MapBlock()
 #endif
 
 	delete[] data;
+	delete[] m_node_indices;
 }
 
 bool MapBlock::onObjectsActivation()
@@ -173,7 +181,14 @@ void MapBlock::copyTo(VoxelManipulator &dst)
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
 	// Copy from data to VoxelManipulator
-	dst.copyFrom(data, data_area, v3s16(0,0,0),
+	if (m_node_storage == NODE_STORAGE_FULL) {
+		dst.copyFrom(data, data_area, v3s16(0,0,0),
+				getPosRelative(), data_size);
+		return;
+	}
+	std::unique_ptr<MapNode[]> nodes(new MapNode[nodecount]);
+	copyNodesTo(nodes.get());
+	dst.copyFrom(nodes.get(), data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
 }
 
@@ -183,8 +198,10 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
 	// Copy from VoxelManipulator to data
+	expandNodes();
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+	m_node_version++;
 }
 
 void MapBlock::actuallyUpdateDayNightDiff()
@@ -202,7 +219,7 @@ void MapBlock::actuallyUpdateDayNightDiff()
 
 	MapNode previous_n(CONTENT_IGNORE);
 	for (u32 i = 0; i < nodecount; i++) {
-		MapNode n = data[i];
+		MapNode n = readNode(i);
 
 		// If node is identical to previous node, don't verify if it differs
 		if (n == previous_n)
@@ -221,7 +238,7 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	if (differs) {
 		bool only_air = true;
 		for (u32 i = 0; i < nodecount; i++) {
-			MapNode &n = data[i];
+			MapNode n = readNode(i);
 			if (n.getContent() != CONTENT_AIR) {
 				only_air = false;
 				break;
@@ -240,6 +257,91 @@ void MapBlock::expireDayNightDiff()
 	m_day_night_differs_expired = true;
 }
 
+void MapBlock::compactNodes()
+{
+	if (m_node_storage != NODE_STORAGE_FULL)
+		return;
+
+	// Find the distinct nodes, giving up when there are too many
+	std::vector<MapNode> palette;
+	std::unordered_map<u32, u8> palette_index;
+	std::unique_ptr<u8[]> indices(new u8[nodecount]);
+	MapNode previous_n;
+	u8 previous_index = 0;
+	for (u32 i = 0; i < nodecount; i++) {
+		MapNode n = readNode(i);
+		if (i > 0 && n == previous_n) {
+			indices[i] = previous_index;
+			continue;
+		}
+		u32 key = (u32)n.param0 << 16 | (u32)n.param1 << 8 | n.param2;
+		auto it = palette_index.find(key);
+		if (it == palette_index.end()) {
+			if (palette.size() == 256)
+				return;
+			it = palette_index.emplace(key, palette.size()).first;
+			palette.push_back(n);
+		}
+		indices[i] = it->second;
+		previous_n = n;
+		previous_index = it->second;
+	}
+
+	MapNode *new_data = new MapNode[palette.size()];
+	std::copy(palette.begin(), palette.end(), new_data);
+	delete[] data;
+	data = new_data;
+	delete[] m_node_indices;
+	m_node_indices = nullptr;
+
+	if (palette.size() == 1) {
+		m_node_storage = NODE_STORAGE_UNIFORM;
+	} else {
+		m_node_indices = indices.release();
+		m_node_storage = NODE_STORAGE_PALETTE;
+	}
+	m_palette_size = palette.size();
+}
+
+void MapBlock::expandCompactNodes()
+{
+	MapNode *new_data = new MapNode[nodecount];
+	copyNodesTo(new_data);
+	delete[] data;
+	data = new_data;
+	delete[] m_node_indices;
+	m_node_indices = nullptr;
+	m_node_storage = NODE_STORAGE_FULL;
+}
+
+void MapBlock::copyNodesTo(MapNode *dst) const
+{
+	switch (m_node_storage) {
+	case NODE_STORAGE_FULL:
+		memcpy(dst, data, nodecount * sizeof(MapNode));
+		break;
+	case NODE_STORAGE_UNIFORM:
+		std::fill(dst, dst + nodecount, data[0]);
+		break;
+	case NODE_STORAGE_PALETTE:
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = data[m_node_indices[i]];
+		break;
+	}
+}
+
+size_t MapBlock::getNodeMemoryUsage() const
+{
+	switch (m_node_storage) {
+	case NODE_STORAGE_UNIFORM:
+		return sizeof(MapNode);
+	case NODE_STORAGE_PALETTE:
+		return nodecount + m_palette_size * sizeof(MapNode);
+	default:
+		return nodecount * sizeof(MapNode);
+	}
+}
+
 /*
 	Serialization
 */
@@ -389,7 +491,7 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
  	if(disk)
 	{
 		MapNode *tmp_nodes = new MapNode[nodecount];
-		memcpy(tmp_nodes, data, nodecount * sizeof(MapNode));
+		copyNodesTo(tmp_nodes);
 		getBlockNodeIdMapping(&nimap, tmp_nodes, m_gamedef->ndef());
 
 		buf = MapNode::serializeBulk(version, tmp_nodes, nodecount,
@@ -403,11 +505,18 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 			nimap.serialize(os);
 		}
 	}
-	else
+	else if (m_node_storage == NODE_STORAGE_FULL)
 	{
 		buf = MapNode::serializeBulk(version, data, nodecount,
 				content_width, params_width);
 	}
+	else
+	{
+		std::unique_ptr<MapNode[]> tmp_nodes(new MapNode[nodecount]);
+		copyNodesTo(tmp_nodes.get());
+		buf = MapNode::serializeBulk(version, tmp_nodes.get(), nodecount,
+				content_width, params_width);
+	}
 
 	writeU8(os, content_width);
 	writeU8(os, params_width);
@@ -474,6 +583,10 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()<<std::endl);
 
+	// The nodes are read into the full array
+	expandNodes();
+	m_node_version++;
+
 	m_day_night_differs_expired = false;
 
 	if(version <= 21)
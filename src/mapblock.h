@@ -90,6 +90,7 @@ class MapBlock
 
 	void reallocate()
 	{
+		expandNodes();
 		for (u32 i = 0; i < nodecount; i++)
 			data[i] = MapNode(CONTENT_IGNORE);
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
@@ -97,9 +98,40 @@ class MapBlock
 
 	MapNode* getData()
 	{
+		expandNodes();
 		return data;
 	}
 
+	////
+	//// Node storage
+	////
+
+	/*
+		Blocks that are not used for a while can keep their nodes in less
+		memory. Reading nodes works the same in all of them, writing nodes
+		or getData() brings back the full array.
+	*/
+	enum NodeStorage : u8 {
+		// nodecount nodes
+		NODE_STORAGE_FULL,
+		// All nodes are data[0]
+		NODE_STORAGE_UNIFORM,
+		// data holds up to 256 distinct nodes, m_node_indices which one
+		// each node is
+		NODE_STORAGE_PALETTE,
+	};
+
+	inline NodeStorage getNodeStorage() const
+	{
+		return m_node_storage;
+	}
+
+	// Moves the nodes into the smallest storage that fits them
+	void compactNodes();
+
+	// Bytes used for the nodes
+	size_t getNodeMemoryUsage() const;
+
 	////
 	//// Modification tracking methods
 	////
@@ -113,8 +145,10 @@ class MapBlock
 		} else if (mod == m_modified) {
 			m_modified_reason |= reason;
 		}
-		if (mod == MOD_STATE_WRITE_NEEDED)
+		if (mod == MOD_STATE_WRITE_NEEDED) {
 			contents.clear();
+			m_node_version++;
+		}
 	}
 
 	inline u32 getModified()
@@ -135,6 +169,16 @@ class MapBlock
 		m_modified_reason = 0;
 	}
 
+	/*
+		Changes whenever the nodes may have been written. No two blocks
+		created in this process share a value, so a block that was unloaded
+		and loaded again is told apart as well.
+	*/
+	inline u64 getNodeVersion() const
+	{
+		return (u64)m_serial << 32 | m_node_version;
+	}
+
 	////
 	//// Flags
 	////
@@ -247,7 +291,7 @@ class MapBlock
 		if (!*valid_position)
 			return {CONTENT_IGNORE};
 
-		return data[z * zstride + y * ystride + x];
+		return readNode(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNode(v3s16 p, bool *valid_position)
@@ -266,6 +310,7 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
+		expandNodes();
 		data[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
@@ -281,7 +326,7 @@ class MapBlock
 
 	inline MapNode getNodeNoCheck(s16 x, s16 y, s16 z)
 	{
-		return data[z * zstride + y * ystride + x];
+		return readNode(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNodeNoCheck(v3s16 p)
@@ -291,6 +336,7 @@ class MapBlock
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode n)
 	{
+		expandNodes();
 		data[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
@@ -449,6 +495,24 @@ class MapBlock
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
+	inline MapNode readNode(u32 i) const
+	{
+		if (m_node_storage == NODE_STORAGE_FULL)
+			return data[i];
+		if (m_node_storage == NODE_STORAGE_UNIFORM)
+			return data[0];
+		return data[m_node_indices[i]];
+	}
+
+	inline void expandNodes()
+	{
+		if (m_node_storage != NODE_STORAGE_FULL)
+			expandCompactNodes();
+	}
+	void expandCompactNodes();
+	// Writes all nodes to dst, which has room for nodecount nodes
+	void copyNodesTo(MapNode *dst) const;
+
 	/*
 	 * PLEASE NOTE: When adding something here be mindful of position and size
 	 * of member variables! This is also the reason for the weird public-private
@@ -468,6 +532,11 @@ class MapBlock
 	// see isOrphan()
 	bool m_orphan = false;
 
+	// see getNodeStorage()
+	NodeStorage m_node_storage = NODE_STORAGE_FULL;
+	// Number of nodes in data if compacted
+	u16 m_palette_size = 0;
+
 	// Position in blocks on parent
 	v3s16 m_pos;
 
@@ -490,7 +559,8 @@ class MapBlock
 	 * heap fragmentation (the array is exactly 16K), CPU caches and/or
 	 * optimizability of algorithms working on this array.
 	 */
-	MapNode *const data; // of `nodecount` elements
+	MapNode *data; // of `nodecount` elements, fewer if compacted
+	u8 *m_node_indices = nullptr; // NODE_STORAGE_PALETTE only
 
 	// provides the item and node definitions
 	IGameDef *m_gamedef;
@@ -524,6 +594,10 @@ class MapBlock
 	u16 m_modified = MOD_STATE_WRITE_NEEDED;
 	u32 m_modified_reason = MOD_REASON_INITIAL;
 
+	// see getNodeVersion()
+	const u32 m_serial;
+	u32 m_node_version = 0;
+
 	/*
 		When block is removed from active blocks, this is set to gametime.
 		Value BLOCK_TIMESTAMP_UNDEFINED=0xffffffff means there is no timestamp.
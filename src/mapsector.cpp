@@ -19,13 +19,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapsector.h"
 #include "exceptions.h"
+#include "map.h"
 #include "mapblock.h"
 #include "serialization.h"
 
 MapSector::MapSector(Map *parent, v2s16 pos, IGameDef *gamedef):
 		m_parent(parent),
 		m_pos(pos),
-		m_gamedef(gamedef)
+		m_gamedef(gamedef),
+		m_usage_clock(parent->getUsageClock())
 {
 }
 
@@ -67,6 +67,11 @@ class MapSector
 	bool empty() const { return m_blocks.empty(); }
 
 	int size() const { return m_blocks.size(); }
+
+	// Map::getUsageClock() when the usage timers of the blocks were last
+	// advanced
+	double getUsageClock() const { return m_usage_clock; }
+	void setUsageClock(double clock) { m_usage_clock = clock; }
 protected:
 
 	// The pile of MapBlocks
@@ -83,6 +88,8 @@ class MapSector
 	MapBlock *m_block_cache = nullptr;
 	s16 m_block_cache_y;
 
+	double m_usage_clock;
+
 	/*
 		Private methods
 	*/
@@ -30,6 +30,8 @@ bool IMetadata::operator==(const IMetadata &other) const
 	const StringMap &this_map = getStrings(&this_map_);
 	const StringMap &other_map = other.getStrings(&other_map_);
 
+	if (&this_map == &other_map)
+		return true;
 	if (this_map.size() != other_map.size())
 		return false;
 
@@ -87,57 +89,84 @@ const std::string &IMetadata::resolveString(const std::string &str, std::string
 	SimpleMetadata
 */
 
+const StringMap &SimpleMetadata::getVars() const
+{
+	static const StringMap no_vars;
+	return m_stringvars ? *m_stringvars : no_vars;
+}
+
+StringMap &SimpleMetadata::modifyVars()
+{
+	if (!m_stringvars)
+		m_stringvars = std::make_shared<StringMap>();
+	else if (m_stringvars.use_count() > 1)
+		m_stringvars = std::make_shared<StringMap>(*m_stringvars);
+	return *m_stringvars;
+}
+
+void SimpleMetadata::setVars(StringMap &&vars)
+{
+	if (vars.empty())
+		m_stringvars.reset();
+	else
+		m_stringvars = std::make_shared<StringMap>(std::move(vars));
+}
+
 void SimpleMetadata::clear()
 {
-	m_stringvars.clear();
+	m_stringvars.reset();
 	m_modified = true;
 }
 
 bool SimpleMetadata::empty() const
 {
-	return m_stringvars.empty();
+	return getVars().empty();
 }
 
 size_t SimpleMetadata::size() const
 {
-	return m_stringvars.size();
+	return getVars().size();
 }
 
 bool SimpleMetadata::contains(const std::string &name) const
 {
-	return m_stringvars.find(name) != m_stringvars.end();
+	return getVars().count(name) != 0;
 }
 
 const StringMap &SimpleMetadata::getStrings(StringMap *) const
 {
-	return m_stringvars;
+	return getVars();
 }
 
 const std::vector<std::string> &SimpleMetadata::getKeys(std::vector<std::string> *place) const
 {
+	const StringMap &vars = getVars();
 	place->clear();
-	place->reserve(m_stringvars.size());
-	for (const auto &pair : m_stringvars)
+	place->reserve(vars.size());
+	for (const auto &pair : vars)
 		place->push_back(pair.first);
 	return *place;
 }
 
 const std::string *SimpleMetadata::getStringRaw(const std::string &name, std::string *) const
 {
-	const auto found = m_stringvars.find(name);
-	return found != m_stringvars.cend() ? &found->second : nullptr;
+	const StringMap &vars = getVars();
+	const auto found = vars.find(name);
+	return found != vars.cend() ? &found->second : nullptr;
 }
 
 bool SimpleMetadata::setString(const std::string &name, const std::string &var)
 {
 	if (var.empty()) {
-		if (m_stringvars.erase(name) == 0)
+		if (!contains(name))
 			return false;
+		modifyVars().erase(name);
 	} else {
-		StringMap::iterator it = m_stringvars.find(name);
-		if (it != m_stringvars.end() && it->second == var)
+		const StringMap &vars = getVars();
+		auto it = vars.find(name);
+		if (it != vars.end() && it->second == var)
 			return false;
-		m_stringvars[name] = var;
+		modifyVars()[name] = var;
 	}
 	m_modified = true;
 	return true;
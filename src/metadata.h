@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "irr_v3d.h"
 #include <iostream>
+#include <memory>
 #include <vector>
 #include "util/string.h"
 
@@ -77,6 +78,7 @@ class IMetadata
 class SimpleMetadata: public virtual IMetadata
 {
 	bool m_modified = false;
+	std::shared_ptr<StringMap> m_stringvars;
 public:
 	virtual ~SimpleMetadata() = default;
 
@@ -115,7 +117,10 @@ class SimpleMetadata: public virtual IMetadata
 	inline void setModified(bool v) { m_modified = v; }
 
 protected:
-	StringMap m_stringvars;
+	// The strings are shared by copies of the metadata until one is modified
+	const StringMap &getVars() const;
+	StringMap &modifyVars();
+	void setVars(StringMap &&vars);
 
 	const std::string *getStringRaw(const std::string &name,
 			std::string *) const override final;
@@ -31,10 +31,29 @@ enum ToServerConnectionState {
 	TOSERVER_STATE_INGAME,
 	TOSERVER_STATE_ALL,
 };
+
+/*
+	Whether a packet handler needs the environment lock.
+	Handlers marked TOSERVER_THREAD_ANY must not touch the environment (or
+	anything else behind Server::m_env_mutex), so they are run without taking
+	the environment lock. All handlers still run on the server thread; the
+	ANY ones just don't wait for emerge threads or the async environment API
+	holding the lock.
+
+	The auth handlers stay TOSERVER_THREAD_ENV: INIT, FIRST_SRP and
+	SRP_BYTES_M go through the Lua auth handler, and SRP_BYTES_A denies
+	access on bad input, which leaves mod channels that Lua may be using.
+*/
+enum ToServerCommandThread {
+	TOSERVER_THREAD_ENV,
+	TOSERVER_THREAD_ANY,
+};
+
 struct ToServerCommandHandler
 {
 	const std::string name;
 	ToServerConnectionState state;
+	ToServerCommandThread thread;
 	void (Server::*handler)(NetworkPacket* pkt);
 };
 
@@ -363,9 +363,11 @@ void Server::handleCommand_RequestMedia(NetworkPacket* pkt)
 
 	*pkt >> numfiles;
 
+	// Not behind the environment lock, so the player name is taken from the
+	// client rather than the environment.
 	session_t peer_id = pkt->getPeerId();
 	infostream << "Sending " << numfiles << " files to " <<
-		getPlayerName(peer_id) << std::endl;
+		getClient(peer_id, CS_InitDone)->getName() << std::endl;
 	verbosestream << "TOSERVER_REQUEST_MEDIA: requested file(s)" << std::endl;
 
 	for (u16 i = 0; i < numfiles; i++) {
@@ -448,8 +450,11 @@ void Server::handleCommand_GotBlocks(NetworkPacket* pkt)
 				("GOTBLOCKS length is too short");
 	}
 
+	// Not behind the environment lock, see toServerCommandTable
 	ClientInterface::AutoLock lock(m_clients);
 	RemoteClient *client = m_clients.lockedGetClientNoEx(pkt->getPeerId());
+	if (!client)
+		return;
 
 	for (u16 i = 0; i < count; i++) {
 		v3s16 p;
@@ -562,13 +567,17 @@ void Server::handleCommand_DeletedBlocks(NetworkPacket* pkt)
 	u8 count;
 	*pkt >> count;
 
-	RemoteClient *client = getClient(pkt->getPeerId());
-
 	if ((s16)pkt->getSize() < 1 + (int)count * 6) {
 		throw con::InvalidIncomingDataException
 				("DELETEDBLOCKS length is too short");
 	}
 
+	// Not behind the environment lock, see toServerCommandTable
+	ClientInterface::AutoLock lock(m_clients);
+	RemoteClient *client = m_clients.lockedGetClientNoEx(pkt->getPeerId());
+	if (!client)
+		return;
+
 	for (u16 i = 0; i < count; i++) {
 		v3s16 p;
 		*pkt >> p;
@@ -383,6 +383,7 @@ void ContentFeatures::reset()
 	climbable = false;
 	buildable_to = false;
 	floodable = false;
+	floats = false;
 	rightclickable = true;
 	leveled = 0;
 	leveled_max = LEVELED_MAX;
@@ -1051,8 +1052,10 @@ void NodeDefManager::clear()
 		// Insert directly into containers
 		content_t c = CONTENT_UNKNOWN;
 		m_content_features[c] = f;
-		for (u32 ci = 0; ci <= CONTENT_MAX; ci++)
+		for (u32 ci = 0; ci <= CONTENT_MAX; ci++) {
 			m_content_lighting_flag_cache[ci] = f.getLightingFlags();
+			m_content_hot_properties[ci] = f.getHotProperties();
+		}
 		addNameIdMapping(c, f.name);
 	}
 
@@ -1074,6 +1077,7 @@ void NodeDefManager::clear()
 		content_t c = CONTENT_AIR;
 		m_content_features[c] = f;
 		m_content_lighting_flag_cache[c] = f.getLightingFlags();
+		m_content_hot_properties[c] = f.getHotProperties();
 		addNameIdMapping(c, f.name);
 	}
 
@@ -1094,6 +1098,7 @@ void NodeDefManager::clear()
 		content_t c = CONTENT_IGNORE;
 		m_content_features[c] = f;
 		m_content_lighting_flag_cache[c] = f.getLightingFlags();
+		m_content_hot_properties[c] = f.getHotProperties();
 		addNameIdMapping(c, f.name);
 	}
 }
@@ -1348,6 +1353,7 @@ content_t NodeDefManager::set(const std::string &name, const ContentFeatures &de
 	m_content_features[id] = def;
 	m_content_features[id].floats = itemgroup_get(def.groups, "float") != 0;
 	m_content_lighting_flag_cache[id] = def.getLightingFlags();
+	m_content_hot_properties[id] = m_content_features[id].getHotProperties();
 	verbosestream << "NodeDefManager: registering content id \"" << id
 		<< "\": name=\"" << def.name << "\""<<std::endl;
 
@@ -1481,9 +1487,24 @@ void NodeDefManager::updateTextures(IGameDef *gamedef, void *progress_callback_a
 
 	u32 size = m_content_features.size();
 
+	// Generate the tile images up front, this can be done in parallel
+	std::vector<std::string> tile_names;
+	for (const ContentFeatures &f : m_content_features) {
+		for (const TileDef &tiledef : f.tiledef)
+			tile_names.push_back(tiledef.name);
+		for (const TileDef &tiledef : f.tiledef_overlay)
+			tile_names.push_back(tiledef.name);
+		for (const TileDef &tiledef : f.tiledef_special)
+			tile_names.push_back(tiledef.name);
+	}
+	tsrc->prefetchTexturesForMesh(tile_names);
+
 	for (u32 i = 0; i < size; i++) {
 		ContentFeatures *f = &(m_content_features[i]);
 		f->updateTextures(tsrc, shdsrc, meshmanip, client, tsettings);
+		// The leaves style may change drawtype and solidness
+		if (!f->name.empty())
+			m_content_hot_properties[i] = f->getHotProperties();
 		client->showUpdateProgressTexture(progress_callback_args, i, size);
 	}
 #endif
@@ -1562,6 +1583,7 @@ void NodeDefManager::deSerialize(std::istream &is, u16 protocol_version)
 		m_content_features[i] = f;
 		m_content_features[i].floats = itemgroup_get(f.groups, "float") != 0;
 		m_content_lighting_flag_cache[i] = f.getLightingFlags();
+		m_content_hot_properties[i] = m_content_features[i].getHotProperties();
 		addNameIdMapping(i, f.name);
 		TRACESTREAM(<< "NodeDef: deserialized " << f.name << std::endl);
 
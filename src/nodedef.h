@@ -297,6 +297,28 @@ struct TileDef
 //       tiles can be overridden.
 #define CF_SPECIAL_COUNT 6
 
+/*!
+ * The few node properties that are checked for nearly every node by
+ * collision, liquid transformation and mesh generation, packed into four
+ * bytes so that these loops do not pull whole ContentFeatures into the cache.
+ * See NodeDefManager::getHotProperties().
+ */
+struct ContentHotProperties {
+	u8 drawtype; // NodeDrawType
+	u8 liquid_type; // LiquidType
+	u8 solidness;
+	bool walkable : 1;
+	bool floodable : 1;
+	bool floats : 1;
+	bool buildable_to : 1;
+	// drawtype is NDT_NODEBOX with a connected nodebox
+	bool connected_nodebox : 1;
+
+	NodeDrawType getDrawType() const { return (NodeDrawType)drawtype; }
+	LiquidType getLiquidType() const { return (LiquidType)liquid_type; }
+};
+static_assert(sizeof(ContentHotProperties) == 4, "Unexpected ContentHotProperties size");
+
 struct ContentFeatures
 {
 	// PROTOCOL_VERSION >= 37. This is legacy and should not be increased anymore,
@@ -516,6 +538,20 @@ struct ContentFeatures
 		return flags;
 	}
 
+	ContentHotProperties getHotProperties() const {
+		ContentHotProperties props;
+		props.drawtype = drawtype;
+		props.liquid_type = liquid_type;
+		props.solidness = solidness;
+		props.walkable = walkable;
+		props.floodable = floodable;
+		props.floats = floats;
+		props.buildable_to = buildable_to;
+		props.connected_nodebox = drawtype == NDT_NODEBOX &&
+				node_box.type == NODEBOX_CONNECTED;
+		return props;
+	}
+
 	int getGroup(const std::string &group) const
 	{
 		return itemgroup_get(groups, group);
@@ -584,6 +620,19 @@ class NodeDefManager {
 		return getLightingFlags(n.getContent());
 	}
 
+	/*!
+	 * Returns the frequently used properties of the given content type.
+	 * Prefer this over get() in loops that only need these properties.
+	 */
+	inline ContentHotProperties getHotProperties(content_t c) const {
+		// No bound check is necessary, since the array's length is CONTENT_MAX + 1.
+		return m_content_hot_properties[c];
+	}
+
+	inline ContentHotProperties getHotProperties(const MapNode &n) const {
+		return getHotProperties(n.getContent());
+	}
+
 	/*!
 	 * Returns the node properties for a node name.
 	 * @param name name of a node
@@ -835,6 +884,11 @@ class NodeDefManager {
 	 * Fast cache of content lighting flags.
 	 */
 	ContentLightingFlags m_content_lighting_flag_cache[CONTENT_MAX + 1L];
+
+	/*!
+	 * Fast cache of content hot properties.
+	 */
+	ContentHotProperties m_content_hot_properties[CONTENT_MAX + 1L];
 };
 
 NodeDefManager *createNodeDefManager();
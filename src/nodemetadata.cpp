@@ -42,9 +42,9 @@ NodeMetadata::~NodeMetadata()
 
 void NodeMetadata::serialize(std::ostream &os, u8 version, bool disk) const
 {
-	int num_vars = disk ? m_stringvars.size() : countNonPrivate();
+	int num_vars = disk ? size() : countNonPrivate();
 	writeU32(os, num_vars);
-	for (const auto &sv : m_stringvars) {
+	for (const auto &sv : getVars()) {
 		bool priv = isPrivate(sv.first);
 		if (!disk && priv)
 			continue;
@@ -62,15 +62,17 @@ void NodeMetadata::deSerialize(std::istream &is, u8 version)
 {
 	clear();
 	int num_vars = readU32(is);
+	StringMap vars;
 	for(int i=0; i<num_vars; i++){
 		std::string name = deSerializeString16(is);
 		std::string var = deSerializeString32(is);
-		m_stringvars[name] = var;
+		vars[name] = var;
 		if (version >= 2) {
 			if (readU8(is) == 1)
 				markPrivate(name, true);
 		}
 	}
+	setVars(std::move(vars));
 
 	m_inventory->deSerialize(is);
 }
@@ -99,9 +101,9 @@ void NodeMetadata::markPrivate(const std::string &name, bool set)
 int NodeMetadata::countNonPrivate() const
 {
 	// m_privatevars can contain names not actually present
-	// DON'T: return m_stringvars.size() - m_privatevars.size();
+	// DON'T: return size() - m_privatevars.size();
 	int n = 0;
-	for (const auto &sv : m_stringvars) {
+	for (const auto &sv : getVars()) {
 		if (!isPrivate(sv.first))
 			n++;
 	}
@@ -26,6 +26,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "map.h"
 #include "nodedef.h"
 #include "irrlicht_changes/printing.h"
+#include "log.h"
+#include <memory>
+#include <unordered_set>
 
 //#define PATHFINDER_DEBUG
 //#define PATHFINDER_CALC_TIME
@@ -60,6 +63,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define PATHFINDER_MAX_WAYPOINTS 700
 
+/** blocks kept in a PathfinderNodeCache, about 1 KiB each */
+#define PATHFINDER_CACHE_MAX_BLOCKS 4096
+
+/** map blocks a search queued to PathfinderQueue may span */
+#define PATHFINDER_SNAPSHOT_MAX_BLOCKS 32768
+
+/** minimum distance in map blocks for searching a block corridor first */
+#define PATHFINDER_CORRIDOR_MIN_BLOCKS 3
+
 /******************************************************************************/
 /* Class definitions                                                          */
 /******************************************************************************/
@@ -180,7 +192,7 @@ class Pathfinder {
 
 public:
 	Pathfinder() = delete;
-	Pathfinder(Map *map, const NodeDefManager *ndef) : m_map(map), m_ndef(ndef) {}
+	Pathfinder(Map *map, const NodeDefManager *ndef, PathfinderNodeCache *cache);
 
 	~Pathfinder();
 
@@ -246,6 +258,20 @@ class Pathfinder {
 	bool           isValidIndex(v3s16 index);
 
 
+	/** what the search needs to know about a node */
+	enum NodeState {
+		NODE_IGNORE,   /**< not loaded */
+		NODE_WALKABLE,
+		NODE_FREE
+	};
+
+	/**
+	 * get state of a node from the node cache
+	 * @param pos real world position
+	 * @return node state
+	 */
+	NodeState      getNodeState(v3s16 pos);
+
 	/* algorithm functions */
 
 	/**
@@ -282,6 +308,21 @@ class Pathfinder {
 	 */
 	bool          updateCostHeuristic(v3s16 isource, v3s16 idestination);
 
+	/**
+	 * find a path through map blocks connected by free nodes on their
+	 * shared faces and keep the blocks along it and around it in
+	 * m_corridor, to restrict a following node search to them
+	 * @param source start position (real pos)
+	 * @param destination end position (real pos)
+	 * @return true/false a corridor has been found
+	 */
+	bool          findBlockCorridor(v3s16 source, v3s16 destination);
+
+	/**
+	 * (re)create the node container for the current search area
+	 */
+	void          resetNodes();
+
 	/**
 	 * build a vector containing all nodes from destination to source;
 	 * to be called after the node costs have been processed
@@ -317,6 +358,9 @@ class Pathfinder {
 
 	core::aabbox3d<s16> m_limits; /**< position limits in real map coordinates  */
 
+	/** map blocks the A* search is restricted to, empty for no restriction */
+	std::unordered_set<v3s16> m_corridor;
+
 	/** contains all map data already collected and analyzed.
 		Access it via the getIndexElement/getIdxElem methods. */
 	friend class GridNodeContainer;
@@ -326,6 +370,15 @@ class Pathfinder {
 
 	const NodeDefManager *m_ndef = nullptr;
 
+	/** walkability cache, either shared or owned by this pathfinder */
+	PathfinderNodeCache *m_cache = nullptr;
+	std::unique_ptr<PathfinderNodeCache> m_own_cache;
+
+	/** block of the last getNodeState call */
+	v3s16 m_last_blockpos;
+	const PathfinderNodeCache::Block *m_last_block = nullptr;
+	bool m_last_block_valid = false;
+
 	friend class PathfinderCompareHeuristic;
 
 #ifdef PATHFINDER_DEBUG
@@ -412,12 +465,221 @@ std::vector<v3s16> get_path(Map* map, const NodeDefManager *ndef,
 		unsigned int searchdistance,
 		unsigned int max_jump,
 		unsigned int max_drop,
-		PathAlgorithm algo)
+		PathAlgorithm algo,
+		PathfinderNodeCache *cache)
 {
-	return Pathfinder(map, ndef).getPath(source, destination,
+	return Pathfinder(map, ndef, cache).getPath(source, destination,
 				searchdistance, max_jump, max_drop, algo);
 }
 
+/******************************************************************************/
+void PathfinderNodeCache::onMapEditEvent(const MapEditEvent &event)
+{
+	for (v3s16 blockpos : event.modified_blocks)
+		m_blocks.erase(blockpos);
+}
+
+/******************************************************************************/
+const PathfinderNodeCache::Block *PathfinderNodeCache::getBlock(Map *map,
+		v3s16 blockpos)
+{
+	if (!map) {
+		auto it = m_blocks.find(blockpos);
+		return it != m_blocks.end() ? it->second.get() : nullptr;
+	}
+
+	MapBlock *mapblock = map->getBlockNoCreateNoEx(blockpos);
+	if (!mapblock) {
+		m_blocks.erase(blockpos);
+		return nullptr;
+	}
+
+	const u64 node_version = mapblock->getNodeVersion();
+	auto it = m_blocks.find(blockpos);
+	if (it != m_blocks.end() && it->second->node_version == node_version)
+		return it->second.get();
+
+	// Snapshots may still use the old block
+	auto new_block = std::make_shared<Block>();
+	Block &block = *new_block;
+	block.node_version = node_version;
+	// Read node by node, so that a compacted block stays compacted
+	u32 i = 0;
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++, i++) {
+		content_t c = mapblock->getNodeNoCheck(x, y, z).getContent();
+		if (c == CONTENT_IGNORE) {
+			block.ignore.set(i);
+			continue;
+		}
+		if (m_ndef->getHotProperties(c).walkable) {
+			block.walkable.set(i);
+			continue;
+		}
+		const v3s16 relpos(x, y, z);
+		const s16 coords[3] = {x, y, z};
+		for (int axis = 0; axis < 3; axis++) {
+			if (coords[axis] == MAP_BLOCKSIZE - 1)
+				block.free_sides[axis * 2].set(getFaceIndex(axis * 2, relpos));
+			if (coords[axis] == 0)
+				block.free_sides[axis * 2 + 1].set(getFaceIndex(axis * 2 + 1, relpos));
+		}
+	}
+	m_blocks[blockpos] = new_block;
+	return &block;
+}
+
+/******************************************************************************/
+std::unique_ptr<PathfinderNodeCache> PathfinderNodeCache::snapshot(Map *map,
+		v3s16 minpos, v3s16 maxpos)
+{
+	beginSearch();
+	auto copy = std::make_unique<PathfinderNodeCache>(m_ndef);
+	for (s16 z = minpos.Z; z <= maxpos.Z; z++)
+	for (s16 y = minpos.Y; y <= maxpos.Y; y++)
+	for (s16 x = minpos.X; x <= maxpos.X; x++) {
+		v3s16 blockpos(x, y, z);
+		if (getBlock(map, blockpos))
+			copy->m_blocks[blockpos] = m_blocks[blockpos];
+	}
+	return copy;
+}
+
+/******************************************************************************/
+u32 PathfinderNodeCache::getFaceIndex(int side, v3s16 relpos)
+{
+	switch (side / 2) {
+	case 0:
+		return relpos.Z * MAP_BLOCKSIZE + relpos.Y;
+	case 1:
+		return relpos.Z * MAP_BLOCKSIZE + relpos.X;
+	default:
+		return relpos.Y * MAP_BLOCKSIZE + relpos.X;
+	}
+}
+
+/******************************************************************************/
+void PathfinderNodeCache::beginSearch()
+{
+	if (m_blocks.size() > PATHFINDER_CACHE_MAX_BLOCKS)
+		m_blocks.clear();
+}
+
+/******************************************************************************/
+PathfinderQueue::PathfinderQueue(Map *map, PathfinderNodeCache *cache) :
+	m_map(map),
+	m_cache(cache)
+{
+}
+
+PathfinderQueue::~PathfinderQueue()
+{
+	for (auto &worker : m_workers)
+		worker->stop();
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_job_sem.post();
+	for (auto &worker : m_workers)
+		worker->wait();
+}
+
+u32 PathfinderQueue::enqueue(v3s16 source,
+		v3s16 destination,
+		unsigned int searchdistance,
+		unsigned int max_jump,
+		unsigned int max_drop,
+		PathAlgorithm algo)
+{
+	if (m_workers.empty()) {
+		unsigned int num_threads = rangelim(Thread::getNumberOfProcessors() / 2, 1U, 4U);
+		for (unsigned int i = 0; i < num_threads; i++) {
+			m_workers.emplace_back(new Worker(this));
+			m_workers.back()->start();
+		}
+	}
+
+	// Same area as Pathfinder::getPath searches in
+	auto limit = [searchdistance] (int pos, int sign) {
+		int p = pos + sign * (int)MYMIN(searchdistance, (unsigned int)MAX_MAP_GENERATION_LIMIT);
+		return getContainerPos((s16)rangelim(p, -MAX_MAP_GENERATION_LIMIT,
+				MAX_MAP_GENERATION_LIMIT), MAP_BLOCKSIZE);
+	};
+	v3s16 minpos(limit(MYMIN(source.X, destination.X), -1),
+			limit(MYMIN(source.Y, destination.Y), -1),
+			limit(MYMIN(source.Z, destination.Z), -1));
+	v3s16 maxpos(limit(MYMAX(source.X, destination.X), 1),
+			limit(MYMAX(source.Y, destination.Y), 1),
+			limit(MYMAX(source.Z, destination.Z), 1));
+	v3s32 size = v3s32(maxpos.X, maxpos.Y, maxpos.Z) -
+			v3s32(minpos.X, minpos.Y, minpos.Z) + 1;
+
+	Job job;
+	job.id = m_next_id++;
+	if ((s64)size.X * size.Y * size.Z > PATHFINDER_SNAPSHOT_MAX_BLOCKS) {
+		ERROR_TARGET << "Search area of " << size << " map blocks is too large"
+				<< std::endl;
+		MutexAutoLock lock(m_results_mutex);
+		m_results.push_back({job.id, {}});
+		return job.id;
+	}
+	job.cache = m_cache->snapshot(m_map, minpos, maxpos);
+	job.source = source;
+	job.destination = destination;
+	job.searchdistance = searchdistance;
+	job.max_jump = max_jump;
+	job.max_drop = max_drop;
+	job.algo = algo;
+	const u32 id = job.id;
+	{
+		MutexAutoLock lock(m_jobs_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_job_sem.post();
+	return id;
+}
+
+bool PathfinderQueue::popResult(Result &result)
+{
+	MutexAutoLock lock(m_results_mutex);
+	if (m_results.empty())
+		return false;
+	result = std::move(m_results.front());
+	m_results.pop_front();
+	return true;
+}
+
+void *PathfinderQueue::Worker::run()
+{
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	while (true) {
+		m_queue->m_job_sem.wait();
+		if (stopRequested())
+			break;
+
+		Job job;
+		{
+			MutexAutoLock lock(m_queue->m_jobs_mutex);
+			if (m_queue->m_jobs.empty())
+				continue;
+			job = std::move(m_queue->m_jobs.front());
+			m_queue->m_jobs.pop_front();
+		}
+
+		Result result;
+		result.id = job.id;
+		result.path = get_path(nullptr, nullptr, job.source, job.destination,
+				job.searchdistance, job.max_jump, job.max_drop, job.algo,
+				job.cache.get());
+
+		MutexAutoLock lock(m_queue->m_results_mutex);
+		m_queue->m_results.push_back(std::move(result));
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+	return nullptr;
+}
+
 /******************************************************************************/
 PathCost::PathCost(const PathCost &b)
 {
@@ -514,20 +776,19 @@ void PathGridnode::setCost(v3s16 dir, const PathCost &cost)
 
 void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 {
-	const NodeDefManager *ndef = m_pathf->m_ndef;
 	PathGridnode &elem = *p_node;
 
 	v3s16 realpos = m_pathf->getRealPos(ipos);
 
-	MapNode current = m_pathf->m_map->getNode(realpos);
-	MapNode below   = m_pathf->m_map->getNode(realpos + v3s16(0, -1, 0));
+	Pathfinder::NodeState current = m_pathf->getNodeState(realpos);
+	Pathfinder::NodeState below   = m_pathf->getNodeState(realpos + v3s16(0, -1, 0));
 
 
-	if ((current.param0 == CONTENT_IGNORE) ||
-			(below.param0 == CONTENT_IGNORE)) {
+	if ((current == Pathfinder::NODE_IGNORE) ||
+			(below == Pathfinder::NODE_IGNORE)) {
 		DEBUG_OUT("Pathfinder: " << realpos <<
 			" current or below is invalid element" << std::endl);
-		if (current.param0 == CONTENT_IGNORE) {
+		if (current == Pathfinder::NODE_IGNORE) {
 			elem.type = 'i';
 			DEBUG_OUT(ipos << ": " << 'i' << std::endl);
 		}
@@ -535,10 +796,10 @@ void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 	}
 
 	//don't add anything if it isn't an air node
-	if (ndef->get(current).walkable || !ndef->get(below).walkable) {
+	if (current == Pathfinder::NODE_WALKABLE || below != Pathfinder::NODE_WALKABLE) {
 			DEBUG_OUT("Pathfinder: " << realpos
 				<< " not on surface" << std::endl);
-			if (ndef->get(current).walkable) {
+			if (current == Pathfinder::NODE_WALKABLE) {
 				elem.type = 's';
 				DEBUG_OUT(ipos << ": " << 's' << std::endl);
 			} else {
@@ -623,6 +884,10 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	m_destination = destination;
 	m_min_target_distance = -1;
 	m_prefetch = true;
+	// A snapshot has to stay complete
+	if (m_map)
+		m_cache->beginSearch();
+	m_last_block_valid = false;
 
 	if (algo == PA_PLAIN_NP) {
 		m_prefetch = false;
@@ -652,12 +917,8 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	m_max_index_y = diff.Y;
 	m_max_index_z = diff.Z;
 
-	delete m_nodes_container;
-	if (diff.getLength() > 5) {
-		m_nodes_container = new MapGridNodeContainer(this);
-	} else {
-		m_nodes_container = new ArrayGridNodeContainer(this, diff);
-	}
+	m_corridor.clear();
+	resetNodes();
 #ifdef PATHFINDER_DEBUG
 	printType();
 	printCost();
@@ -665,14 +926,14 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 #endif
 
 	//fail if source or destination is walkable
-	MapNode node_at_pos = m_map->getNode(destination);
-	if (m_ndef->get(node_at_pos).walkable) {
+	NodeState node_at_pos = getNodeState(destination);
+	if (node_at_pos == NODE_WALKABLE) {
 		VERBOSE_TARGET << "Destination is walkable. " <<
 				"Pos: " << destination << std::endl;
 		return retval;
 	}
-	node_at_pos = m_map->getNode(source);
-	if (m_ndef->get(node_at_pos).walkable) {
+	node_at_pos = getNodeState(source);
+	if (node_at_pos == NODE_WALKABLE) {
 		VERBOSE_TARGET << "Source is walkable. " <<
 				"Pos: " << source << std::endl;
 		return retval;
@@ -726,6 +987,17 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 			break;
 		case PA_PLAIN_NP:
 		case PA_PLAIN:
+			if (findBlockCorridor(source, destination)) {
+				update_cost_retval = updateCostHeuristic(StartIndex, EndIndex);
+				if (update_cost_retval)
+					break;
+				// The corridor only approximates walkability, search
+				// the whole area again
+				VERBOSE_TARGET << "No path within block corridor" << std::endl;
+				m_corridor.clear();
+				resetNodes();
+				getIndexElement(EndIndex).target = true;
+			}
 			update_cost_retval = updateCostHeuristic(StartIndex, EndIndex);
 			break;
 		default:
@@ -813,16 +1085,61 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	return retval;
 }
 
+Pathfinder::Pathfinder(Map *map, const NodeDefManager *ndef,
+		PathfinderNodeCache *cache) :
+	m_map(map),
+	m_ndef(ndef),
+	m_cache(cache)
+{
+	if (!m_cache) {
+		m_own_cache = std::make_unique<PathfinderNodeCache>(ndef);
+		m_cache = m_own_cache.get();
+	}
+}
+
 Pathfinder::~Pathfinder()
 {
 	delete m_nodes_container;
 }
+
+/******************************************************************************/
+void Pathfinder::resetNodes()
+{
+	v3s16 diff = m_limits.MaxEdge - m_limits.MinEdge;
+
+	delete m_nodes_container;
+	if (diff.getLength() > 5) {
+		m_nodes_container = new MapGridNodeContainer(this);
+	} else {
+		m_nodes_container = new ArrayGridNodeContainer(this, diff);
+	}
+}
+
 /******************************************************************************/
 v3s16 Pathfinder::getRealPos(v3s16 ipos)
 {
 	return m_limits.MinEdge + ipos;
 }
 
+/******************************************************************************/
+Pathfinder::NodeState Pathfinder::getNodeState(v3s16 pos)
+{
+	v3s16 blockpos = getNodeBlockPos(pos);
+	if (!m_last_block_valid || blockpos != m_last_blockpos) {
+		m_last_blockpos = blockpos;
+		m_last_block = m_cache->getBlock(m_map, blockpos);
+		m_last_block_valid = true;
+	}
+	if (!m_last_block)
+		return NODE_IGNORE;
+
+	v3s16 relpos = pos - blockpos * MAP_BLOCKSIZE;
+	u32 i = relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + relpos.Y * MAP_BLOCKSIZE + relpos.X;
+	if (m_last_block->ignore[i])
+		return NODE_IGNORE;
+	return m_last_block->walkable[i] ? NODE_WALKABLE : NODE_FREE;
+}
+
 /******************************************************************************/
 PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 {
@@ -839,28 +1156,27 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		return retval;
 	}
 
-	MapNode node_at_pos2 = m_map->getNode(pos2);
+	NodeState node_at_pos2 = getNodeState(pos2);
 
 	//did we get information about node?
-	if (node_at_pos2.param0 == CONTENT_IGNORE ) {
+	if (node_at_pos2 == NODE_IGNORE) {
 			VERBOSE_TARGET << "Pathfinder: (1) area at pos: "
 					<< pos2 << " not loaded";
 			return retval;
 	}
 
-	if (!m_ndef->get(node_at_pos2).walkable) {
-		MapNode node_below_pos2 =
-			m_map->getNode(pos2 + v3s16(0, -1, 0));
+	if (node_at_pos2 != NODE_WALKABLE) {
+		NodeState node_below_pos2 = getNodeState(pos2 + v3s16(0, -1, 0));
 
 		//did we get information about node?
-		if (node_below_pos2.param0 == CONTENT_IGNORE ) {
+		if (node_below_pos2 == NODE_IGNORE) {
 				VERBOSE_TARGET << "Pathfinder: (2) area at pos: "
 					<< (pos2 + v3s16(0, -1, 0)) << " not loaded";
 				return retval;
 		}
 
 		//test if the same-height neighbor is suitable
-		if (m_ndef->get(node_below_pos2).walkable) {
+		if (node_below_pos2 == NODE_WALKABLE) {
 			//SUCCESS!
 			retval.valid = true;
 			retval.value = 1;
@@ -871,19 +1187,19 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		else {
 			//test if we can fall a couple of nodes (m_maxdrop)
 			v3s16 testpos = pos2 + v3s16(0, -1, 0);
-			MapNode node_at_pos = m_map->getNode(testpos);
+			NodeState node_at_pos = getNodeState(testpos);
 
-			while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-					(!m_ndef->get(node_at_pos).walkable) &&
+			while ((node_at_pos != NODE_IGNORE) &&
+					(node_at_pos != NODE_WALKABLE) &&
 					(testpos.Y > m_limits.MinEdge.Y)) {
 				testpos += v3s16(0, -1, 0);
-				node_at_pos = m_map->getNode(testpos);
+				node_at_pos = getNodeState(testpos);
 			}
 
 			//did we find surface?
 			if ((testpos.Y >= m_limits.MinEdge.Y) &&
-					(node_at_pos.param0 != CONTENT_IGNORE) &&
-					(m_ndef->get(node_at_pos).walkable)) {
+					(node_at_pos != NODE_IGNORE) &&
+					(node_at_pos == NODE_WALKABLE)) {
 				if ((pos2.Y - testpos.Y - 1) <= m_maxdrop) {
 					//SUCCESS!
 					retval.valid = true;
@@ -909,34 +1225,34 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 
 		v3s16 targetpos = pos2; // position for jump target
 		v3s16 jumppos = pos; // position for checking if jumping space is free
-		MapNode node_target = m_map->getNode(targetpos);
-		MapNode node_jump = m_map->getNode(jumppos);
+		NodeState node_target = getNodeState(targetpos);
+		NodeState node_jump = getNodeState(jumppos);
 		bool headbanger = false; // true if anything blocks jumppath
 
-		while ((node_target.param0 != CONTENT_IGNORE) &&
-				(m_ndef->get(node_target).walkable) &&
+		while ((node_target != NODE_IGNORE) &&
+				(node_target == NODE_WALKABLE) &&
 				(targetpos.Y < m_limits.MaxEdge.Y)) {
 			//if the jump would hit any solid node, discard
-			if ((node_jump.param0 == CONTENT_IGNORE) ||
-					(m_ndef->get(node_jump).walkable)) {
+			if ((node_jump == NODE_IGNORE) ||
+					(node_jump == NODE_WALKABLE)) {
 					headbanger = true;
 				break;
 			}
 			targetpos += v3s16(0, 1, 0);
 			jumppos   += v3s16(0, 1, 0);
-			node_target = m_map->getNode(targetpos);
-			node_jump   = m_map->getNode(jumppos);
+			node_target = getNodeState(targetpos);
+			node_jump   = getNodeState(jumppos);
 
 		}
 		//check headbanger one last time
-		if ((node_jump.param0 == CONTENT_IGNORE) ||
-			(m_ndef->get(node_jump).walkable)) {
+		if ((node_jump == NODE_IGNORE) ||
+			(node_jump == NODE_WALKABLE)) {
 			headbanger = true;
 		}
 
 		//did we find surface without banging our head?
 		if ((!headbanger) && (targetpos.Y <= m_limits.MaxEdge.Y) &&
-				(!m_ndef->get(node_target).walkable)) {
+				(node_target != NODE_WALKABLE)) {
 
 			if (targetpos.Y - pos2.Y <= m_maxjump) {
 				//SUCCESS!
@@ -1180,6 +1496,10 @@ bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
 
 			// get position of true neighbor
 			v3s16 neighbor = current_pos + direction_3d;
+			if (!m_corridor.empty() &&
+					m_corridor.count(getNodeBlockPos(neighbor)) == 0)
+				continue;
+
 			v3s16 ineighbor = getIndexPos(neighbor);
 			PathGridnode &n_pos = getIndexElement(ineighbor);
 
@@ -1200,6 +1520,93 @@ bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
 	return false;
 }
 
+/******************************************************************************/
+bool Pathfinder::findBlockCorridor(v3s16 source, v3s16 destination)
+{
+	// A* search over map blocks. Two neighboring blocks are connected
+	// if both have a free node at the same spot of their shared face.
+	const v3s16 block_source = getNodeBlockPos(source);
+	const v3s16 block_destination = getNodeBlockPos(destination);
+	const v3s16 block_min = getNodeBlockPos(m_limits.MinEdge);
+	const v3s16 block_max = getNodeBlockPos(m_limits.MaxEdge);
+
+	auto block_dist = [] (v3s16 a, v3s16 b) {
+		return std::abs(a.X - b.X) + std::abs(a.Y - b.Y) + std::abs(a.Z - b.Z);
+	};
+	if (block_dist(block_source, block_destination) < PATHFINDER_CORRIDOR_MIN_BLOCKS)
+		return false;
+
+	// in the order of PathfinderNodeCache::Block::free_sides
+	const static v3s16 directions[6] = {
+		v3s16( 1, 0, 0), v3s16(-1, 0, 0),
+		v3s16( 0, 1, 0), v3s16( 0,-1, 0),
+		v3s16( 0, 0, 1), v3s16( 0, 0,-1)
+	};
+
+	struct OpenBlock {
+		int estimated_cost;
+		v3s16 pos;
+	};
+	auto compare = [] (const OpenBlock &a, const OpenBlock &b) {
+		return a.estimated_cost > b.estimated_cost;
+	};
+	std::priority_queue<OpenBlock, std::vector<OpenBlock>, decltype(compare)>
+			open_list(compare);
+	std::unordered_map<v3s16, int> costs;
+	std::unordered_map<v3s16, v3s16> sources;
+
+	costs[block_source] = 0;
+	open_list.push({block_dist(block_source, block_destination), block_source});
+	bool found = false;
+	while (!open_list.empty()) {
+		const v3s16 pos = open_list.top().pos;
+		open_list.pop();
+		if (pos == block_destination) {
+			found = true;
+			break;
+		}
+
+		const PathfinderNodeCache::Block *block = m_cache->getBlock(m_map, pos);
+		if (!block)
+			continue;
+		const int cost = costs[pos] + 1;
+		for (int side = 0; side < 6; side++) {
+			const v3s16 npos = pos + directions[side];
+			if (npos.X < block_min.X || npos.Y < block_min.Y || npos.Z < block_min.Z ||
+					npos.X > block_max.X || npos.Y > block_max.Y || npos.Z > block_max.Z)
+				continue;
+			auto it = costs.find(npos);
+			if (it != costs.end() && it->second <= cost)
+				continue;
+			const PathfinderNodeCache::Block *nblock = m_cache->getBlock(m_map, npos);
+			if (!nblock || (block->free_sides[side] & nblock->free_sides[side ^ 1]).none())
+				continue;
+			costs[npos] = cost;
+			sources[npos] = pos;
+			open_list.push({cost + block_dist(npos, block_destination), npos});
+		}
+	}
+	// The search may have read blocks that the node search did not
+	m_last_block_valid = false;
+
+	if (!found) {
+		VERBOSE_TARGET << "No block corridor from " << block_source
+				<< " to " << block_destination << std::endl;
+		return false;
+	}
+
+	// A path may cut across edges and corners of blocks
+	for (v3s16 pos = block_destination;; pos = sources[pos]) {
+		for (s16 z = -1; z <= 1; z++)
+		for (s16 y = -1; y <= 1; y++)
+		for (s16 x = -1; x <= 1; x++)
+			m_corridor.insert(pos + v3s16(x, y, z));
+		if (pos == block_source)
+			break;
+	}
+	return true;
+}
+
 /******************************************************************************/
 bool Pathfinder::buildPath(std::vector<v3s16> &path, v3s16 ipos)
 {
@@ -1236,20 +1643,20 @@ v3s16 Pathfinder::walkDownwards(v3s16 pos, unsigned int max_down) {
 	if (max_down == 0)
 		return pos;
 	v3s16 testpos = v3s16(pos);
-	MapNode node_at_pos = m_map->getNode(testpos);
+	NodeState node_at_pos = getNodeState(testpos);
 	unsigned int down = 0;
-	while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-			(!m_ndef->get(node_at_pos).walkable) &&
+	while ((node_at_pos != NODE_IGNORE) &&
+			(node_at_pos != NODE_WALKABLE) &&
 			(testpos.Y > m_limits.MinEdge.Y) &&
 			(down <= max_down)) {
 		testpos += v3s16(0, -1, 0);
 		down++;
-		node_at_pos = m_map->getNode(testpos);
+		node_at_pos = getNodeState(testpos);
 	}
 	//did we find surface?
 	if ((testpos.Y >= m_limits.MinEdge.Y) &&
-			(node_at_pos.param0 != CONTENT_IGNORE) &&
-			(m_ndef->get(node_at_pos).walkable)) {
+			(node_at_pos != NODE_IGNORE) &&
+			(node_at_pos == NODE_WALKABLE)) {
 		if (down == 0) {
 			pos = testpos;
 		} else if ((down - 1) <= max_down) {
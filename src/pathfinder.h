@@ -22,8 +22,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /******************************************************************************/
 /* Includes                                                                   */
 /******************************************************************************/
+#include <bitset>
+#include <deque>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include "irr_v3d.h"
+#include "map.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
 
 /******************************************************************************/
 /* Forward declarations                                                       */
@@ -54,11 +62,140 @@ typedef enum {
 /* declarations                                                               */
 /******************************************************************************/
 
-/** c wrapper function to use from scriptapi */
+/** Walkability of the nodes of loaded map blocks, shared between searches
+ *  so that the map and the node definitions are not queried over and over.
+ *  A block is read again when a map edit event touches it or when it
+ *  was unloaded and loaded again.
+ */
+class PathfinderNodeCache : public MapEventReceiver {
+public:
+	struct Block {
+		u64 node_version; /**< MapBlock::getNodeVersion() when read */
+		std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE> walkable;
+		std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE> ignore;
+		/** free nodes on the faces of the block, in the order
+		 *  +X, -X, +Y, -Y, +Z, -Z; see getFaceIndex() */
+		std::bitset<MAP_BLOCKSIZE * MAP_BLOCKSIZE> free_sides[6];
+	};
+
+	/**
+	 * index of a node position within a free_sides bitset
+	 * @param side face of the block
+	 * @param relpos node position relative to the block
+	 */
+	static u32 getFaceIndex(int side, v3s16 relpos);
+
+	PathfinderNodeCache(const NodeDefManager *ndef) : m_ndef(ndef) {}
+
+	void onMapEditEvent(const MapEditEvent &event) override;
+
+	/**
+	 * get the walkability of a map block, reading it if needed
+	 * @param map map to read from; nullptr to only look into the cache
+	 * @return cached block or nullptr if the block is not loaded
+	 */
+	const Block *getBlock(Map *map, v3s16 blockpos);
+
+	/**
+	 * copy the blocks of an area into a new cache, reading them if needed;
+	 * the copy can be searched with a nullptr map on another thread
+	 * @param minpos minimum block position of the area
+	 * @param maxpos maximum block position of the area
+	 */
+	std::unique_ptr<PathfinderNodeCache> snapshot(Map *map,
+			v3s16 minpos, v3s16 maxpos);
+
+	/**
+	 * to be called before a search; pointers returned by getBlock stay
+	 * valid until the next call
+	 */
+	void beginSearch();
+
+private:
+	// Blocks are never changed once read, so snapshots can share them
+	std::unordered_map<v3s16, std::shared_ptr<const Block>> m_blocks;
+	const NodeDefManager *m_ndef;
+};
+
+/** Runs path searches on worker threads. Each search works on a snapshot
+ *  of the node cache taken when it is queued, so it sees the map as it
+ *  was at that time.
+ */
+class PathfinderQueue {
+public:
+	struct Result {
+		u32 id;
+		std::vector<v3s16> path; /**< empty if no path was found */
+	};
+
+	PathfinderQueue(Map *map, PathfinderNodeCache *cache);
+	~PathfinderQueue();
+
+	DISABLE_CLASS_COPY(PathfinderQueue);
+
+	/**
+	 * queue a search; to be called from the thread that changes the map
+	 * @return id to match the result with
+	 */
+	u32 enqueue(v3s16 source,
+			v3s16 destination,
+			unsigned int searchdistance,
+			unsigned int max_jump,
+			unsigned int max_drop,
+			PathAlgorithm algo);
+
+	/**
+	 * take a finished search
+	 * @return false if there is none
+	 */
+	bool popResult(Result &result);
+
+private:
+	struct Job {
+		u32 id;
+		std::unique_ptr<PathfinderNodeCache> cache;
+		v3s16 source;
+		v3s16 destination;
+		unsigned int searchdistance;
+		unsigned int max_jump;
+		unsigned int max_drop;
+		PathAlgorithm algo;
+	};
+
+	class Worker : public Thread {
+	public:
+		Worker(PathfinderQueue *queue) :
+			Thread("Pathfinder"),
+			m_queue(queue)
+		{}
+
+		void *run();
+
+	private:
+		PathfinderQueue *m_queue;
+	};
+
+	Map *m_map;
+	PathfinderNodeCache *m_cache;
+	u32 m_next_id = 0;
+
+	// Started with the first search
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	Semaphore m_job_sem;
+
+	std::mutex m_jobs_mutex;
+	std::deque<Job> m_jobs;
+	std::mutex m_results_mutex;
+	std::deque<Result> m_results;
+};
+
+/** c wrapper function to use from scriptapi;
+ *  map may be nullptr to search a snapshot cache */
 std::vector<v3s16> get_path(Map *map, const NodeDefManager *ndef,
 		v3s16 source,
 		v3s16 destination,
 		unsigned int searchdistance,
 		unsigned int max_jump,
 		unsigned int max_drop,
-		PathAlgorithm algo);
+		PathAlgorithm algo,
+		PathfinderNodeCache *cache = nullptr);
@@ -44,6 +44,9 @@ class ScriptApiEnv : virtual public ScriptApiBase
 	void on_emerge_area_completion(v3s16 blockpos, int action,
 		ScriptCallbackState *state);
 
+	// Called after a search queued from core.find_path_async() finished
+	void on_path_found(u32 id, const std::vector<v3s16> &path);
+
 	void check_for_falling(v3s16 p);
 
 	// Called after liquid transform changes
@@ -1267,6 +1267,21 @@ int ModApiEnv::l_delete_area(lua_State *L)
 	return 1;
 }
 
+static PathAlgorithm read_path_algorithm(lua_State *L, int index)
+{
+	PathAlgorithm algo = PA_PLAIN_NP;
+	if (!lua_isnoneornil(L, index)) {
+		std::string algorithm = luaL_checkstring(L, index);
+
+		if (algorithm == "A*")
+			algo = PA_PLAIN;
+
+		if (algorithm == "Dijkstra")
+			algo = PA_DIJKSTRA;
+	}
+	return algo;
+}
+
 // find_path(pos1, pos2, searchdistance,
 //     max_jump, max_drop, algorithm) -> table containing path
 int ModApiEnv::l_find_path(lua_State *L)
@@ -1278,19 +1293,10 @@ int ModApiEnv::l_find_path(lua_State *L)
 	unsigned int searchdistance = luaL_checkint(L, 3);
 	unsigned int max_jump       = luaL_checkint(L, 4);
 	unsigned int max_drop       = luaL_checkint(L, 5);
-	PathAlgorithm algo          = PA_PLAIN_NP;
-	if (!lua_isnoneornil(L, 6)) {
-		std::string algorithm = luaL_checkstring(L,6);
-
-		if (algorithm == "A*")
-			algo = PA_PLAIN;
-
-		if (algorithm == "Dijkstra")
-			algo = PA_DIJKSTRA;
-	}
+	PathAlgorithm algo          = read_path_algorithm(L, 6);
 
 	std::vector<v3s16> path = get_path(&env->getServerMap(), env->getGameDef()->ndef(), pos1, pos2,
-		searchdistance, max_jump, max_drop, algo);
+		searchdistance, max_jump, max_drop, algo, env->getPathfinderCache());
 
 	if (!path.empty()) {
 		lua_createtable(L, path.size(), 0);
@@ -1308,6 +1314,28 @@ int ModApiEnv::l_find_path(lua_State *L)
 	return 0;
 }
 
+// queue_find_path(pos1, pos2, searchdistance,
+//     max_jump, max_drop, algorithm) -> job id
+int ModApiEnv::l_queue_find_path(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 pos1                  = read_v3s16(L, 1);
+	v3s16 pos2                  = read_v3s16(L, 2);
+	unsigned int searchdistance = luaL_checkint(L, 3);
+	unsigned int max_jump       = luaL_checkint(L, 4);
+	unsigned int max_drop       = luaL_checkint(L, 5);
+	PathAlgorithm algo          = read_path_algorithm(L, 6);
+
+	PathfinderQueue *queue = env->getPathfinderQueue();
+	if (!queue)
+		throw LuaError("Path searches can not be queued without a map");
+
+	lua_pushinteger(L, queue->enqueue(pos1, pos2, searchdistance,
+		max_jump, max_drop, algo));
+	return 1;
+}
+
 static bool read_tree_def(lua_State *L, int idx,
 	const NodeDefManager *ndef, treegen::TreeDef &tree_def)
 {
@@ -1481,6 +1509,7 @@ void ModApiEnv::Initialize(lua_State *L, int top)
 	API_FCT(clear_objects);
 	API_FCT(spawn_tree);
 	API_FCT(find_path);
+	API_FCT(queue_find_path);
 	API_FCT(line_of_sight);
 	API_FCT(raycast);
 	API_FCT(transforming_liquid_add);
@@ -60,11 +60,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/sha1.h"
 #include "util/hex.h"
 #include "database/database.h"
+#include "database/database-async.h"
 #include "chatmessage.h"
 #include "chat_interface.h"
 #include "remoteplayer.h"
 #include "server/player_sao.h"
 #include "server/serverinventorymgr.h"
+#include "server/media_index.h"
 #include "translation.h"
 #include "database/database-sqlite3.h"
 #if USE_POSTGRESQL
@@ -229,6 +231,14 @@ std::wstring Server::ShutdownState::getShutdownTimerMessage() const
 	Server
 */
 
+struct Server::CachedSettings
+{
+	SettingHandle<float> unload_unused_data_timeout{"server_unload_unused_data_timeout"};
+	SettingHandle<s16> max_block_send_distance{"max_block_send_distance"};
+	SettingHandle<u32> max_users{"max_users"};
+	SettingHandle<u32> max_simultaneous_block_sends{"max_simultaneous_block_sends_per_client"};
+};
+
 Server::Server(
 		const std::string &path_world,
 		const SubgameSpec &gamespec,
@@ -302,10 +312,34 @@ Server::Server(
 			"minetest_core_server_packet_recv_processed",
 			"Valid received packets processed");
 
+	m_packet_recv_unlocked_counter = m_metrics_backend->addCounter(
+			"minetest_core_server_packet_recv_unlocked",
+			"Received packets handled without the environment lock");
+
 	m_map_edit_event_counter = m_metrics_backend->addCounter(
 			"minetest_core_map_edit_events",
 			"Number of map edit events");
 
+	m_object_send_queued_gauge = m_metrics_backend->addGauge(
+			"minetest_core_object_send_queued",
+			"Number of objects waiting to be sent to clients");
+
+	m_object_send_deferred_counter = m_metrics_backend->addCounter(
+			"minetest_core_object_send_deferred",
+			"Number of object sends deferred due to the per-step budget");
+
+	m_object_init_bytes_counter = m_metrics_backend->addCounter(
+			"minetest_core_object_init_bytes",
+			"Bytes of object initialization data sent to clients");
+
+	m_inventory_send_counter = m_metrics_backend->addCounter(
+			"minetest_core_inventory_sends",
+			"Number of player inventory updates sent to clients");
+
+	m_inventory_send_bytes_counter = m_metrics_backend->addCounter(
+			"minetest_core_inventory_send_bytes",
+			"Bytes of player inventory updates sent to clients");
+
 	m_lag_gauge->set(g_settings->getFloat("dedicated_server_step"));
 }
 
@@ -370,6 +404,8 @@ Server::~Server()
 	// Write any changes before deletion.
 	if (m_mod_storage_database)
 		m_mod_storage_database->endSave();
+	if (m_media_index)
+		m_media_index->save();
 
 	// Delete things in the reverse order of creation
 	delete m_emerge;
@@ -414,6 +450,9 @@ void Server::init()
 		throw ServerError(std::string("Failed to initialize world: ") + e.what());
 	}
 
+	m_cached_settings = std::make_unique<CachedSettings>();
+	m_clients.initSettings();
+
 	// Create emerge manager
 	m_emerge = new EmergeManager(this, m_metrics_backend.get());
 
@@ -423,6 +462,12 @@ void Server::init()
 
 	// Create mod storage database and begin a save for later
 	m_mod_storage_database = openModStorageDatabase(m_path_world);
+	if (g_settings->getFloat("database_write_interval") > 0) {
+		// Coalesce the changes and write them in the background
+		m_mod_storage_writer = new ModStorageDatabaseAsync(
+			m_mod_storage_database, m_metrics_backend.get());
+		m_mod_storage_database = m_mod_storage_writer;
+	}
 	m_mod_storage_database->beginSave();
 
 	m_modmgr = std::make_unique<ServerModManager>(m_path_world);
@@ -483,6 +528,14 @@ void Server::init()
 	// init the recipe hashes to speed up crafting
 	m_craftdef->initHashes(this);
 
+	// Definitions are final now, build the payloads for up-to-date clients
+	// before anyone joins
+	invalidateDefinitionPayloads();
+	getDefinitionPayload(m_itemdef_payloads, LATEST_PROTOCOL_VERSION,
+		[this] (std::ostream &os) { m_itemdef->serialize(os, LATEST_PROTOCOL_VERSION); });
+	getDefinitionPayload(m_nodedef_payloads, LATEST_PROTOCOL_VERSION,
+		[this] (std::ostream &os) { m_nodedef->serialize(os, LATEST_PROTOCOL_VERSION); });
+
 	// Initialize Environment
 	m_startup_server_map = nullptr; // Ownership moved to ServerEnvironment
 	m_env = new ServerEnvironment(servermap, m_script, this,
@@ -663,13 +716,16 @@ void Server::AsyncRunStep(bool initial_step)
 	}
 
 	static const float map_timer_and_unload_dtime = 2.92;
-	if(m_map_timer_and_unload_interval.step(dtime, map_timer_and_unload_dtime))
+	bool map_timer_due = m_map_timer_and_unload_interval.step(dtime,
+			map_timer_and_unload_dtime);
+	// A sweep over a large map is continued in the next steps
+	if (map_timer_due || m_env->getMap().isSweepInProgress())
 	{
 		MutexAutoLock lock(m_env_mutex);
 		// Run Map's timers and unload unused data
 		ScopeProfiler sp(g_profiler, "Server: map timer and unload");
-		m_env->getMap().timerUpdate(map_timer_and_unload_dtime,
-			std::max(g_settings->getFloat("server_unload_unused_data_timeout"), 0.0f),
+		m_env->getMap().timerUpdate(map_timer_due ? map_timer_and_unload_dtime : 0.0f,
+			std::max(m_cached_settings->unload_unused_data_timeout.get(), 0.0f),
 			-1);
 	}
 
@@ -773,6 +829,7 @@ void Server::AsyncRunStep(bool initial_step)
 			ScopeProfiler sp(g_profiler, "Server: update objects within range");
 
 			m_player_gauge->set(clients.size());
+			u32 objects_queued = 0;
 			for (const auto &client_it : clients) {
 				RemoteClient *client = client_it.second;
 
@@ -787,14 +844,17 @@ void Server::AsyncRunStep(bool initial_step)
 				if (!playersao)
 					continue;
 
-				SendActiveObjectRemoveAdd(client, playersao);
+				objects_queued += SendActiveObjectRemoveAdd(client, playersao);
 			}
+			m_object_send_queued_gauge->set(objects_queued);
 		}
 
 		// Write changes to the mod storage
 		m_mod_storage_save_timer -= dtime;
 		if (m_mod_storage_save_timer <= 0.0f) {
 			m_mod_storage_save_timer = g_settings->getFloat("server_map_save_interval");
+			if (m_mod_storage_writer)
+				m_mod_storage_writer->checkError();
 			m_mod_storage_database->endSave();
 			m_mod_storage_database->beginSave();
 		}
@@ -1172,8 +1232,15 @@ inline void Server::handleCommand(NetworkPacket *pkt)
 
 void Server::ProcessData(NetworkPacket *pkt)
 {
-	// Environment is locked first.
-	MutexAutoLock envlock(m_env_mutex);
+	ToServerCommand command = (ToServerCommand) pkt->getCommand();
+
+	// Environment is locked first, unless the handler doesn't need it.
+	MutexAutoLock envlock(m_env_mutex, std::defer_lock);
+	if (command >= TOSERVER_NUM_MSG_TYPES ||
+			toServerCommandTable[command].thread == TOSERVER_THREAD_ENV)
+		envlock.lock();
+	else
+		m_packet_recv_unlocked_counter->increment();
 
 	ScopeProfiler sp(g_profiler, "Server: Process network packet (sum)");
 	u32 peer_id = pkt->getPeerId();
@@ -1204,8 +1271,6 @@ void Server::ProcessData(NetworkPacket *pkt)
 	}
 
 	try {
-		ToServerCommand command = (ToServerCommand) pkt->getCommand();
-
 		// Command must be handled into ToServerCommandHandler
 		if (command >= TOSERVER_NUM_MSG_TYPES) {
 			infostream << "Server: Ignoring unknown command "
@@ -1451,6 +1516,34 @@ void Server::SendDeathscreen(session_t peer_id, bool set_camera_point_target,
 	Send(&pkt);
 }
 
+std::shared_ptr<const std::string> Server::getDefinitionPayload(
+		std::unordered_map<u16, std::shared_ptr<const std::string>> &cache,
+		u16 protocol_version,
+		const std::function<void(std::ostream &)> &serialize)
+{
+	MutexAutoLock lock(m_def_payload_mutex);
+
+	auto it = cache.find(protocol_version);
+	if (it != cache.end())
+		return it->second;
+
+	std::ostringstream tmp_os(std::ios::binary);
+	serialize(tmp_os);
+	std::ostringstream tmp_os2(std::ios::binary);
+	compressZlib(tmp_os.str(), tmp_os2);
+
+	auto payload = std::make_shared<const std::string>(tmp_os2.str());
+	cache[protocol_version] = payload;
+	return payload;
+}
+
+void Server::invalidateDefinitionPayloads()
+{
+	MutexAutoLock lock(m_def_payload_mutex);
+	m_itemdef_payloads.clear();
+	m_nodedef_payloads.clear();
+}
+
 void Server::SendItemDef(session_t peer_id,
 		IItemDefManager *itemdef, u16 protocol_version)
 {
@@ -1461,11 +1554,11 @@ void Server::SendItemDef(session_t peer_id,
 		u32 length of the next item
 		zlib-compressed serialized ItemDefManager
 	*/
-	std::ostringstream tmp_os(std::ios::binary);
-	itemdef->serialize(tmp_os, protocol_version);
-	std::ostringstream tmp_os2(std::ios::binary);
-	compressZlib(tmp_os.str(), tmp_os2);
-	pkt.putLongString(tmp_os2.str());
+	// The payload only depends on the protocol version, so it is built
+	// once and shared between all joining clients
+	auto payload = getDefinitionPayload(m_itemdef_payloads, protocol_version,
+		[&] (std::ostream &os) { itemdef->serialize(os, protocol_version); });
+	pkt.putLongString(*payload);
 
 	// Make data buffer
 	verbosestream << "Server: Sending item definitions to id(" << peer_id
@@ -1484,12 +1577,9 @@ void Server::SendNodeDef(session_t peer_id,
 		u32 length of the next item
 		zlib-compressed serialized NodeDefManager
 	*/
-	std::ostringstream tmp_os(std::ios::binary);
-	nodedef->serialize(tmp_os, protocol_version);
-	std::ostringstream tmp_os2(std::ios::binary);
-	compressZlib(tmp_os.str(), tmp_os2);
-
-	pkt.putLongString(tmp_os2.str());
+	auto payload = getDefinitionPayload(m_nodedef_payloads, protocol_version,
+		[&] (std::ostream &os) { nodedef->serialize(os, protocol_version); });
+	pkt.putLongString(*payload);
 
 	// Make data buffer
 	verbosestream << "Server: Sending node definitions to id(" << peer_id
@@ -1525,6 +1615,9 @@ void Server::SendInventory(PlayerSAO *sao, bool incremental)
 	const std::string &s = os.str();
 	pkt.putRawString(s.c_str(), s.size());
 	Send(&pkt);
+
+	m_inventory_send_counter->increment();
+	m_inventory_send_bytes_counter->increment(s.size());
 }
 
 void Server::SendChatMessage(session_t peer_id, const ChatMessage &message)
@@ -1574,8 +1667,8 @@ void Server::SendShowFormspecMessage(session_t peer_id, const std::string &forms
 void Server::SendSpawnParticle(session_t peer_id, u16 protocol_version,
 	const ParticleParameters &p)
 {
-	static thread_local const float radius =
-			g_settings->getS16("max_block_send_distance") * MAP_BLOCKSIZE * BS;
+	const float radius =
+			m_cached_settings->max_block_send_distance.get() * MAP_BLOCKSIZE * BS;
 
 	if (peer_id == PEER_ID_INEXISTENT) {
 		std::vector<session_t> clients = m_clients.getClientIDs();
@@ -1617,8 +1710,8 @@ void Server::SendSpawnParticle(session_t peer_id, u16 protocol_version,
 void Server::SendAddParticleSpawner(session_t peer_id, u16 protocol_version,
 	const ParticleSpawnerParameters &p, u16 attached_id, u32 id)
 {
-	static thread_local const float radius =
-			g_settings->getS16("max_block_send_distance") * MAP_BLOCKSIZE * BS;
+	const float radius =
+			m_cached_settings->max_block_send_distance.get() * MAP_BLOCKSIZE * BS;
 
 	if (peer_id == PEER_ID_INEXISTENT) {
 		std::vector<session_t> clients = m_clients.getClientIDs();
@@ -2042,7 +2135,7 @@ void Server::SendPlayerFormspecPrepend(session_t peer_id)
 	Send(&pkt);
 }
 
-void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersao)
+u32 Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersao)
 {
 	// Radius inside which objects are active
 	static thread_local const s16 radius =
@@ -2056,6 +2149,10 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 	static thread_local const s16 player_transfer_dist =
 		g_settings->getS16("player_transfer_distance") * MAP_BLOCKSIZE;
 
+	// Maximum initialization data sent per step, 0 = unlimited
+	static thread_local const u32 send_budget =
+		g_settings->getU32("active_object_send_budget");
+
 	s16 player_radius = player_transfer_dist == 0 && is_transfer_limited ?
 		radius : player_transfer_dist;
 
@@ -2069,11 +2166,20 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 	m_env->getAddedActiveObjects(playersao, my_radius, player_radius,
 		client->m_known_objects, added_objects);
 
-	int removed_count = removed_objects.size();
-	int added_count   = added_objects.size();
+	// Send the objects the player needs most first.
+	// This also drops the ids of objects that are gone.
+	std::vector<u16> added_ids;
+	added_ids.reserve(added_objects.size());
+	for (; !added_objects.empty(); added_objects.pop())
+		added_ids.push_back(added_objects.front());
+	m_env->sortBySendPriority(playersao, added_ids);
 
-	if (removed_objects.empty() && added_objects.empty())
-		return;
+	if (removed_objects.empty() && added_ids.empty()) {
+		client->m_deferred_objects.clear();
+		return 0;
+	}
+
+	int removed_count = removed_objects.size();
 
 	char buf[4];
 	std::string data;
@@ -2100,37 +2206,55 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 	}
 
 	// Handle added objects
-	writeU16((u8*)buf, added_objects.size());
-	data.append(buf, 2);
-	while (!added_objects.empty()) {
+	// Objects over the budget stay unknown to the client and are found
+	// again as added in the next step
+	std::string added_data;
+	u16 added_count = 0;
+	u32 init_bytes = 0;
+	size_t i = 0;
+	for (; i < added_ids.size(); i++) {
+		if (send_budget != 0 && init_bytes >= send_budget)
+			break;
+
 		// Get object
-		u16 id = added_objects.front();
+		u16 id = added_ids[i];
 		ServerActiveObject *obj = m_env->getActiveObject(id);
-		added_objects.pop();
-
-		if (!obj) {
-			warningstream << FUNCTION_NAME << ": NULL object id="
-				<< (int)id << std::endl;
-			continue;
-		}
 
 		// Get object type
 		u8 type = obj->getSendType();
 
+		std::string init_data = serializeString32(
+			obj->getClientInitializationData(client->net_proto_version));
+		init_bytes += init_data.size();
+
 		// Add to data buffer for sending
 		writeU16((u8*)buf, id);
-		data.append(buf, 2);
+		added_data.append(buf, 2);
 		writeU8((u8*)buf, type);
-		data.append(buf, 1);
-
-		data.append(serializeString32(
-			obj->getClientInitializationData(client->net_proto_version)));
+		added_data.append(buf, 1);
+		added_data.append(init_data);
+		added_count++;
 
 		// Add to known objects
 		client->m_known_objects.insert(id);
 
 		obj->m_known_by_count++;
 	}
+	u32 deferred_count = added_ids.size() - i;
+
+	// Count only objects that were not already deferred in the last step
+	std::set<u16> deferred_objects(added_ids.begin() + i, added_ids.end());
+	u32 newly_deferred = 0;
+	for (u16 id : deferred_objects)
+		newly_deferred += client->m_deferred_objects.count(id) == 0;
+	client->m_deferred_objects = std::move(deferred_objects);
+	m_object_send_deferred_counter->increment(newly_deferred);
+
+	writeU16((u8*)buf, added_count);
+	data.append(buf, 2);
+	data.append(added_data);
+
+	m_object_init_bytes_counter->increment(init_bytes);
 
 	NetworkPacket pkt(TOCLIENT_ACTIVE_OBJECT_REMOVE_ADD, data.size(), client->peer_id);
 	pkt.putRawString(data.c_str(), data.size());
@@ -2138,7 +2262,10 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 
 	verbosestream << "Server::SendActiveObjectRemoveAdd: "
 		<< removed_count << " removed, " << added_count << " added, "
+		<< deferred_count << " deferred, "
 		<< "packet size is " << pkt.getSize() << std::endl;
+
+	return deferred_count;
 }
 
 void Server::SendActiveObjectMessages(session_t peer_id, const std::string &datas,
@@ -2477,8 +2604,8 @@ void Server::SendBlocks(float dtime)
 
 	// Maximal total count calculation
 	// The per-client block sends is halved with the maximal online users
-	u32 max_blocks_to_send = (m_env->getPlayerCount() + g_settings->getU32("max_users")) *
-		g_settings->getU32("max_simultaneous_block_sends_per_client") / 4 + 1;
+	u32 max_blocks_to_send = (m_env->getPlayerCount() + m_cached_settings->max_users.get()) *
+		m_cached_settings->max_simultaneous_block_sends.get() / 4 + 1;
 
 	ScopeProfiler sp(g_profiler, "Server::SendBlocks(): Send to clients");
 	Map &map = m_env->getMap();
@@ -2526,9 +2653,7 @@ bool Server::SendBlock(session_t peer_id, const v3s16 &blockpos)
 	return true;
 }
 
-bool Server::addMediaFile(const std::string &filename,
-	const std::string &filepath, std::string *filedata_to,
-	std::string *digest_to)
+static bool checkMediaFilename(const std::string &filename)
 {
 	// If name contains illegal characters, ignore the file
 	if (!string_allowed(filename, TEXTURENAME_ALLOWED_CHARS)) {
@@ -2550,21 +2675,6 @@ bool Server::addMediaFile(const std::string &filename,
 				<< filename << "\"" << std::endl;
 		return false;
 	}
-	// Ok, attempt to load the file and add to cache
-
-	// Read data
-	std::string filedata;
-	if (!fs::ReadFile(filepath, filedata)) {
-		errorstream << "Server::addMediaFile(): Failed to open \""
-					<< filename << "\" for reading" << std::endl;
-		return false;
-	}
-
-	if (filedata.empty()) {
-		errorstream << "Server::addMediaFile(): Empty file \""
-				<< filepath << "\"" << std::endl;
-		return false;
-	}
 
 	const char *deprecated_ext[] = { ".bmp", nullptr };
 	if (!removeStringEnd(filename, deprecated_ext).empty())
@@ -2572,31 +2682,83 @@ bool Server::addMediaFile(const std::string &filename,
 		warningstream << "Media file \"" << filename << "\" is using a"
 			" deprecated format and will stop working in the future." << std::endl;
 	}
+	return true;
+}
+
+bool Server::addMediaFile(const std::string &filename,
+	const std::string &filepath, std::string *filedata_to,
+	std::string *digest_to)
+{
+	if (!checkMediaFilename(filename))
+		return false;
+
+	// Unchanged files don't need to be hashed again
+	u64 file_size;
+	s64 file_mtime;
+	std::string sha1_base64;
+	bool have_info = fs::GetFileInfo(filepath, file_size, file_mtime);
+	bool indexed = have_info && m_media_index &&
+		m_media_index->lookup(filepath, file_size, file_mtime, sha1_base64);
+
+	if (!indexed || filedata_to) {
+		// Ok, attempt to load the file and add to cache
+
+		// Read data
+		std::string filedata;
+		if (!fs::ReadFile(filepath, filedata)) {
+			errorstream << "Server::addMediaFile(): Failed to open \""
+						<< filename << "\" for reading" << std::endl;
+			return false;
+		}
+
+		if (filedata.empty()) {
+			errorstream << "Server::addMediaFile(): Empty file \""
+					<< filepath << "\"" << std::endl;
+			return false;
+		}
+
+		if (!indexed) {
+			SHA1 sha1;
+			sha1.addBytes(filedata.c_str(), filedata.length());
 
-	SHA1 sha1;
-	sha1.addBytes(filedata.c_str(), filedata.length());
+			unsigned char *digest = sha1.getDigest();
+			sha1_base64 = base64_encode(digest, 20);
+			free(digest);
+
+			if (have_info && m_media_index)
+				m_media_index->update(filepath, file_size, file_mtime, sha1_base64);
+		}
+
+		if (filedata_to)
+			*filedata_to = std::move(filedata);
+	}
 
-	unsigned char *digest = sha1.getDigest();
-	std::string sha1_base64 = base64_encode(digest, 20);
-	std::string sha1_hex = hex_encode((char*) digest, 20);
 	if (digest_to)
-		*digest_to = std::string((char*) digest, 20);
-	free(digest);
+		*digest_to = base64_decode(sha1_base64);
+
+	addMediaInfo(filename, filepath, sha1_base64);
+	return true;
+}
 
+void Server::addMediaInfo(const std::string &filename,
+	const std::string &filepath, const std::string &sha1_base64)
+{
 	// Put in list
 	m_media[filename] = MediaInfo(filepath, sha1_base64);
-	verbosestream << "Server: " << sha1_hex << " is " << filename
-			<< std::endl;
-
-	if (filedata_to)
-		*filedata_to = std::move(filedata);
-	return true;
+	verbosestream << "Server: " << hex_encode(base64_decode(sha1_base64))
+			<< " is " << filename << std::endl;
 }
 
 void Server::fillMediaCache()
 {
 	infostream << "Server: Calculating media file checksums" << std::endl;
 
+	if (!m_media_index) {
+		m_media_index = std::make_unique<MediaHashIndex>(
+				m_path_world + DIR_DELIM + "media_index.txt");
+		m_media_index->load();
+	}
+
 	// Collect all media file paths
 	std::vector<std::string> paths;
 
@@ -2606,7 +2768,9 @@ void Server::fillMediaCache()
 	fs::GetRecursiveDirs(paths, m_gamespec.path + DIR_DELIM + "textures");
 	m_modmgr->getModsMediaPaths(paths);
 
-	// Collect media file information from paths into cache
+	// Collect media files from paths, the first one of a name wins
+	std::vector<std::pair<std::string, std::string>> files; // name, path
+	std::unordered_set<std::string> names;
 	for (const std::string &mediapath : paths) {
 		std::vector<fs::DirListNode> dirlist = fs::GetDirListing(mediapath);
 		for (const fs::DirListNode &dln : dirlist) {
@@ -2614,15 +2778,72 @@ void Server::fillMediaCache()
 				continue;
 
 			const std::string &filename = dln.name;
-			if (m_media.find(filename) != m_media.end()) // Do not override
+			if (m_media.find(filename) != m_media.end() ||
+					names.count(filename) != 0) // Do not override
+				continue;
+			if (!checkMediaFilename(filename))
 				continue;
 
 			std::string filepath = mediapath;
 			filepath.append(DIR_DELIM).append(filename);
-			addMediaFile(filename, filepath);
+			names.insert(filename);
+			files.emplace_back(filename, std::move(filepath));
 		}
 	}
 
+	// Look up unchanged files in the index, hash the rest in parallel.
+	// The index gets the file info from before hashing, so that a file
+	// changed meanwhile is hashed again next time.
+	struct FileInfo {
+		bool valid;
+		u64 size;
+		s64 mtime;
+	};
+	std::vector<std::string> digests(files.size());
+	std::vector<size_t> to_hash;
+	std::vector<std::string> to_hash_paths;
+	std::vector<FileInfo> to_hash_infos;
+	for (size_t i = 0; i < files.size(); i++) {
+		FileInfo info{};
+		const std::string &filepath = files[i].second;
+		info.valid = fs::GetFileInfo(filepath, info.size, info.mtime);
+		if (!info.valid ||
+				!m_media_index->lookup(filepath, info.size, info.mtime, digests[i])) {
+			to_hash.push_back(i);
+			to_hash_paths.push_back(filepath);
+			to_hash_infos.push_back(info);
+		}
+	}
+
+	u64 t_start = porting::getTimeMs();
+	std::vector<std::string> hashed;
+	hashMediaFiles(to_hash_paths, hashed);
+	for (size_t j = 0; j < to_hash.size(); j++) {
+		const std::string &filepath = to_hash_paths[j];
+		if (hashed[j].empty()) {
+			errorstream << "Server::fillMediaCache(): Failed to read \""
+					<< filepath << "\" or file is empty" << std::endl;
+			continue;
+		}
+		digests[to_hash[j]] = hashed[j];
+
+		const FileInfo &info = to_hash_infos[j];
+		if (info.valid)
+			m_media_index->update(filepath, info.size, info.mtime, hashed[j]);
+	}
+	infostream << "Server: hashed " << to_hash.size() << " of " << files.size()
+			<< " media files in " << (porting::getTimeMs() - t_start) << "ms"
+			<< std::endl;
+
+	for (size_t i = 0; i < files.size(); i++) {
+		if (!digests[i].empty())
+			addMediaInfo(files[i].first, files[i].second, digests[i]);
+	}
+
+	// Files which are gone or were replaced don't need to stay in the index
+	m_media_index->prune();
+	m_media_index->save();
+
 	infostream << "Server: " << m_media.size() << " media files collected" << std::endl;
 }
 
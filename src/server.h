@@ -43,6 +43,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
+#include <functional>
+#include <memory>
 
 class ChatEvent;
 struct ChatEventChat;
@@ -72,6 +75,8 @@ struct Lighting;
 class ServerThread;
 class ServerModManager;
 class ServerInventoryManager;
+class MediaHashIndex;
+class ModStorageDatabaseAsync;
 struct PackedValue;
 struct ParticleParameters;
 struct ParticleSpawnerParameters;
@@ -445,6 +450,14 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void SendNodeDef(session_t peer_id, const NodeDefManager *nodedef,
 		u16 protocol_version);
 
+	// Returns the compressed definitions for a protocol version, serializing
+	// them on the first request only
+	std::shared_ptr<const std::string> getDefinitionPayload(
+		std::unordered_map<u16, std::shared_ptr<const std::string>> &cache,
+		u16 protocol_version,
+		const std::function<void(std::ostream &)> &serialize);
+	void invalidateDefinitionPayloads();
+
 
 	virtual void SendChatMessage(session_t peer_id, const ChatMessage &message);
 	void SendTimeOfDay(session_t peer_id, u16 time, f32 time_speed);
@@ -499,6 +512,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 	bool addMediaFile(const std::string &filename, const std::string &filepath,
 			std::string *filedata = nullptr, std::string *digest = nullptr);
+	void addMediaInfo(const std::string &filename, const std::string &filepath,
+			const std::string &sha1_base64);
 	void fillMediaCache();
 	void sendMediaAnnouncement(session_t peer_id, const std::string &lang_code);
 	void sendRequestedMedia(session_t peer_id,
@@ -515,7 +530,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void SendSpawnParticle(session_t peer_id, u16 protocol_version,
 		const ParticleParameters &p);
 
-	void SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersao);
+	// Returns the number of added objects deferred to a later step
+	u32 SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersao);
 	void SendActiveObjectMessages(session_t peer_id, const std::string &datas,
 		bool reliable = true);
 	void SendCSMRestrictionFlags(session_t peer_id);
@@ -569,6 +585,10 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// For "dedicated" server list flag
 	bool m_dedicated;
 	Settings *m_game_settings = nullptr;
+	// Handles of settings read while running, created once the game
+	// settings are loaded
+	struct CachedSettings;
+	std::unique_ptr<CachedSettings> m_cached_settings;
 
 	// Thread can set; step() will throw as ServerError
 	MutexedVariable<std::string> m_async_fatal_error;
@@ -616,6 +636,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Mods
 	std::unique_ptr<ServerModManager> m_modmgr;
 
+	// Serialized and compressed item/node definitions by protocol version
+	std::unordered_map<u16, std::shared_ptr<const std::string>> m_itemdef_payloads;
+	std::unordered_map<u16, std::shared_ptr<const std::string>> m_nodedef_payloads;
+	std::mutex m_def_payload_mutex;
+
 	std::unordered_map<std::string, Translations> server_translations;
 
 	/*
@@ -686,6 +711,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 	// media files known to server
 	std::unordered_map<std::string, MediaInfo> m_media;
+	// digests of media files from previous runs
+	std::unique_ptr<MediaHashIndex> m_media_index;
 
 	// pending dynamic media callbacks, clients inform the server when they have a file fetched
 	std::unordered_map<u32, PendingDynamicMediaCallback> m_pending_dyn_media;
@@ -699,6 +726,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	s32 nextSoundId();
 
 	ModStorageDatabase *m_mod_storage_database = nullptr;
+	// Same object as m_mod_storage_database when it writes in the background
+	ModStorageDatabaseAsync *m_mod_storage_writer = nullptr;
 	float m_mod_storage_save_timer = 10.0f;
 
 	// CSM restrictions byteflag
@@ -722,7 +751,13 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	MetricCounterPtr m_aom_buffer_counter[2]; // [0] = rel, [1] = unrel
 	MetricCounterPtr m_packet_recv_counter;
 	MetricCounterPtr m_packet_recv_processed_counter;
+	MetricCounterPtr m_packet_recv_unlocked_counter;
 	MetricCounterPtr m_map_edit_event_counter;
+	MetricGaugePtr m_object_send_queued_gauge;
+	MetricCounterPtr m_object_send_deferred_counter;
+	MetricCounterPtr m_object_init_bytes_counter;
+	MetricCounterPtr m_inventory_send_counter;
+	MetricCounterPtr m_inventory_send_bytes_counter;
 };
 
 /*
@@ -18,6 +18,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include <log.h>
+#include <algorithm>
+#include <cmath>
 #include "mapblock.h"
 #include "profiler.h"
 #include "activeobjectmgr.h"
@@ -25,6 +27,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 namespace server
 {
 
+// Edge length of the cells of the spatial index
+static constexpr float SPATIAL_CELL_SIZE = 16 * BS;
+
 ActiveObjectMgr::~ActiveObjectMgr()
 {
 	if (!m_active_objects.empty()) {
@@ -102,6 +107,10 @@ bool ActiveObjectMgr::registerObject(std::unique_ptr<ServerActiveObject> obj)
 	auto obj_p = obj.get();
 	m_active_objects[obj->getId()] = std::move(obj);
 
+	v3s16 cell = getSpatialCell(obj_p->getBasePosition());
+	m_spatial_cells[cell].push_back(obj_p);
+	m_object_cells[obj_p] = cell;
+
 	verbosestream << "Server::ActiveObjectMgr::addActiveObjectRaw(): "
 			<< "Added id=" << obj_p->getId() << "; there are now "
 			<< m_active_objects.size() << " active objects." << std::endl;
@@ -119,25 +128,106 @@ void ActiveObjectMgr::removeObject(u16 id)
 		return;
 	}
 
+	auto cell_it = m_object_cells.find(it->second.get());
+	if (cell_it != m_object_cells.end()) {
+		removeFromSpatialCell(cell_it->first, cell_it->second);
+		m_object_cells.erase(cell_it);
+	}
+
 	// Delete the obj before erasing, as the destructor may indirectly access
 	// m_active_objects.
 	it->second.reset();
 	m_active_objects.erase(id); // `it` can be invalid now
 }
 
+v3s16 ActiveObjectMgr::getSpatialCell(const v3f &pos)
+{
+	auto coord = [] (f32 f) -> s16 {
+		f32 c = std::floor(f / SPATIAL_CELL_SIZE);
+		return rangelim(c, (f32)S16_MIN, (f32)S16_MAX);
+	};
+	return v3s16(coord(pos.X), coord(pos.Y), coord(pos.Z));
+}
+
+void ActiveObjectMgr::removeFromSpatialCell(ServerActiveObject *obj, v3s16 cell)
+{
+	auto it = m_spatial_cells.find(cell);
+	if (it == m_spatial_cells.end())
+		return;
+
+	std::vector<ServerActiveObject *> &objects = it->second;
+	auto obj_it = std::find(objects.begin(), objects.end(), obj);
+	if (obj_it != objects.end()) {
+		*obj_it = objects.back();
+		objects.pop_back();
+	}
+	if (objects.empty())
+		m_spatial_cells.erase(it);
+}
+
+void ActiveObjectMgr::updateObjectPosition(ServerActiveObject *obj)
+{
+	auto it = m_object_cells.find(obj);
+	if (it == m_object_cells.end())
+		return;
+
+	v3s16 cell = getSpatialCell(obj->getBasePosition());
+	if (cell == it->second)
+		return;
+
+	removeFromSpatialCell(obj, it->second);
+	m_spatial_cells[cell].push_back(obj);
+	it->second = cell;
+}
+
+bool ActiveObjectMgr::getSpatialCandidates(const aabb3f &box,
+		std::vector<ServerActiveObject *> &candidates)
+{
+	v3s16 min = getSpatialCell(box.MinEdge);
+	v3s16 max = getSpatialCell(box.MaxEdge);
+	u64 num_cells = (u64)(max.X - min.X + 1) * (max.Y - min.Y + 1) *
+			(max.Z - min.Z + 1);
+	if (num_cells > m_active_objects.size())
+		return false;
+
+	v3s16 cell;
+	for (cell.X = min.X; cell.X <= max.X; cell.X++)
+	for (cell.Y = min.Y; cell.Y <= max.Y; cell.Y++)
+	for (cell.Z = min.Z; cell.Z <= max.Z; cell.Z++) {
+		auto it = m_spatial_cells.find(cell);
+		if (it != m_spatial_cells.end())
+			candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+	}
+
+	// Same order as iterating over all objects
+	std::sort(candidates.begin(), candidates.end(),
+		[] (ServerActiveObject *a, ServerActiveObject *b) {
+			return a->getId() < b->getId();
+		});
+	return true;
+}
+
 void ActiveObjectMgr::getObjectsInsideRadius(const v3f &pos, float radius,
 		std::vector<ServerActiveObject *> &result,
 		std::function<bool(ServerActiveObject *obj)> include_obj_cb)
 {
 	float r2 = radius * radius;
-	for (auto &activeObject : m_active_objects) {
-		ServerActiveObject *obj = activeObject.second.get();
+	auto check = [&] (ServerActiveObject *obj) {
 		const v3f &objectpos = obj->getBasePosition();
 		if (objectpos.getDistanceFromSQ(pos) > r2)
-			continue;
+			return;
 
 		if (!include_obj_cb || include_obj_cb(obj))
 			result.push_back(obj);
+	};
+
+	std::vector<ServerActiveObject *> candidates;
+	if (getSpatialCandidates(aabb3f(pos - radius, pos + radius), candidates)) {
+		for (ServerActiveObject *obj : candidates)
+			check(obj);
+	} else {
+		for (auto &activeObject : m_active_objects)
+			check(activeObject.second.get());
 	}
 }
 
@@ -145,14 +235,22 @@ void ActiveObjectMgr::getObjectsInArea(const aabb3f &box,
 		std::vector<ServerActiveObject *> &result,
 		std::function<bool(ServerActiveObject *obj)> include_obj_cb)
 {
-	for (auto &activeObject : m_active_objects) {
-		ServerActiveObject *obj = activeObject.second.get();
+	auto check = [&] (ServerActiveObject *obj) {
 		const v3f &objectpos = obj->getBasePosition();
 		if (!box.isPointInside(objectpos))
-			continue;
+			return;
 
 		if (!include_obj_cb || include_obj_cb(obj))
 			result.push_back(obj);
+	};
+
+	std::vector<ServerActiveObject *> candidates;
+	if (getSpatialCandidates(box, candidates)) {
+		for (ServerActiveObject *obj : candidates)
+			check(obj);
+	} else {
+		for (auto &activeObject : m_active_objects)
+			check(activeObject.second.get());
 	}
 }
 
@@ -195,4 +293,43 @@ void ActiveObjectMgr::getAddedActiveObjectsAroundPos(const v3f &player_pos, f32
 	}
 }
 
+void ActiveObjectMgr::sortBySendPriority(const v3f &pos, const v3f &look_dir,
+		std::vector<u16> &ids)
+{
+	struct Prioritized
+	{
+		bool is_player;
+		f32 weighted_distance;
+		u16 id;
+
+		bool operator<(const Prioritized &other) const
+		{
+			if (is_player != other.is_player)
+				return is_player;
+			if (weighted_distance != other.weighted_distance)
+				return weighted_distance < other.weighted_distance;
+			return id < other.id;
+		}
+	};
+
+	std::vector<Prioritized> prioritized;
+	prioritized.reserve(ids.size());
+	for (u16 id : ids) {
+		ServerActiveObject *obj = getActiveObject(id);
+		if (!obj)
+			continue;
+
+		v3f dir = obj->getBasePosition() - pos;
+		f32 distance = dir.getLength();
+		f32 cos_angle = distance > 0.0f ? dir.dotProduct(look_dir) / distance : 1.0f;
+		prioritized.push_back({obj->getType() == ACTIVEOBJECT_TYPE_PLAYER,
+				distance * (1.5f - 0.5f * cos_angle), id});
+	}
+	std::sort(prioritized.begin(), prioritized.end());
+
+	ids.clear();
+	for (const Prioritized &p : prioritized)
+		ids.push_back(p.id);
+}
+
 } // namespace server
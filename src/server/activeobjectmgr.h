@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <functional>
+#include <unordered_map>
 #include <vector>
 #include "../activeobjectmgr.h"
 #include "serveractiveobject.h"
@@ -48,5 +49,30 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 	void getAddedActiveObjectsAroundPos(const v3f &player_pos, f32 radius,
 			f32 player_radius, std::set<u16> &current_objects,
 			std::queue<u16> &added_objects);
+
+	// Orders the ids by how much a player at pos looking towards look_dir
+	// needs the objects: other players first, then by distance, with objects
+	// behind the player counting as up to twice as far away.
+	// Ids of objects that no longer exist are dropped.
+	void sortBySendPriority(const v3f &pos, const v3f &look_dir,
+			std::vector<u16> &ids);
+
+	// Updates the spatial index after the object moved.
+	// Does nothing for objects that are not registered.
+	void updateObjectPosition(ServerActiveObject *obj);
+
+private:
+	static v3s16 getSpatialCell(const v3f &pos);
+	void removeFromSpatialCell(ServerActiveObject *obj, v3s16 cell);
+
+	// Gets the objects in the cells overlapping the box, sorted by id.
+	// Returns false if the box spans so many cells that checking every
+	// object is cheaper.
+	bool getSpatialCandidates(const aabb3f &box,
+			std::vector<ServerActiveObject *> &candidates);
+
+	// Spatial index of the active objects for the area queries
+	std::unordered_map<v3s16, std::vector<ServerActiveObject *>> m_spatial_cells;
+	std::unordered_map<ServerActiveObject *, v3s16> m_object_cells;
 };
 } // namespace server
@@ -0,0 +1,198 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "media_index.h"
+#include "filesys.h"
+#include "log.h"
+#include "threading/thread.h"
+#include "util/base64.h"
+#include "util/basic_macros.h"
+#include "util/sha1.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+// Bump when the format of the index file changes
+#define MEDIA_INDEX_VERSION "2"
+
+/*
+	File format, one file per line after the version line:
+	<base64 sha1> <size> <mtime in nanoseconds> <path>
+*/
+
+void MediaHashIndex::load()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_modified = false;
+
+	std::ifstream is(m_index_path, std::ios::binary);
+	if (!is.good())
+		return;
+
+	std::string line;
+	if (!std::getline(is, line) || line != MEDIA_INDEX_VERSION) {
+		infostream << "MediaHashIndex: ignoring outdated index \""
+				<< m_index_path << "\"" << std::endl;
+		m_modified = true;
+		return;
+	}
+
+	while (std::getline(is, line)) {
+		std::istringstream iss(line);
+		Entry entry;
+		if (!(iss >> entry.sha1_base64 >> entry.size >> entry.mtime) ||
+				iss.get() != ' ' || !base64_is_valid(entry.sha1_base64)) {
+			// Drop the broken line, the file gets hashed again
+			m_modified = true;
+			continue;
+		}
+		std::string path;
+		std::getline(iss, path);
+		entry.used = false;
+		m_entries[path] = std::move(entry);
+	}
+
+	infostream << "MediaHashIndex: loaded " << m_entries.size()
+			<< " entries" << std::endl;
+}
+
+void MediaHashIndex::save()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_modified)
+		return;
+
+	std::ostringstream os(std::ios::binary);
+	os << MEDIA_INDEX_VERSION << "\n";
+	for (const auto &it : m_entries) {
+		const Entry &entry = it.second;
+		os << entry.sha1_base64 << " " << entry.size << " " << entry.mtime
+				<< " " << it.first << "\n";
+	}
+
+	if (!fs::safeWriteToFile(m_index_path, os.str())) {
+		warningstream << "MediaHashIndex: failed to write \""
+				<< m_index_path << "\"" << std::endl;
+		return;
+	}
+	m_modified = false;
+}
+
+bool MediaHashIndex::lookup(const std::string &path, u64 size, s64 mtime,
+		std::string &sha1_base64)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(path);
+	if (it == m_entries.end())
+		return false;
+
+	Entry &entry = it->second;
+	if (entry.size != size || entry.mtime != mtime)
+		return false;
+
+	entry.used = true;
+	sha1_base64 = entry.sha1_base64;
+	return true;
+}
+
+void MediaHashIndex::update(const std::string &path, u64 size, s64 mtime,
+		const std::string &sha1_base64)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Entry &entry = m_entries[path];
+	entry.size = size;
+	entry.mtime = mtime;
+	entry.sha1_base64 = sha1_base64;
+	entry.used = true;
+	m_modified = true;
+}
+
+void MediaHashIndex::prune()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		if (it->second.used) {
+			++it;
+		} else {
+			it = m_entries.erase(it);
+			m_modified = true;
+		}
+	}
+}
+
+class HashMediaThread : public Thread
+{
+public:
+	HashMediaThread(const std::vector<std::string> &paths,
+			std::vector<std::string> &sha1_base64, std::atomic<size_t> &next) :
+		Thread("HashMedia"),
+		m_paths(paths),
+		m_sha1_base64(sha1_base64),
+		m_next(next)
+	{}
+
+protected:
+	void *run()
+	{
+		std::string filedata;
+		size_t i;
+		while ((i = m_next++) < m_paths.size()) {
+			if (!fs::ReadFile(m_paths[i], filedata) || filedata.empty())
+				continue;
+
+			SHA1 sha1;
+			sha1.addBytes(filedata.c_str(), filedata.length());
+			unsigned char *digest = sha1.getDigest();
+			m_sha1_base64[i] = base64_encode(digest, 20);
+			free(digest);
+		}
+		return nullptr;
+	}
+
+private:
+	const std::vector<std::string> &m_paths;
+	std::vector<std::string> &m_sha1_base64;
+	std::atomic<size_t> &m_next;
+};
+
+void hashMediaFiles(const std::vector<std::string> &paths,
+		std::vector<std::string> &sha1_base64)
+{
+	sha1_base64.clear();
+	sha1_base64.resize(paths.size());
+	if (paths.empty())
+		return;
+
+	// Reading is I/O bound, so a few more threads than cores don't hurt
+	unsigned int num_threads = MYMIN(16U, Thread::getNumberOfProcessors() * 2);
+	num_threads = std::min<size_t>(num_threads, paths.size());
+	num_threads = MYMAX(num_threads, 1U);
+
+	std::atomic<size_t> next(0);
+	std::vector<std::unique_ptr<HashMediaThread>> threads;
+	for (unsigned int i = 0; i < num_threads; i++) {
+		threads.emplace_back(new HashMediaThread(paths, sha1_base64, next));
+		threads.back()->start();
+	}
+	for (auto &thread : threads)
+		thread->wait();
+}
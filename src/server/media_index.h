@@ -0,0 +1,78 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+	Remembers the SHA1 digests of media files by path, size and modification
+	time, so that files which did not change since the last server start
+	don't have to be read and hashed again.
+*/
+class MediaHashIndex
+{
+public:
+	MediaHashIndex(const std::string &index_path) : m_index_path(index_path) {}
+
+	void load();
+	// Writes the index back if it changed since it was loaded
+	void save();
+
+	// Returns true and the base64-encoded digest if the file is unchanged
+	bool lookup(const std::string &path, u64 size, s64 mtime,
+			std::string &sha1_base64);
+	void update(const std::string &path, u64 size, s64 mtime,
+			const std::string &sha1_base64);
+
+	// Forgets all files that were neither looked up nor updated
+	void prune();
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_entries.size();
+	}
+
+private:
+	struct Entry
+	{
+		u64 size;
+		s64 mtime;
+		std::string sha1_base64;
+		bool used;
+	};
+
+	const std::string m_index_path;
+	std::unordered_map<std::string, Entry> m_entries;
+	bool m_modified = false;
+	mutable std::mutex m_mutex;
+};
+
+/*
+	Reads and hashes the given files using several threads.
+	sha1_base64[i] receives the digest of paths[i], or stays empty if the
+	file could not be read or is empty.
+*/
+void hashMediaFiles(const std::vector<std::string> &paths,
+		std::vector<std::string> &sha1_base64);
@@ -222,10 +222,7 @@ void PlayerSAO::step(float dtime, bool send_recommended)
 	}
 
 	if (!m_properties_sent) {
-		m_properties_sent = true;
-		std::string str = getPropertyPacket();
-		// create message and add to list
-		m_messages_out.emplace(getId(), true, str);
+		sendPropertyPacket(getPropertyPacket());
 		m_env->getScriptIface()->player_event(this, "properties_changed");
 	}
 
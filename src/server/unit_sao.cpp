@@ -261,6 +261,16 @@ void UnitSAO::notifyObjectPropertiesModified()
 	m_properties_sent = false;
 }
 
+void UnitSAO::sendPropertyPacket(std::string packet)
+{
+	m_properties_sent = true;
+	// Mods often set the same properties again, don't resend them
+	if (packet == m_last_property_packet)
+		return;
+	m_messages_out.emplace(getId(), true, packet);
+	m_last_property_packet = std::move(packet);
+}
+
 std::string UnitSAO::generateUpdateAttachmentCommand() const
 {
 	std::ostringstream os(std::ios::binary);
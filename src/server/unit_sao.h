@@ -90,6 +90,8 @@ class UnitSAO : public ServerActiveObject
 	ObjectProperties *accessObjectProperties();
 	void notifyObjectPropertiesModified();
 	void sendOutdatedData();
+	// Queues a property update, unless the last one sent was the same
+	void sendPropertyPacket(std::string packet);
 
 	// Update packets
 	std::string generateUpdateAttachmentCommand() const;
@@ -115,6 +117,8 @@ class UnitSAO : public ServerActiveObject
 	// Object properties
 	bool m_properties_sent = true;
 	ObjectProperties m_prop;
+	// Last property update sent, to skip updates that change nothing
+	std::string m_last_property_packet;
 
 	// Stores position and rotation for each bone name
 	std::unordered_map<std::string, core::vector2d<v3f>> m_bone_position;
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include <algorithm>
+#include <iterator>
 #include <stack>
 #include "serverenvironment.h"
 #include "settings.h"
@@ -25,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapblock.h"
 #include "nodedef.h"
 #include "nodemetadata.h"
+#include "pathfinder.h"
 #include "gamedef.h"
 #include "map.h"
 #include "porting.h"
@@ -39,6 +41,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "threading/mutex_auto_lock.h"
 #include "filesys.h"
 #include "gameparams.h"
+#include "database/database-async.h"
 #include "database/database-dummy.h"
 #include "database/database-files.h"
 #include "database/database-sqlite3.h"
@@ -298,27 +301,12 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block,
 	ActiveBlockList
 */
 
-void fillRadiusBlock(v3s16 p0, s16 r, std::set<v3s16> &list)
-{
-	v3s16 p;
-	for(p.X=p0.X-r; p.X<=p0.X+r; p.X++)
-		for(p.Y=p0.Y-r; p.Y<=p0.Y+r; p.Y++)
-			for(p.Z=p0.Z-r; p.Z<=p0.Z+r; p.Z++)
-			{
-				// limit to a sphere
-				if (p.getDistanceFrom(p0) <= r) {
-					// Set in list
-					list.insert(p);
-				}
-			}
-}
-
-void fillViewConeBlock(v3s16 p0,
+static void fillViewConeBlock(v3s16 p0,
 	const s16 r,
 	const v3f camera_pos,
 	const v3f camera_dir,
 	const float camera_fov,
-	std::set<v3s16> &list)
+	std::vector<v3s16> &list)
 {
 	v3s16 p;
 	const s16 r_nodes = r * BS * MAP_BLOCKSIZE;
@@ -326,7 +314,60 @@ void fillViewConeBlock(v3s16 p0,
 	for (p.Y = p0.Y - r; p.Y <= p0.Y+r; p.Y++)
 	for (p.Z = p0.Z - r; p.Z <= p0.Z+r; p.Z++) {
 		if (isBlockInSight(p, camera_pos, camera_dir, camera_fov, r_nodes)) {
-			list.insert(p);
+			list.push_back(p);
+		}
+	}
+}
+
+// The view cone of a player is only computed again after turning by more
+// than this (cosine of ~6 degrees) or entering another block
+static const f32 VIEW_CONE_MIN_COS_CHANGE = 0.995f;
+
+const std::vector<v3s16> &ActiveBlockList::getSphereOffsets(s16 radius)
+{
+	if (radius != m_sphere_radius) {
+		m_sphere_radius = radius;
+		m_sphere_offsets.clear();
+		v3s16 p;
+		for (p.X = -radius; p.X <= radius; p.X++)
+		for (p.Y = -radius; p.Y <= radius; p.Y++)
+		for (p.Z = -radius; p.Z <= radius; p.Z++) {
+			// limit to a sphere
+			if (p.getDistanceFrom(v3s16(0, 0, 0)) <= radius)
+				m_sphere_offsets.push_back(p);
+		}
+	}
+	return m_sphere_offsets;
+}
+
+void ActiveBlockList::addRefs(const std::vector<v3s16> &blocks, v3s16 offset,
+	bool abm)
+{
+	for (v3s16 p : blocks) {
+		p += offset;
+		if (m_refs[p]++ == 0)
+			m_touched.insert(p);
+		if (abm && m_abm_refs[p]++ == 0)
+			m_touched.insert(p);
+	}
+}
+
+void ActiveBlockList::removeRefs(const std::vector<v3s16> &blocks, v3s16 offset,
+	bool abm)
+{
+	for (v3s16 p : blocks) {
+		p += offset;
+		auto it = m_refs.find(p);
+		if (--it->second == 0) {
+			m_refs.erase(it);
+			m_touched.insert(p);
+		}
+		if (!abm)
+			continue;
+		it = m_abm_refs.find(p);
+		if (--it->second == 0) {
+			m_abm_refs.erase(it);
+			m_touched.insert(p);
 		}
 	}
 }
@@ -337,15 +378,12 @@ void ActiveBlockList::update(std::vector<PlayerSAO*> &active_players,
 	std::set<v3s16> &blocks_removed,
 	std::set<v3s16> &blocks_added)
 {
-	/*
-		Create the new list
-	*/
-	std::set<v3s16> newlist = m_forceloaded_list;
-	m_abm_list = m_forceloaded_list;
+	std::vector<PlayerView> views;
+	views.reserve(active_players.size());
 	for (const PlayerSAO *playersao : active_players) {
-		v3s16 pos = getNodeBlockPos(floatToInt(playersao->getBasePosition(), BS));
-		fillRadiusBlock(pos, active_block_range, m_abm_list);
-		fillRadiusBlock(pos, active_block_range, newlist);
+		PlayerView view;
+		view.id = playersao->getId();
+		view.blockpos = getNodeBlockPos(floatToInt(playersao->getBasePosition(), BS));
 
 		s16 player_ao_range = std::min(active_object_range, playersao->getWantedRange());
 		// only do this if this would add blocks
@@ -355,39 +393,121 @@ void ActiveBlockList::update(std::vector<PlayerSAO*> &active_players,
 			camera_dir.rotateXZBy(playersao->getRotation().Y);
 			if (playersao->getCameraInverted())
 				camera_dir = -camera_dir;
-			fillViewConeBlock(pos,
-				player_ao_range,
-				playersao->getEyePosition(),
-				camera_dir,
-				playersao->getFov(),
-				newlist);
+			view.cone_range = player_ao_range;
+			view.camera_pos = playersao->getEyePosition();
+			view.camera_dir = camera_dir;
+			view.camera_fov = playersao->getFov();
 		}
+		views.push_back(view);
 	}
 
+	update(views, active_block_range, blocks_removed, blocks_added);
+}
+
+void ActiveBlockList::update(const std::vector<PlayerView> &players,
+	s16 active_block_range,
+	std::set<v3s16> &blocks_removed,
+	std::set<v3s16> &blocks_added)
+{
 	/*
-		Find out which blocks on the old list are not on the new list
+		Update the references of players that moved or turned around.
+		New references are added before the old ones are removed, so that
+		blocks that stay active are not touched.
 	*/
-	// Go through old list
-	for (v3s16 p : m_list) {
-		// If not on new list, it's been removed
-		if (newlist.find(p) == newlist.end())
-			blocks_removed.insert(p);
+	for (auto &it : m_players)
+		it.second.seen = false;
+
+	for (const PlayerView &view : players) {
+		auto inserted = m_players.emplace(view.id, PlayerState());
+		PlayerState &state = inserted.first->second;
+		bool is_new = inserted.second;
+		state.seen = true;
+
+		bool moved = is_new || state.blockpos != view.blockpos ||
+			state.radius != active_block_range;
+		if (moved) {
+			addRefs(getSphereOffsets(active_block_range), view.blockpos, true);
+			if (!is_new)
+				removeRefs(getSphereOffsets(state.radius), state.blockpos, true);
+			state.blockpos = view.blockpos;
+			state.radius = active_block_range;
+		}
+
+		bool cone_changed = moved || state.cone_range != view.cone_range ||
+			(view.cone_range > 0 && (state.camera_fov != view.camera_fov ||
+			state.camera_dir.dotProduct(view.camera_dir) < VIEW_CONE_MIN_COS_CHANGE));
+		if (cone_changed) {
+			std::vector<v3s16> cone;
+			if (view.cone_range > 0) {
+				fillViewConeBlock(view.blockpos, view.cone_range,
+					view.camera_pos, view.camera_dir, view.camera_fov, cone);
+			}
+			addRefs(cone, v3s16(), false);
+			removeRefs(state.cone, v3s16(), false);
+			state.cone = std::move(cone);
+			state.cone_range = view.cone_range;
+			state.camera_dir = view.camera_dir;
+			state.camera_fov = view.camera_fov;
+		}
 	}
 
-	/*
-		Find out which blocks on the new list are not on the old list
-	*/
-	// Go through new list
-	for (v3s16 p : newlist) {
-		// If not on old list, it's been added
-		if (m_list.find(p) == m_list.end())
-			blocks_added.insert(p);
+	// Players that left
+	for (auto it = m_players.begin(); it != m_players.end();) {
+		if (it->second.seen) {
+			++it;
+			continue;
+		}
+		removeRefs(getSphereOffsets(it->second.radius), it->second.blockpos, true);
+		removeRefs(it->second.cone, v3s16(), false);
+		it = m_players.erase(it);
+	}
+
+	// Forceloaded blocks, changed by mods
+	if (m_forceloaded_list != m_forceloaded_applied) {
+		std::vector<v3s16> added, removed;
+		std::set_difference(m_forceloaded_list.begin(), m_forceloaded_list.end(),
+			m_forceloaded_applied.begin(), m_forceloaded_applied.end(),
+			std::back_inserter(added));
+		std::set_difference(m_forceloaded_applied.begin(), m_forceloaded_applied.end(),
+			m_forceloaded_list.begin(), m_forceloaded_list.end(),
+			std::back_inserter(removed));
+		addRefs(added, v3s16(), true);
+		removeRefs(removed, v3s16(), true);
+		m_forceloaded_applied = m_forceloaded_list;
 	}
 
 	/*
-		Update m_list
+		Bring the lists in line with the references where they changed,
+		and retry blocks that could not be loaded before
 	*/
-	m_list = std::move(newlist);
+	m_touched.insert(m_retry.begin(), m_retry.end());
+	m_retry.clear();
+	for (v3s16 p : m_touched) {
+		if (m_refs.find(p) != m_refs.end()) {
+			if (m_list.insert(p).second)
+				blocks_added.insert(p);
+		} else if (m_list.erase(p)) {
+			blocks_removed.insert(p);
+		}
+
+		if (m_abm_refs.find(p) != m_abm_refs.end())
+			m_abm_list.insert(p);
+		else
+			m_abm_list.erase(p);
+	}
+	m_touched.clear();
+}
+
+void ActiveBlockList::clear()
+{
+	m_list.clear();
+	m_abm_list.clear();
+	m_refs.clear();
+	m_abm_refs.clear();
+	m_players.clear();
+	m_forceloaded_applied.clear();
+	m_touched.clear();
+	m_retry.clear();
 }
 
 /*
@@ -427,6 +547,8 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 
 	m_active_object_gauge = mb->addGauge(
 		"minetest_env_active_objects", "Number of active objects");
+
+	m_metrics_backend = mb;
 }
 
 void ServerEnvironment::init()
@@ -498,10 +620,26 @@ void ServerEnvironment::init()
 	m_player_database = openPlayerDatabase(player_backend_name, m_path_world, conf);
 	m_auth_database = openAuthDatabase(auth_backend_name, m_path_world, conf);
 
+	// Write players and auth data in the background
+	float write_interval = g_settings->getFloat("database_write_interval");
+	if (write_interval > 0) {
+		m_database_writer = std::make_unique<DatabaseWriteThread>(
+			m_player_database, m_auth_database, write_interval, m_metrics_backend);
+		m_player_database = new PlayerDatabaseAsync(m_database_writer.get());
+		m_auth_database = new AuthDatabaseAsync(m_database_writer.get());
+	}
+
 	if (m_map && m_script->has_on_mapblocks_changed()) {
 		m_map->addEventReceiver(&m_on_mapblocks_changed_receiver);
 		m_on_mapblocks_changed_receiver.receiving = true;
 	}
+
+	if (m_map) {
+		m_pathfinder_cache = std::make_unique<PathfinderNodeCache>(m_server->ndef());
+		m_map->addEventReceiver(m_pathfinder_cache.get());
+		m_pathfinder_queue = std::make_unique<PathfinderQueue>(m_map,
+				m_pathfinder_cache.get());
+	}
 }
 
 ServerEnvironment::~ServerEnvironment()
@@ -517,9 +655,14 @@ ServerEnvironment::~ServerEnvironment()
 		m_server->addShutdownError(e);
 	}
 
+	m_pathfinder_queue.reset();
+
 	// Drop/delete map
-	if (m_map)
+	if (m_map) {
+		if (m_pathfinder_cache)
+			m_map->removeEventReceiver(m_pathfinder_cache.get());
 		m_map->drop();
+	}
 
 	// Delete ActiveBlockModifiers
 	for (ABMWithState &m_abm : m_abms) {
@@ -533,6 +676,8 @@ ServerEnvironment::~ServerEnvironment()
 
 	delete m_player_database;
 	delete m_auth_database;
+	// Writes what is left
+	m_database_writer.reset();
 }
 
 Map & ServerEnvironment::getMap()
@@ -605,6 +750,9 @@ void ServerEnvironment::kickAllPlayers(AccessDeniedCode reason,
 
 void ServerEnvironment::saveLoadedPlayers(bool force)
 {
+	if (m_database_writer)
+		m_database_writer->checkError();
+
 	for (RemotePlayer *player : m_players) {
 		if (force || player->checkModified() || (player->getPlayerSAO() &&
 				player->getPlayerSAO()->getMeta().isModified())) {
@@ -1341,9 +1489,7 @@ void ServerEnvironment::step(float dtime)
 	// Update this one
 	// NOTE: This is kind of funny on a singleplayer game, but doesn't
 	// really matter that much.
-	static thread_local const float server_step =
-			g_settings->getFloat("dedicated_server_step");
-	m_recommended_send_interval = server_step;
+	m_recommended_send_interval = m_dedicated_server_step.get();
 
 	/*
 		Increment game time
@@ -1370,6 +1516,16 @@ void ServerEnvironment::step(float dtime)
 		}
 	}
 
+	/*
+		Activate objects left over from blocks activated before
+	*/
+	m_object_activation_budget = m_max_objects_activated.get();
+	if (!m_pending_objects.empty()) {
+		ScopeProfiler sp(g_profiler, "ServerEnv: activate pending objects", SPT_AVG);
+		activatePendingObjects();
+		g_profiler->avg("ServerEnv: blocks with pending objects", m_pending_objects.size());
+	}
+
 	/*
 		Manage active block list
 	*/
@@ -1397,13 +1553,9 @@ void ServerEnvironment::step(float dtime)
 		*/
 		// use active_object_send_range_blocks since that is max distance
 		// for active objects sent the client anyway
-		static thread_local const s16 active_object_range =
-				g_settings->getS16("active_object_send_range_blocks");
-		static thread_local const s16 active_block_range =
-				g_settings->getS16("active_block_range");
 		std::set<v3s16> blocks_removed;
 		std::set<v3s16> blocks_added;
-		m_active_blocks.update(players, active_block_range, active_object_range,
+		m_active_blocks.update(players, m_active_block_range.get(), m_active_object_send_range.get(),
 			blocks_removed, blocks_added);
 
 		/*
@@ -1539,6 +1691,12 @@ void ServerEnvironment::step(float dtime)
 
 	m_script->stepAsync();
 
+	if (m_pathfinder_queue) {
+		PathfinderQueue::Result result;
+		while (m_pathfinder_queue->popResult(result))
+			m_script->on_path_found(result.id, result.path);
+	}
+
 	/*
 		Step active objects
 	*/
@@ -1705,6 +1863,17 @@ void ServerEnvironment::getAddedActiveObjects(PlayerSAO *playersao, s16 radius,
 		player_radius_f, current_objects, added_objects);
 }
 
+void ServerEnvironment::sortBySendPriority(PlayerSAO *playersao, std::vector<u16> &ids)
+{
+	v3f look_dir = v3f(0,0,1);
+	look_dir.rotateYZBy(playersao->getLookPitch());
+	look_dir.rotateXZBy(playersao->getRotation().Y);
+	if (playersao->getCameraInverted())
+		look_dir = -look_dir;
+
+	m_ao_manager.sortBySendPriority(playersao->getEyePosition(), look_dir, ids);
+}
+
 /*
 	Finds out what objects have been removed from
 	inside a radius around a position
@@ -1989,12 +2158,80 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 	if (block == NULL)
 		return;
 
+	m_pending_objects.erase(block->getPos());
+
 	if (!block->onObjectsActivation())
 		return;
 
+	if (m_max_objects_activated.get() == 0) {
+		activateStoredObjects(block, dtime_s, 0);
+		return;
+	}
+
+	size_t count = block->m_static_objects.getStoredSize();
+	size_t activated = 0;
+	if (m_object_activation_budget > 0) {
+		activated = activateStoredObjects(block, dtime_s, m_object_activation_budget);
+		m_object_activation_budget -= activated;
+		if (block->isOrphan())
+			return;
+	}
+	if (activated < count)
+		m_pending_objects[block->getPos()] = {count - activated, dtime_s, m_game_time};
+}
+
+void ServerEnvironment::activatePendingObjects()
+{
+	for (auto it = m_pending_objects.begin(); it != m_pending_objects.end() &&
+			m_object_activation_budget > 0; ) {
+		MapBlock *block = m_map->getBlockNoCreateNoEx(it->first);
+		if (!block || !m_active_blocks.contains(it->first)) {
+			// The objects stay stored until the block is activated again
+			it = m_pending_objects.erase(it);
+			continue;
+		}
+
+		PendingObjects &pending = it->second;
+		size_t max = std::min<size_t>(pending.count, m_object_activation_budget);
+		u32 dtime_s = pending.dtime_s + (m_game_time - pending.game_time);
+		size_t activated = activateStoredObjects(block, dtime_s, max);
+		m_object_activation_budget -= activated;
+		// Running out of stored objects early means they were removed
+		if (activated < max || pending.count == max) {
+			it = m_pending_objects.erase(it);
+		} else {
+			pending.count -= max;
+			++it;
+		}
+	}
+}
+
+size_t ServerEnvironment::activateStoredObjects(MapBlock *block, u32 dtime_s,
+		size_t max)
+{
+	// Objects may have been added to the block while its stored ones were
+	// pending. The ones that do not fit stay stored.
+	size_t wanted = block->m_static_objects.getStoredSize();
+	if (max != 0)
+		wanted = std::min(wanted, max);
+	size_t room = block->m_static_objects.getActivatableCount(
+			m_max_objects_per_block.get());
+	if (room < wanted) {
+		warningstream << "ServerEnvironment::activateObjects(): block "
+				<< block->getPos() << " already has "
+				<< block->m_static_objects.getActiveSize()
+				<< " active objects, leaving " << (wanted - room)
+				<< " objects stored" << std::endl;
+		if (room == 0)
+			return 0;
+		max = room;
+	}
+
+	std::vector<StaticObject> stored = block->m_static_objects.takeStored(max);
+
 	// Activate stored objects
 	std::vector<StaticObject> new_stored;
-	for (const StaticObject &s_obj : block->m_static_objects.getAllStored()) {
+	for (const StaticObject &s_obj : stored) {
 		// Create an active object from the data
 		std::unique_ptr<ServerActiveObject> obj =
 				createSAO((ActiveObjectType)s_obj.type, s_obj.pos, s_obj.data);
@@ -2015,11 +2252,9 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 		// This will also add the object to the active static list
 		addActiveObjectRaw(std::move(obj), false, dtime_s);
 		if (block->isOrphan())
-			return;
+			return stored.size();
 	}
 
-	// Clear stored list
-	block->m_static_objects.clearStored();
 	// Add leftover failed stuff to stored list
 	for (const StaticObject &s_obj : new_stored) {
 		block->m_static_objects.pushStored(s_obj);
@@ -2033,6 +2268,7 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 		Thus, do not call block->raiseModified(MOD_STATE_WRITE_NEEDED).
 		Otherwise there would be a huge amount of unnecessary I/O.
 	*/
+	return stored.size();
 }
 
 /*
@@ -26,14 +26,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server/activeobjectmgr.h"
 #include "util/numeric.h"
 #include "util/metricsbackend.h"
+#include <memory>
 #include <set>
 #include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 class IGameDef;
 struct GameParams;
 class RemotePlayer;
 class PlayerDatabase;
 class AuthDatabase;
+class DatabaseWriteThread;
 class PlayerSAO;
 class ServerEnvironment;
 class ActiveBlockModifier;
@@ -41,6 +45,8 @@ struct StaticObject;
 class ServerActiveObject;
 class Server;
 class ServerScripting;
+class PathfinderNodeCache;
+class PathfinderQueue;
 enum AccessDeniedCode : u8;
 typedef u16 session_t;
 
@@ -164,11 +170,27 @@ class LBMManager
 class ActiveBlockList
 {
 public:
+	// What a player keeps active
+	struct PlayerView
+	{
+		u16 id = 0;
+		v3s16 blockpos;
+		// Range of the view cone, 0 if the player has none
+		s16 cone_range = 0;
+		v3f camera_pos;
+		v3f camera_dir;
+		f32 camera_fov = 0.0f;
+	};
+
 	void update(std::vector<PlayerSAO*> &active_players,
 		s16 active_block_range,
 		s16 active_object_range,
 		std::set<v3s16> &blocks_removed,
 		std::set<v3s16> &blocks_added);
+	void update(const std::vector<PlayerView> &players,
+		s16 active_block_range,
+		std::set<v3s16> &blocks_removed,
+		std::set<v3s16> &blocks_added);
 
 	bool contains(v3s16 p) const {
 		return (m_list.find(p) != m_list.end());
@@ -178,19 +200,53 @@ class ActiveBlockList
 		return m_list.size();
 	}
 
-	void clear() {
-		m_list.clear();
-	}
+	void clear();
 
+	// Deactivates a block that could not be loaded. It is reported as
+	// added again by the next update if it is still wanted.
 	void remove(v3s16 p) {
 		m_list.erase(p);
 		m_abm_list.erase(p);
+		m_retry.insert(p);
 	}
 
-	std::set<v3s16> m_list;
-	std::set<v3s16> m_abm_list;
+	std::unordered_set<v3s16> m_list;
+	std::unordered_set<v3s16> m_abm_list;
 	// list of blocks that are always active, not modified by this class
 	std::set<v3s16> m_forceloaded_list;
+
+private:
+	/*
+		The lists are maintained incrementally: every player and the
+		forceloaded list hold references on the blocks they keep active,
+		and only the references of players that moved or turned around
+		change in an update.
+	*/
+	struct PlayerState
+	{
+		v3s16 blockpos;
+		s16 radius = 0;
+		s16 cone_range = 0;
+		v3f camera_dir;
+		f32 camera_fov = 0.0f;
+		std::vector<v3s16> cone;
+		bool seen = false;
+	};
+
+	void addRefs(const std::vector<v3s16> &blocks, v3s16 offset, bool abm);
+	void removeRefs(const std::vector<v3s16> &blocks, v3s16 offset, bool abm);
+	const std::vector<v3s16> &getSphereOffsets(s16 radius);
+
+	std::unordered_map<v3s16, u32> m_refs;
+	std::unordered_map<v3s16, u32> m_abm_refs;
+	std::unordered_map<u16, PlayerState> m_players;
+	std::set<v3s16> m_forceloaded_applied;
+	// Blocks whose references changed since the last update
+	std::unordered_set<v3s16> m_touched;
+	std::unordered_set<v3s16> m_retry;
+
+	s16 m_sphere_radius = -1;
+	std::vector<v3s16> m_sphere_offsets;
 };
 
 /*
@@ -235,6 +291,12 @@ class ServerEnvironment final : public Environment
 	Server *getGameDef()
 	{ return m_server; }
 
+	PathfinderNodeCache *getPathfinderCache()
+	{ return m_pathfinder_cache.get(); }
+
+	PathfinderQueue *getPathfinderQueue()
+	{ return m_pathfinder_queue.get(); }
+
 	float getSendRecommendedInterval()
 	{ return m_recommended_send_interval; }
 
@@ -306,6 +368,12 @@ class ServerEnvironment final : public Environment
 		std::set<u16> &current_objects,
 		std::queue<u16> &removed_objects);
 
+	/*
+		Orders added objects so that the ones most relevant to the player
+		(close by, in view) are sent first
+	*/
+	void sortBySendPriority(PlayerSAO *playersao, std::vector<u16> &ids);
+
 	/*
 		Get the next message emitted by some active object.
 		Returns false if no messages are available, true otherwise.
@@ -358,6 +426,12 @@ class ServerEnvironment final : public Environment
 		return m_ao_manager.getObjectsInArea(box, objects, include_obj_cb);
 	}
 
+	// Keeps the spatial index of the active objects up to date
+	void onObjectMoved(ServerActiveObject *obj)
+	{
+		m_ao_manager.updateObjectPosition(obj);
+	}
+
 	// Clear objects, loading and going through every MapBlock
 	void clearObjects(ClearObjectsMode mode);
 
@@ -431,9 +505,14 @@ class ServerEnvironment final : public Environment
 	void removeRemovedObjects();
 
 	/*
-		Convert stored objects from block to active
+		Convert stored objects from block to active.
+		Blocks with more objects than are left for this step are finished
+		in the next steps by activatePendingObjects().
 	*/
 	void activateObjects(MapBlock *block, u32 dtime_s);
+	void activatePendingObjects();
+	// Activates up to max of the first stored objects, returns how many it took
+	size_t activateStoredObjects(MapBlock *block, u32 dtime_s, size_t max);
 
 	/*
 		Convert objects that are not in active blocks to static.
@@ -468,6 +547,10 @@ class ServerEnvironment final : public Environment
 	server::ActiveObjectMgr m_ao_manager;
 	// on_mapblocks_changed map event receiver
 	OnMapblocksChangedReceiver m_on_mapblocks_changed_receiver;
+	// Walkability of map blocks shared by path searches
+	std::unique_ptr<PathfinderNodeCache> m_pathfinder_cache;
+	// Path searches running on worker threads
+	std::unique_ptr<PathfinderQueue> m_pathfinder_queue;
 	// World path
 	const std::string m_path_world;
 	// Outgoing network message buffer for active objects
@@ -491,11 +574,28 @@ class ServerEnvironment final : public Environment
 	// Time of last clearObjects call (game time).
 	// When a mapblock older than this is loaded, its objects are cleared.
 	u32 m_last_clear_objects_time = 0;
+	// Blocks with stored objects left to activate
+	struct PendingObjects
+	{
+		// Stored objects left, failed ones are put back after them
+		size_t count;
+		u32 dtime_s;
+		u32 game_time;
+	};
+	std::map<v3s16, PendingObjects> m_pending_objects;
+	// Objects that can still be activated in this step, if limited
+	u32 m_object_activation_budget = 0;
+	SettingHandle<u32> m_max_objects_activated{"max_objects_activated_per_step"};
+	SettingHandle<u16> m_max_objects_per_block{"max_objects_per_block"};
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
 	LBMManager m_lbm_mgr;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval = 0.1f;
+	// Read per environment, so that the game settings of this server apply
+	SettingHandle<float> m_dedicated_server_step{"dedicated_server_step"};
+	SettingHandle<s16> m_active_object_send_range{"active_object_send_range_blocks"};
+	SettingHandle<s16> m_active_block_range{"active_block_range"};
 	// Estimate for general maximum lag as determined by server.
 	// Can raise to high values like 15s with eg. map generation mods.
 	float m_max_lag_estimate = 0.1f;
@@ -505,6 +605,8 @@ class ServerEnvironment final : public Environment
 
 	PlayerDatabase *m_player_database = nullptr;
 	AuthDatabase *m_auth_database = nullptr;
+	// Owns the actual databases if they are written in the background
+	std::unique_ptr<DatabaseWriteThread> m_database_writer;
 
 	// Pseudo random generator for shuffling, etc.
 	std::mt19937 m_rgen;
@@ -516,6 +618,7 @@ class ServerEnvironment final : public Environment
 	std::unordered_map<u32, u16> m_particle_spawner_attachments;
 
 	// Environment metrics
+	MetricsBackend *m_metrics_backend;
 	MetricCounterPtr m_step_time_counter;
 	MetricGaugePtr m_active_block_gauge;
 	MetricGaugePtr m_active_object_gauge;
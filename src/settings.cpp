@@ -1093,3 +1093,79 @@ void Settings::doCallbacks(const std::string &name) const
 			(it->first)(name, it->second);
 	}
 }
+
+/*
+	SettingHandle
+*/
+
+static void read_setting(const std::string &name, bool &value)
+{
+	value = g_settings->getBool(name);
+}
+
+static void read_setting(const std::string &name, u16 &value)
+{
+	value = g_settings->getU16(name);
+}
+
+static void read_setting(const std::string &name, s16 &value)
+{
+	value = g_settings->getS16(name);
+}
+
+static void read_setting(const std::string &name, u32 &value)
+{
+	value = g_settings->getU32(name);
+}
+
+static void read_setting(const std::string &name, s32 &value)
+{
+	value = g_settings->getS32(name);
+}
+
+static void read_setting(const std::string &name, float &value)
+{
+	value = g_settings->getFloat(name);
+}
+
+template <typename T>
+SettingHandle<T>::SettingHandle(const std::string &name) :
+	m_name(name),
+	m_value(T())
+{
+	reload();
+	g_settings->registerChangedCallback(m_name, &SettingHandle::changedCallback, this);
+}
+
+template <typename T>
+SettingHandle<T>::~SettingHandle()
+{
+	// Handles with static storage may outlive the global settings
+	if (g_settings)
+		g_settings->deregisterChangedCallback(m_name, &SettingHandle::changedCallback, this);
+}
+
+template <typename T>
+void SettingHandle<T>::changedCallback(const std::string &name, void *data)
+{
+	static_cast<SettingHandle *>(data)->reload();
+}
+
+template <typename T>
+void SettingHandle<T>::reload()
+{
+	try {
+		T value;
+		read_setting(m_name, value);
+		m_value.store(value, std::memory_order_relaxed);
+	} catch (SettingNotFoundException &e) {
+		// Keep the last value if the setting was removed
+	}
+}
+
+template class SettingHandle<bool>;
+template class SettingHandle<u16>;
+template class SettingHandle<s16>;
+template class SettingHandle<u32>;
+template class SettingHandle<s32>;
+template class SettingHandle<float>;
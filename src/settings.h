@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <list>
 #include <set>
 #include <mutex>
+#include <atomic>
 
 class Settings;
 struct NoiseParams;
@@ -296,3 +297,37 @@ class Settings {
 
 	static std::unordered_map<std::string, const FlagDesc *> s_flags;
 };
+
+/*
+	Typed view of a setting in g_settings, for hot code paths.
+	The value is parsed once and cached, and parsed again when the setting
+	is changed through g_settings. Reading it takes no lock.
+	Changes to the layers below g_settings, like the game settings of a
+	server, are not seen. Create the handle once those are loaded, as a
+	member of the object that uses it.
+*/
+template <typename T>
+class SettingHandle
+{
+public:
+	SettingHandle(const std::string &name);
+	~SettingHandle();
+
+	DISABLE_CLASS_COPY(SettingHandle)
+
+	T get() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+	static void changedCallback(const std::string &name, void *data);
+	void reload();
+
+	const std::string m_name;
+	std::atomic<T> m_value;
+};
+
+extern template class SettingHandle<bool>;
+extern template class SettingHandle<u16>;
+extern template class SettingHandle<s16>;
+extern template class SettingHandle<u32>;
+extern template class SettingHandle<s32>;
+extern template class SettingHandle<float>;
@@ -18,9 +18,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "staticobject.h"
+#include <cstring>
+#include "exceptions.h"
 #include "util/serialize.h"
 #include "server/serveractiveobject.h"
 
+// type, pos and data length of a serialized static object
+static const size_t STATIC_OBJECT_HEADER_SIZE = 1 + 12 + 2;
+
 StaticObject::StaticObject(const ServerActiveObject *s_obj, const v3f &pos_):
 	type(s_obj->getType()),
 	pos(pos_)
@@ -78,7 +83,7 @@ void StaticObjectList::serialize(std::ostream &os)
 	writeU8(os, version);
 
 	// count
-	size_t count = m_stored.size() + m_active.size();
+	size_t count = getStoredSize() + m_active.size();
 	// Make sure it fits into u16, else it would get truncated and cause e.g.
 	// issue #2610 (Invalid block data in database: unsupported NameIdMapping version).
 	if (count > U16_MAX) {
@@ -90,6 +95,9 @@ void StaticObjectList::serialize(std::ostream &os)
 	}
 	writeU16(os, count);
 
+	// Still serialized the way they were read
+	os.write(m_stored_raw.data(), m_stored_raw.size());
+
 	for (StaticObject &s_obj : m_stored) {
 		s_obj.serialize(os);
 	}
@@ -106,20 +114,67 @@ void StaticObjectList::deSerialize(std::istream &is)
 		errorstream << "StaticObjectList::deSerialize(): "
 			<< "deserializing objects while " << m_active.size()
 			<< " active objects already exist (not cleared). "
-			<< m_stored.size() << " stored objects _were_ cleared"
+			<< getStoredSize() << " stored objects _were_ cleared"
 			<< std::endl;
 	}
-	m_stored.clear();
+	clearStored();
 
-	// version
-	u8 version = readU8(is);
+	// version, there is only 0
+	readU8(is);
 	// count
 	u16 count = readU16(is);
-	for(u16 i = 0; i < count; i++) {
-		StaticObject s_obj;
-		s_obj.deSerialize(is, version);
-		m_stored.push_back(s_obj);
+
+	// Only find where the objects end, they are decoded when needed
+	char header[STATIC_OBJECT_HEADER_SIZE];
+	for (u16 i = 0; i < count; i++) {
+		is.read(header, sizeof(header));
+		if (is.gcount() != sizeof(header))
+			throw SerializationError("StaticObjectList: truncated object");
+		u16 data_size = readU16((u8 *)&header[STATIC_OBJECT_HEADER_SIZE - 2]);
+
+		size_t offset = m_stored_raw.size();
+		m_stored_raw.resize(offset + sizeof(header) + data_size);
+		memcpy(&m_stored_raw[offset], header, sizeof(header));
+		is.read(&m_stored_raw[offset + sizeof(header)], data_size);
+		if (is.gcount() != data_size)
+			throw SerializationError("StaticObjectList: truncated object data");
+	}
+	m_stored_raw_count = count;
+}
+
+void StaticObjectList::decodeStored() const
+{
+	if (m_stored_raw_count == 0)
+		return;
+
+	std::vector<StaticObject> decoded;
+	decoded.reserve(m_stored_raw_count + m_stored.size());
+	std::istringstream is(m_stored_raw, std::ios_base::binary);
+	for (u16 i = 0; i < m_stored_raw_count; i++) {
+		decoded.emplace_back();
+		decoded.back().deSerialize(is, 0);
+	}
+	for (StaticObject &s_obj : m_stored)
+		decoded.push_back(std::move(s_obj));
+
+	m_stored = std::move(decoded);
+	m_stored_raw.clear();
+	m_stored_raw_count = 0;
+}
+
+std::vector<StaticObject> StaticObjectList::takeStored(size_t max)
+{
+	decodeStored();
+	if (max == 0 || max >= m_stored.size()) {
+		std::vector<StaticObject> taken;
+		taken.swap(m_stored);
+		return taken;
 	}
+
+	std::vector<StaticObject> taken(std::make_move_iterator(m_stored.begin()),
+			std::make_move_iterator(m_stored.begin() + max));
+	m_stored.erase(m_stored.begin(), m_stored.begin() + max);
+	return taken;
 }
 
 bool StaticObjectList::storeActiveObject(u16 id)
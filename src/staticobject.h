@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sstream>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include "debug.h"
 
 class ServerActiveObject;
@@ -77,33 +78,62 @@ class StaticObjectList
 	void deSerialize(std::istream &is);
 
 	// Never permit to modify outside of here. Only this object is responsible of m_stored and m_active modifications
-	const std::vector<StaticObject>& getAllStored() const { return m_stored; }
+	const std::vector<StaticObject>& getAllStored() const
+	{
+		decodeStored();
+		return m_stored;
+	}
 	const std::map<u16, StaticObject> &getAllActives() const { return m_active; }
 
 	inline void setActive(u16 id, const StaticObject &obj) { m_active[id] = obj; }
 	inline size_t getActiveSize() const { return m_active.size(); }
-	inline size_t getStoredSize() const { return m_stored.size(); }
-	inline void clearStored() { m_stored.clear(); }
+	inline size_t getStoredSize() const { return m_stored.size() + m_stored_raw_count; }
+	inline void clearStored()
+	{
+		m_stored.clear();
+		m_stored_raw.clear();
+		m_stored_raw_count = 0;
+	}
 	void pushStored(const StaticObject &obj) { m_stored.push_back(obj); }
+	// Removes and returns the first max stored objects, or all for max = 0
+	std::vector<StaticObject> takeStored(size_t max = 0);
+	// Number of stored objects that can be activated without having more
+	// than max_active active ones
+	size_t getActivatableCount(size_t max_active) const
+	{
+		if (m_active.size() >= max_active)
+			return 0;
+		return std::min(max_active - m_active.size(), getStoredSize());
+	}
 
 	bool storeActiveObject(u16 id);
 
 	inline void clear()
 	{
 		m_active.clear();
-		m_stored.clear();
+		clearStored();
 	}
 
 	inline size_t size()
 	{
-		return m_active.size() + m_stored.size();
+		return m_active.size() + getStoredSize();
 	}
 
 private:
+	void decodeStored() const;
+
 	/*
 		NOTE: When an object is transformed to active, it is removed
 		from m_stored and inserted to m_active.
 	*/
-	std::vector<StaticObject> m_stored;
+	mutable std::vector<StaticObject> m_stored;
 	std::map<u16, StaticObject> m_active;
+
+	/*
+		Stored objects of a loaded block, kept serialized until they are
+		needed. They come before m_stored. Most loaded blocks are saved
+		again or unloaded without their objects ever being activated.
+	*/
+	mutable std::string m_stored_raw;
+	mutable u16 m_stored_raw_count = 0;
 };
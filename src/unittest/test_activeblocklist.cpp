@@ -0,0 +1,195 @@
+/*
+Minetest
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "noise.h"
+#include "serverenvironment.h"
+
+class TestActiveBlockList : public TestBase
+{
+public:
+	TestActiveBlockList() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveBlockList"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testIncrementalUpdate();
+	void testForceloaded();
+	void testRetry();
+	void testViewCone();
+};
+
+static TestActiveBlockList g_test_instance;
+
+void TestActiveBlockList::runTests(IGameDef *gamedef)
+{
+	TEST(testIncrementalUpdate);
+	TEST(testForceloaded);
+	TEST(testRetry);
+	TEST(testViewCone);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// What the lists contained when they were rebuilt from scratch every update
+static std::unordered_set<v3s16> expected_blocks(
+		const std::vector<ActiveBlockList::PlayerView> &players, s16 r)
+{
+	std::unordered_set<v3s16> result;
+	for (const auto &view : players) {
+		v3s16 p;
+		for (p.X = view.blockpos.X - r; p.X <= view.blockpos.X + r; p.X++)
+		for (p.Y = view.blockpos.Y - r; p.Y <= view.blockpos.Y + r; p.Y++)
+		for (p.Z = view.blockpos.Z - r; p.Z <= view.blockpos.Z + r; p.Z++) {
+			if (p.getDistanceFrom(view.blockpos) <= r)
+				result.insert(p);
+		}
+	}
+	return result;
+}
+
+void TestActiveBlockList::testIncrementalUpdate()
+{
+	const s16 range = 2;
+	ActiveBlockList list;
+	PcgRandom pr(42);
+
+	std::vector<ActiveBlockList::PlayerView> players(4);
+	for (size_t i = 0; i < players.size(); i++)
+		players[i].id = i + 1;
+
+	std::unordered_set<v3s16> previous;
+	for (int step = 0; step < 50; step++) {
+		// Some players move, one leaves and comes back
+		for (auto &view : players) {
+			if (pr.range(0, 2) == 0)
+				view.blockpos += v3s16(pr.range(-1, 1), pr.range(-1, 1), pr.range(-1, 1));
+		}
+		std::vector<ActiveBlockList::PlayerView> present = players;
+		if (step % 10 == 5)
+			present.pop_back();
+
+		std::set<v3s16> removed, added;
+		list.update(present, range, removed, added);
+
+		std::unordered_set<v3s16> expected = expected_blocks(present, range);
+		UASSERTEQ(size_t, list.m_list.size(), expected.size());
+		UASSERT(list.m_abm_list.size() == expected.size());
+		for (v3s16 p : expected) {
+			UASSERT(list.contains(p));
+			UASSERT(list.m_abm_list.count(p) == 1);
+			UASSERT(previous.count(p) == 1 || added.count(p) == 1);
+		}
+		for (v3s16 p : previous)
+			UASSERT(expected.count(p) == 1 || removed.count(p) == 1);
+		for (v3s16 p : added)
+			UASSERT(previous.count(p) == 0);
+		for (v3s16 p : removed)
+			UASSERT(expected.count(p) == 0);
+
+		previous = std::move(expected);
+	}
+
+	// Nothing changes without movement
+	std::set<v3s16> removed, added;
+	list.update(players, range, removed, added);
+	removed.clear();
+	added.clear();
+	list.update(players, range, removed, added);
+	UASSERT(removed.empty() && added.empty());
+}
+
+void TestActiveBlockList::testForceloaded()
+{
+	ActiveBlockList list;
+	std::vector<ActiveBlockList::PlayerView> players;
+	std::set<v3s16> removed, added;
+
+	list.m_forceloaded_list.insert(v3s16(100, 0, 0));
+	list.update(players, 2, removed, added);
+	UASSERT(list.contains(v3s16(100, 0, 0)));
+	UASSERT(list.m_abm_list.count(v3s16(100, 0, 0)) == 1);
+	UASSERT(added.count(v3s16(100, 0, 0)) == 1);
+
+	list.m_forceloaded_list.clear();
+	removed.clear();
+	added.clear();
+	list.update(players, 2, removed, added);
+	UASSERT(!list.contains(v3s16(100, 0, 0)));
+	UASSERT(removed.count(v3s16(100, 0, 0)) == 1);
+}
+
+void TestActiveBlockList::testRetry()
+{
+	ActiveBlockList list;
+	std::vector<ActiveBlockList::PlayerView> players(1);
+	players[0].id = 1;
+	std::set<v3s16> removed, added;
+
+	list.update(players, 1, removed, added);
+	UASSERT(list.contains(v3s16(0, 1, 0)));
+
+	// A block that failed to load is reported as added again
+	list.remove(v3s16(0, 1, 0));
+	UASSERT(!list.contains(v3s16(0, 1, 0)));
+	removed.clear();
+	added.clear();
+	list.update(players, 1, removed, added);
+	UASSERT(list.contains(v3s16(0, 1, 0)));
+	UASSERTEQ(size_t, added.size(), 1);
+	UASSERT(removed.empty());
+}
+
+void TestActiveBlockList::testViewCone()
+{
+	ActiveBlockList list;
+	std::vector<ActiveBlockList::PlayerView> players(1);
+	players[0].id = 1;
+	players[0].cone_range = 6;
+	players[0].camera_pos = v3f(8, 8, 8) * BS;
+	players[0].camera_dir = v3f(0, 0, 1);
+	players[0].camera_fov = 1.5f;
+	std::set<v3s16> removed, added;
+
+	list.update(players, 1, removed, added);
+	// Blocks in the view cone are active, but run no ABMs
+	UASSERT(list.contains(v3s16(0, 0, 5)));
+	UASSERT(list.m_abm_list.count(v3s16(0, 0, 5)) == 0);
+	UASSERT(!list.contains(v3s16(0, 0, -5)));
+
+	// Small turns keep the cone, turning around moves it
+	players[0].camera_dir = v3f(0.01f, 0, 1).normalize();
+	removed.clear();
+	added.clear();
+	list.update(players, 1, removed, added);
+	UASSERT(removed.empty() && added.empty());
+
+	players[0].camera_dir = v3f(0, 0, -1);
+	list.update(players, 1, removed, added);
+	UASSERT(!list.contains(v3s16(0, 0, 5)));
+	UASSERT(list.contains(v3s16(0, 0, -5)));
+	UASSERT(removed.count(v3s16(0, 0, 5)) == 1);
+	UASSERT(added.count(v3s16(0, 0, -5)) == 1);
+
+	// Without the player, everything goes away
+	players.clear();
+	list.update(players, 1, removed, added);
+	UASSERTEQ(size_t, list.size(), 0);
+	UASSERTEQ(size_t, list.m_abm_list.size(), 0);
+}
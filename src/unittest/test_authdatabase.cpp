@@ -20,8 +20,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include <algorithm>
+#include <atomic>
+#include "database/database-async.h"
+#include "database/database-dummy.h"
 #include "database/database-files.h"
 #include "database/database-sqlite3.h"
+#include "exceptions.h"
 #include "util/string.h"
 #include "filesys.h"
 
@@ -85,6 +89,51 @@ class SQLite3Provider : public AuthDatabaseProvider
 	std::string dir;
 	AuthDatabase *auth_db = nullptr;
 };
+
+class SQLite3AsyncProvider : public AuthDatabaseProvider
+{
+public:
+	SQLite3AsyncProvider(const std::string &dir) : dir(dir){};
+	virtual ~SQLite3AsyncProvider() { reset(); };
+	virtual AuthDatabase *getAuthDatabase()
+	{
+		// Everything queued must be written when the thread goes away
+		reset();
+		thread = new DatabaseWriteThread(new Database_Dummy(),
+			new AuthDatabaseSQLite3(dir), 60.0f, &metrics);
+		auth_db = new AuthDatabaseAsync(thread);
+		return auth_db;
+	};
+
+private:
+	void reset()
+	{
+		delete auth_db;
+		delete thread;
+		auth_db = nullptr;
+		thread = nullptr;
+	}
+
+	std::string dir;
+	MetricsBackend metrics;
+	DatabaseWriteThread *thread = nullptr;
+	AuthDatabase *auth_db = nullptr;
+};
+
+class FailingAuthDatabase : public AuthDatabaseSQLite3
+{
+public:
+	FailingAuthDatabase(const std::string &dir) : AuthDatabaseSQLite3(dir) {}
+
+	bool saveAuth(const AuthEntry &authEntry) override
+	{
+		if (fail)
+			throw DatabaseException("Write failed on purpose");
+		return AuthDatabaseSQLite3::saveAuth(authEntry);
+	}
+
+	std::atomic<bool> fail{false};
+};
 }
 
 class TestAuthDatabase : public TestBase
@@ -105,6 +154,8 @@ class TestAuthDatabase : public TestBase
 	void testRecallChangedPrivileges();
 	void testListNames();
 	void testDelete();
+	void testAbortSave(AuthDatabase *auth_db);
+	void testWriteFailure(const std::string &dir);
 
 private:
 	AuthDatabaseProvider *auth_provider;
@@ -163,6 +214,40 @@ void TestAuthDatabase::runTests(IGameDef *gamedef)
 	runTestsForCurrentDB();
 
 	delete auth_provider;
+
+	auth_db = new AuthDatabaseSQLite3(test_dir);
+	TEST(testAbortSave, auth_db);
+	delete auth_db;
+
+	TEST(testWriteFailure, test_dir);
+
+	// reset database
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM + "auth.sqlite");
+
+	rawstream << "-------- SQLite3 database (background writes, same object)" << std::endl;
+
+	MetricsBackend metrics;
+	DatabaseWriteThread *thread = new DatabaseWriteThread(new Database_Dummy(),
+		new AuthDatabaseSQLite3(test_dir), 60.0f, &metrics);
+	auth_db = new AuthDatabaseAsync(thread);
+	auth_provider = new FixedProvider(auth_db);
+
+	runTestsForCurrentDB();
+
+	delete auth_db;
+	delete thread;
+	delete auth_provider;
+
+	// reset database
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM + "auth.sqlite");
+
+	rawstream << "-------- SQLite3 database (background writes, new objects)" << std::endl;
+
+	auth_provider = new SQLite3AsyncProvider(test_dir);
+
+	runTestsForCurrentDB();
+
+	delete auth_provider;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -294,3 +379,59 @@ void TestAuthDatabase::testDelete()
 	// second try, expect failure
 	UASSERT(!auth_db->deleteAuth("TestName"));
 }
+
+void TestAuthDatabase::testAbortSave(AuthDatabase *auth_db)
+{
+	AuthEntry authEntry;
+	authEntry.name = "AbortedName";
+	authEntry.password = "AbortedPassword";
+	authEntry.last_login = 1000;
+
+	// An aborted save is rolled back, nested saves included
+	auth_db->beginSave();
+	auth_db->beginSave();
+	UASSERT(auth_db->createAuth(authEntry));
+	auth_db->abortSave();
+	UASSERT(!auth_db->getAuth(authEntry.name, authEntry));
+
+	// and the next save starts a transaction of its own
+	{
+		DatabaseSaveGuard<AuthDatabase> save(auth_db);
+		UASSERT(auth_db->createAuth(authEntry));
+		save.commit();
+	}
+	UASSERT(auth_db->getAuth(authEntry.name, authEntry));
+	UASSERT(auth_db->deleteAuth(authEntry.name));
+}
+
+void TestAuthDatabase::testWriteFailure(const std::string &dir)
+{
+	MetricsBackend metrics;
+	FailingAuthDatabase *failing_db = new FailingAuthDatabase(dir);
+	DatabaseWriteThread thread(new Database_Dummy(), failing_db, 60.0f, &metrics);
+	AuthDatabaseAsync auth_db(&thread);
+
+	AuthEntry authEntry;
+	authEntry.name = "FailedName";
+	authEntry.password = "OldPassword";
+	authEntry.last_login = 1000;
+	UASSERT(auth_db.createAuth(authEntry));
+
+	// A failed write is reported, and the change is still seen
+	failing_db->fail = true;
+	authEntry.password = "NewPassword";
+	UASSERT(auth_db.saveAuth(authEntry));
+	thread.flush();
+	EXCEPTION_CHECK(DatabaseException, thread.checkError());
+	thread.checkError();
+	UASSERT(auth_db.getAuth(authEntry.name, authEntry));
+	UASSERTEQ(std::string, authEntry.password, "NewPassword");
+
+	// and written with the next ones
+	failing_db->fail = false;
+	thread.flush();
+	thread.checkError();
+	UASSERT(failing_db->getAuth(authEntry.name, authEntry));
+	UASSERTEQ(std::string, authEntry.password, "NewPassword");
+	UASSERT(auth_db.deleteAuth(authEntry.name));
+}
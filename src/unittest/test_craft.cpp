@@ -34,6 +34,7 @@ class TestCraft : public TestBase
 			const std::vector<std::string> &groups, IGameDef *gamedef);
 
 	void testShapeless(IGameDef *gamedef);
+	void testGroupIndex(IGameDef *gamedef);
 };
 
 static TestCraft g_test_instance;
@@ -41,6 +42,7 @@ static TestCraft g_test_instance;
 void TestCraft::runTests(IGameDef *gamedef)
 {
 	TEST(testShapeless, gamedef);
+	TEST(testGroupIndex, gamedef);
 }
 
 std::string TestCraft::getDumpedCraftResult(CraftInput input, IGameDef *gamedef)
@@ -273,3 +275,66 @@ void TestCraft::testShapeless(IGameDef *gamedef)
 			}), gamedef),
 			"(item=\"crafttest:i4\", time=0)");
 }
+
+void TestCraft::testGroupIndex(IGameDef *gamedef)
+{
+	IWritableItemDefManager *idef = (IWritableItemDefManager *)gamedef->getItemDefManager();
+	IWritableCraftDefManager *cdef = (IWritableCraftDefManager *)gamedef->getCraftDefManager();
+
+	auto to_item = [&](const std::string &itemstring) -> ItemStack {
+		ItemStack item;
+		item.deSerialize(itemstring, idef);
+		return item;
+	};
+
+	cdef->clear();
+
+	registerItemWithGroups("crafttest:planks", {"crafttest_wood"}, gamedef);
+	registerItemWithGroups("crafttest:pine", {"crafttest_wood", "crafttest_flammable"}, gamedef);
+	registerItemWithGroups("crafttest:stick", {"crafttest_flammable"}, gamedef);
+	registerItemWithGroups("crafttest:o1", {}, gamedef);
+	registerItemWithGroups("crafttest:o2", {}, gamedef);
+	registerItemWithGroups("crafttest:o3", {}, gamedef);
+
+	cdef->registerCraft(new CraftDefinitionShapeless("crafttest:o1",
+			{"group:crafttest_wood", "group:crafttest_wood"},
+			CraftReplacements{}), gamedef);
+	cdef->registerCraft(new CraftDefinitionShapeless("crafttest:o2",
+			{"group:crafttest_flammable", "crafttest:planks"},
+			CraftReplacements{}), gamedef);
+	// Registered later, so it wins over the first one
+	cdef->registerCraft(new CraftDefinitionShapeless("crafttest:o3",
+			{"group:crafttest_wood,crafttest_flammable", "group:crafttest_wood"},
+			CraftReplacements{}), gamedef);
+
+	cdef->initHashes(gamedef);
+
+	UASSERTEQ(std::string, getDumpedCraftResult(CraftInput(CRAFT_METHOD_NORMAL, 3,
+			{
+				to_item("crafttest:planks"),
+				to_item("crafttest:planks"),
+			}), gamedef),
+			"(item=\"crafttest:o1\", time=0)");
+
+	UASSERTEQ(std::string, getDumpedCraftResult(CraftInput(CRAFT_METHOD_NORMAL, 3,
+			{
+				to_item("crafttest:planks"),
+				to_item("crafttest:pine"),
+			}), gamedef),
+			"(item=\"crafttest:o3\", time=0)");
+
+	UASSERTEQ(std::string, getDumpedCraftResult(CraftInput(CRAFT_METHOD_NORMAL, 3,
+			{
+				to_item("crafttest:stick"),
+				to_item("crafttest:planks"),
+			}), gamedef),
+			"(item=\"crafttest:o2\", time=0)");
+
+	// No recipe uses only flammable items
+	UASSERTEQ(std::string, getDumpedCraftResult(CraftInput(CRAFT_METHOD_NORMAL, 3,
+			{
+				to_item("crafttest:stick"),
+				to_item("crafttest:stick"),
+			}), gamedef),
+			"(item=\"\", time=0)");
+}
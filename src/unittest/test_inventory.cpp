@@ -32,6 +32,9 @@ class TestInventory : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testSerializeDeserialize(IItemDefManager *idef);
+	void testIncrementalSlots(IItemDefManager *idef);
+	void testItemName(IItemDefManager *idef);
+	void testMetadataCopyOnWrite(IItemDefManager *idef);
 
 	static const char *serialized_inventory_in;
 	static const char *serialized_inventory_out;
@@ -43,6 +46,9 @@ static TestInventory g_test_instance;
 void TestInventory::runTests(IGameDef *gamedef)
 {
 	TEST(testSerializeDeserialize, gamedef->getItemDefManager());
+	TEST(testIncrementalSlots, gamedef->getItemDefManager());
+	TEST(testItemName, gamedef->getItemDefManager());
+	TEST(testMetadataCopyOnWrite, gamedef->getItemDefManager());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -80,6 +86,105 @@ void TestInventory::testSerializeDeserialize(IItemDefManager *idef)
 	UASSERT(leftover == wanted);
 }
 
+void TestInventory::testIncrementalSlots(IItemDefManager *idef)
+{
+	Inventory server_inv(idef);
+	std::istringstream is(serialized_inventory_in, std::ios::binary);
+	server_inv.deSerialize(is);
+
+	// The client starts out in sync
+	Inventory client_inv(idef);
+	client_inv = server_inv;
+	server_inv.setModified(false);
+
+	InventoryList *list = server_inv.getList("0");
+	ItemStack item = list->changeItem(2, ItemStack());
+	list->changeItem(1, item);
+	UASSERT(list->checkSlotModified(1) && list->checkSlotModified(2));
+	UASSERT(!list->checkSlotModified(0));
+
+	std::ostringstream os(std::ios::binary);
+	server_inv.serialize(os, true);
+
+	// Only the two changed slots are sent
+	std::istringstream lines(os.str(), std::ios::binary);
+	std::string line;
+	u32 kept = 0;
+	while (std::getline(lines, line))
+		kept += line == "Keep";
+	UASSERTEQ(u32, kept, list->getSize() - 2);
+
+	std::istringstream delta(os.str(), std::ios::binary);
+	client_inv.deSerialize(delta);
+	UASSERT(client_inv == server_inv);
+
+	// Changing the list as a whole sends everything again
+	server_inv.setModified(false);
+	list->setWidth(4);
+	UASSERT(list->checkSlotModified(0));
+}
+
+void TestInventory::testItemName(IItemDefManager *idef)
+{
+	ItemName stone("default:stone");
+	UASSERT(stone == ItemName(std::string("default:stone")));
+	UASSERT(stone != ItemName("default:dirt"));
+	UASSERT(stone == "default:stone");
+	UASSERTEQ(std::string, stone.str(), "default:stone");
+	UASSERT(!stone.empty() && stone.getId() != 0);
+	UASSERT(ItemName().empty() && ItemName("") == ItemName());
+	UASSERTEQ(u32, ItemName().getId(), 0);
+
+	UASSERT(idef->isKnownById(stone.getId()));
+	UASSERT(&idef->getById(stone.getId()) == &idef->get("default:stone"));
+	UASSERT(&idef->getById(0) == &idef->get(""));
+
+	// Unknown names are not interned, but compare and look up the same
+	ItemName unknown("test_inventory:unknown");
+	UASSERT(!unknown.isInterned() && !unknown.empty());
+	UASSERT(unknown == ItemName("test_inventory:unknown"));
+	UASSERT(unknown != stone && unknown == "test_inventory:unknown");
+	UASSERTEQ(std::string, ItemStack("test_inventory:unknown", 1, 0, idef)
+			.getDefinition(idef).name, "unknown");
+
+	// A name registered later still equals the copies made before
+	ItemName before("test_inventory:late");
+	UASSERT(!before.isInterned());
+	ItemName late = ItemName::registered("test_inventory:late");
+	UASSERT(late.isInterned() && ItemName("test_inventory:late").isInterned());
+	UASSERT(late == before && before == late);
+	UASSERT(unknown != late);
+
+	// Stacks created before their item is registered, e.g. by mods at load time
+	ItemStack early("test_inventory:registered_later", 1, 0, idef);
+	UASSERT(!early.isKnown(idef));
+	ItemDefinition def;
+	def.name = "test_inventory:registered_later";
+	((IWritableItemDefManager *)idef)->registerItem(def);
+	UASSERT(!early.name.isInterned());
+	UASSERT(early.isKnown(idef));
+	UASSERTEQ(std::string, early.getDefinition(idef).name,
+			"test_inventory:registered_later");
+}
+
+void TestInventory::testMetadataCopyOnWrite(IItemDefManager *idef)
+{
+	ItemStack item("default:stone", 1, 0, idef);
+	item.metadata.setString("key", "value");
+
+	ItemStack copy = item;
+	UASSERT(copy == item);
+	copy.metadata.setString("key", "other");
+	UASSERTEQ(std::string, item.metadata.getString("key"), "value");
+	UASSERTEQ(std::string, copy.metadata.getString("key"), "other");
+	UASSERT(copy != item);
+
+	copy = item;
+	item.metadata.clear();
+	UASSERT(item.metadata.empty());
+	UASSERTEQ(std::string, copy.metadata.getString("key"), "value");
+}
+
 const char *TestInventory::serialized_inventory_in =
 	"List 0 10\n"
 	"Width 3\n"
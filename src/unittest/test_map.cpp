@@ -19,10 +19,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include <cstdio>
+#include <sstream>
 #include <unordered_set>
 #include <unordered_map>
+#include "activeobject.h"
 #include "mapblock.h"
 #include "dummymap.h"
+#include "serialization.h"
+#include "staticobject.h"
+#include "voxel.h"
 
 class TestMap : public TestBase
 {
@@ -36,6 +41,10 @@ class TestMap : public TestBase
 	void testForEachNodeInArea(IGameDef *gamedef);
 	void testForEachNodeInAreaBlank(IGameDef *gamedef);
 	void testForEachNodeInAreaEmpty(IGameDef *gamedef);
+	void testStaticObjectList();
+	void testStaticObjectActivationLimit();
+	void testNodeStorage(IGameDef *gamedef);
+	void testTimerUpdate(IGameDef *gamedef);
 };
 
 static TestMap g_test_instance;
@@ -46,6 +55,10 @@ void TestMap::runTests(IGameDef *gamedef)
 	TEST(testForEachNodeInArea, gamedef);
 	TEST(testForEachNodeInAreaBlank, gamedef);
 	TEST(testForEachNodeInAreaEmpty, gamedef);
+	TEST(testStaticObjectList);
+	TEST(testStaticObjectActivationLimit);
+	TEST(testNodeStorage, gamedef);
+	TEST(testTimerUpdate, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -169,3 +182,183 @@ void TestMap::testForEachNodeInAreaEmpty(IGameDef *gamedef)
 		return true;
 	});
 }
+
+void TestMap::testStaticObjectList()
+{
+	StaticObjectList list;
+	for (int i = 0; i < 5; i++) {
+		StaticObject s_obj;
+		s_obj.type = ACTIVEOBJECT_TYPE_LUAENTITY;
+		s_obj.pos = v3f(i * BS, 0, 0);
+		s_obj.data = "object " + std::to_string(i);
+		list.pushStored(s_obj);
+	}
+	std::ostringstream os(std::ios::binary);
+	list.serialize(os);
+	const std::string serialized = os.str();
+
+	// Loaded objects are counted and saved again without decoding them
+	StaticObjectList list2;
+	std::istringstream is(serialized, std::ios::binary);
+	list2.deSerialize(is);
+	UASSERTEQ(size_t, list2.getStoredSize(), 5);
+	std::ostringstream os2(std::ios::binary);
+	list2.serialize(os2);
+	UASSERT(os2.str() == serialized);
+
+	// Loaded objects come before the ones added later
+	StaticObject added;
+	added.data = "added";
+	list2.pushStored(added);
+	UASSERTEQ(size_t, list2.getStoredSize(), 6);
+	std::vector<StaticObject> taken = list2.takeStored(2);
+	UASSERTEQ(size_t, taken.size(), 2);
+	UASSERT(taken[0].data == "object 0");
+	UASSERT(taken[1].data == "object 1");
+	UASSERT(taken[1].pos == v3f(BS, 0, 0));
+	UASSERTEQ(size_t, list2.getStoredSize(), 4);
+	UASSERT(list2.getAllStored().back().data == "added");
+
+	taken = list2.takeStored();
+	UASSERTEQ(size_t, taken.size(), 4);
+	UASSERTEQ(size_t, list2.getStoredSize(), 0);
+
+	// Truncated data is an error
+	StaticObjectList list3;
+	std::istringstream is3(serialized.substr(0, serialized.size() - 1), std::ios::binary);
+	EXCEPTION_CHECK(SerializationError, list3.deSerialize(is3));
+}
+
+void TestMap::testStaticObjectActivationLimit()
+{
+	StaticObjectList list;
+	for (u16 i = 0; i < 5; i++) {
+		StaticObject s_obj;
+		s_obj.data = "object " + std::to_string(i);
+		// Two were activated before, e.g. added while the rest was pending
+		list.insert(i < 2 ? i + 1 : 0, s_obj);
+	}
+	UASSERTEQ(size_t, list.getActiveSize(), 2);
+	UASSERTEQ(size_t, list.getStoredSize(), 3);
+
+	UASSERTEQ(size_t, list.getActivatableCount(10), 3);
+	UASSERTEQ(size_t, list.getActivatableCount(4), 2);
+	UASSERTEQ(size_t, list.getActivatableCount(2), 0);
+	UASSERTEQ(size_t, list.getActivatableCount(1), 0);
+
+	// The ones over the limit stay stored
+	std::vector<StaticObject> taken = list.takeStored(list.getActivatableCount(4));
+	UASSERTEQ(size_t, taken.size(), 2);
+	UASSERTEQ(size_t, list.getStoredSize(), 1);
+	UASSERT(list.getAllStored()[0].data == "object 4");
+}
+
+void TestMap::testNodeStorage(IGameDef *gamedef)
+{
+	MapBlock block(v3s16(0, 0, 0), gamedef);
+	auto serialized = [&] () {
+		std::ostringstream os(std::ios::binary);
+		block.serialize(os, SER_FMT_VER_HIGHEST_WRITE, true, -1);
+		return os.str();
+	};
+
+	// All the same
+	MapNode air(CONTENT_AIR, 15, 0);
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		block.getData()[i] = air;
+	std::string expected = serialized();
+	block.compactNodes();
+	UASSERT(block.getNodeStorage() == MapBlock::NODE_STORAGE_UNIFORM);
+	UASSERTEQ(size_t, block.getNodeMemoryUsage(), sizeof(MapNode));
+	UASSERT(block.getNodeNoCheck(3, 4, 5) == air);
+	UASSERT(serialized() == expected);
+
+	// Writing expands and changes the node version
+	MapNode stone(t_CONTENT_STONE, 0, 3);
+	const u64 node_version = block.getNodeVersion();
+	block.setNodeNoCheck(3, 4, 5, stone);
+	UASSERT(block.getNodeStorage() == MapBlock::NODE_STORAGE_FULL);
+	UASSERT(block.getNodeVersion() != node_version);
+	UASSERT(block.getNodeNoCheck(3, 4, 5) == stone);
+	UASSERT(block.getNodeNoCheck(0, 0, 0) == air);
+
+	// A few different nodes
+	for (s16 y = 0; y < 4; y++)
+		block.setNodeNoCheck(7, y, 2, MapNode(t_CONTENT_STONE, y, 0));
+	expected = serialized();
+	block.compactNodes();
+	UASSERT(block.getNodeStorage() == MapBlock::NODE_STORAGE_PALETTE);
+	UASSERT(block.getNodeMemoryUsage() < MapBlock::nodecount * sizeof(MapNode));
+	UASSERT(block.getNodeNoCheck(3, 4, 5) == stone);
+	UASSERT(block.getNodeNoCheck(7, 2, 2) == MapNode(t_CONTENT_STONE, 2, 0));
+	UASSERT(block.getNodeNoCheck(15, 15, 15) == air);
+	UASSERT(serialized() == expected);
+	// Saving keeps the block compact
+	UASSERT(block.getNodeStorage() == MapBlock::NODE_STORAGE_PALETTE);
+
+	// Loading into a compacted block
+	MapBlock loaded(v3s16(0, 0, 0), gamedef);
+	loaded.compactNodes();
+	UASSERT(loaded.getNodeStorage() == MapBlock::NODE_STORAGE_UNIFORM);
+	{
+		std::istringstream is(expected, std::ios::binary);
+		loaded.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE, true);
+	}
+	UASSERT(loaded.getNodeStorage() == MapBlock::NODE_STORAGE_FULL);
+	UASSERT(loaded.getNodeNoCheck(3, 4, 5) == stone);
+	// Another block at the same position never has the same version
+	UASSERT(loaded.getNodeVersion() != block.getNodeVersion());
+	UASSERT(loaded.getNodeNoCheck(15, 15, 15) == air);
+
+	// Writing back from a voxel manipulator changes the node version by itself
+	VoxelManipulator vm;
+	vm.addArea(VoxelArea(block.getPosRelative(),
+			block.getPosRelative() + (MAP_BLOCKSIZE - 1)));
+	block.copyTo(vm);
+	const u64 vm_node_version = block.getNodeVersion();
+	block.copyFrom(vm);
+	UASSERT(block.getNodeVersion() != vm_node_version);
+	UASSERT(block.getNodeNoCheck(3, 4, 5) == stone);
+
+	MapNode *data = block.getData();
+	UASSERT(block.getNodeStorage() == MapBlock::NODE_STORAGE_FULL);
+	UASSERT(data[5 * MapBlock::zstride + 4 * MapBlock::ystride + 3] == stone);
+
+	// Too many different nodes stay as they are
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		data[i] = MapNode(t_CONTENT_STONE, i % 16, (i / 16) % 32);
+	block.compactNodes();
+	UASSERT(block.getNodeStorage() == MapBlock::NODE_STORAGE_FULL);
+}
+
+void TestMap::testTimerUpdate(IGameDef *gamedef)
+{
+	DummyMap map(gamedef, v3s16(0, 0, 0), v3s16(3, 1, 3));
+	MapBlock *kept = map.getBlockNoCreateNoEx(v3s16(1, 0, 1));
+	UASSERT(kept);
+	kept->refGrab();
+
+	auto sweep = [&] (float dtime, std::vector<v3s16> &unloaded) {
+		map.timerUpdate(dtime, 5.0f, -1, &unloaded);
+		while (map.isSweepInProgress())
+			map.timerUpdate(0.0f, 5.0f, -1, &unloaded);
+	};
+
+	std::vector<v3s16> unloaded;
+	sweep(10.0f, unloaded);
+	UASSERTEQ(size_t, unloaded.size(), 4 * 2 * 4 - 1);
+	UASSERT(!map.getBlockNoCreateNoEx(v3s16(0, 0, 0)));
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(1, 0, 1)) == kept);
+	UASSERT(kept->getUsageTimer() == 10.0f);
+
+	// Time passes for the blocks kept
+	unloaded.clear();
+	sweep(2.0f, unloaded);
+	UASSERT(unloaded.empty());
+	UASSERT(kept->getUsageTimer() == 12.0f);
+
+	kept->refDrop();
+	sweep(0.0f, unloaded);
+	UASSERTEQ(size_t, unloaded.size(), 1);
+	UASSERT(unloaded[0] == v3s16(1, 0, 1));
+}
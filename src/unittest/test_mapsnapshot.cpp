@@ -0,0 +1,195 @@
+/*
+Minetest
+Copyright (C) 2023 Minetest Authors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "database/database-snapshot.h"
+#include "filesys.h"
+
+class TestMapSnapshot : public TestBase
+{
+public:
+	TestMapSnapshot() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapSnapshot"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testEmpty();
+	void testRoundTrip();
+	void testChanges();
+	void testReopen();
+	void testRewriteIndex();
+
+private:
+	// Block data as a reader sees it, empty if the block is missing
+	static std::string readBlock(const MapSnapshotReader &reader, v3s16 pos);
+
+	std::string m_dir;
+};
+
+static TestMapSnapshot g_test_instance;
+
+void TestMapSnapshot::runTests(IGameDef *gamedef)
+{
+	m_dir = getTestTempDirectory();
+
+	TEST(testEmpty);
+	TEST(testRoundTrip);
+	TEST(testChanges);
+	TEST(testReopen);
+	TEST(testRewriteIndex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string TestMapSnapshot::readBlock(const MapSnapshotReader &reader, v3s16 pos)
+{
+	const char *data;
+	size_t size;
+	if (!reader.getBlock(pos, &data, &size))
+		return "";
+	return std::string(data, size);
+}
+
+void TestMapSnapshot::testEmpty()
+{
+	std::string dir = m_dir + DIR_DELIM "empty";
+	fs::CreateAllDirs(dir);
+
+	MapSnapshotReader missing(dir);
+	UASSERT(!missing.isOpen());
+
+	MapDatabaseSnapshot db(dir);
+	MapSnapshotReader reader(dir);
+	UASSERT(reader.isOpen());
+	UASSERTEQ(u32, reader.getBlockCount(), 0);
+	UASSERT(readBlock(reader, v3s16(0, 0, 0)).empty());
+}
+
+void TestMapSnapshot::testRoundTrip()
+{
+	MapDatabaseSnapshot db(m_dir);
+	db.clear();
+	db.beginSave();
+	UASSERT(db.saveBlock(v3s16(0, 0, 0), "origin"));
+	UASSERT(db.saveBlock(v3s16(-1, 2, -3), "negative"));
+	UASSERT(db.saveBlock(v3s16(100, -200, 300), "far"));
+	db.endSave();
+
+	MapSnapshotReader reader(m_dir);
+	UASSERT(reader.isOpen());
+	UASSERTEQ(u32, reader.getBlockCount(), 3);
+	UASSERTEQ(std::string, readBlock(reader, v3s16(0, 0, 0)), "origin");
+	UASSERTEQ(std::string, readBlock(reader, v3s16(-1, 2, -3)), "negative");
+	UASSERTEQ(std::string, readBlock(reader, v3s16(100, -200, 300)), "far");
+	UASSERT(readBlock(reader, v3s16(1, 0, 0)).empty());
+
+	u32 count = 0;
+	reader.forEachBlock([&] (const v3s16 &pos, const char *data, size_t size) {
+		UASSERTEQ(std::string, std::string(data, size), readBlock(reader, pos));
+		count++;
+	});
+	UASSERTEQ(u32, count, 3);
+
+	std::string block;
+	db.loadBlock(v3s16(-1, 2, -3), &block);
+	UASSERTEQ(std::string, block, "negative");
+}
+
+void TestMapSnapshot::testChanges()
+{
+	MapDatabaseSnapshot db(m_dir);
+	MapSnapshotReader before(m_dir);
+
+	// The first save after opening writes a new index
+	db.saveBlock(v3s16(0, 0, 0), "changed origin");
+	db.saveBlock(v3s16(5, 5, 5), "new");
+	db.endSave();
+	// The next ones only append to the log
+	db.deleteBlock(v3s16(-1, 2, -3));
+	db.saveBlock(v3s16(5, 5, 5), "newer");
+	db.endSave();
+
+	MapSnapshotReader reader(m_dir);
+	UASSERT(reader.isOpen());
+	UASSERTEQ(u32, reader.getBlockCount(), 3);
+	UASSERTEQ(std::string, readBlock(reader, v3s16(0, 0, 0)), "changed origin");
+	UASSERT(readBlock(reader, v3s16(-1, 2, -3)).empty());
+	UASSERTEQ(std::string, readBlock(reader, v3s16(5, 5, 5)), "newer");
+	UASSERTEQ(std::string, readBlock(reader, v3s16(100, -200, 300)), "far");
+
+	u32 count = 0;
+	reader.forEachBlock([&] (const v3s16 &pos, const char *data, size_t size) {
+		UASSERTEQ(std::string, std::string(data, size), readBlock(reader, pos));
+		count++;
+	});
+	UASSERTEQ(u32, count, 3);
+
+	// An earlier reader keeps its view
+	UASSERTEQ(std::string, readBlock(before, v3s16(0, 0, 0)), "origin");
+	UASSERTEQ(std::string, readBlock(before, v3s16(-1, 2, -3)), "negative");
+}
+
+void TestMapSnapshot::testReopen()
+{
+	MapDatabaseSnapshot db(m_dir);
+
+	std::vector<v3s16> blocks;
+	db.listAllLoadableBlocks(blocks);
+	UASSERTEQ(size_t, blocks.size(), 3);
+
+	std::string block;
+	db.loadBlock(v3s16(0, 0, 0), &block);
+	UASSERTEQ(std::string, block, "changed origin");
+	db.loadBlock(v3s16(-1, 2, -3), &block);
+	UASSERT(block.empty());
+
+	// Saving after reopening starts over with a new index
+	db.saveBlock(v3s16(6, 6, 6), "after reopen");
+	db.endSave();
+
+	MapSnapshotReader reader(m_dir);
+	UASSERTEQ(u32, reader.getBlockCount(), 4);
+	UASSERTEQ(std::string, readBlock(reader, v3s16(0, 0, 0)), "changed origin");
+	UASSERTEQ(std::string, readBlock(reader, v3s16(6, 6, 6)), "after reopen");
+}
+
+void TestMapSnapshot::testRewriteIndex()
+{
+	MapDatabaseSnapshot db(m_dir);
+	db.clear();
+
+	// Enough changes to make the log too long
+	const s16 n = 40;
+	for (s16 i = 0; i < n; i++) {
+		for (s16 j = 0; j < n; j++)
+			db.saveBlock(v3s16(i, j, 0), std::to_string(i * n + j));
+		db.endSave();
+	}
+	db.deleteBlock(v3s16(0, 0, 0));
+	db.endSave();
+
+	MapSnapshotReader reader(m_dir);
+	UASSERT(reader.isOpen());
+	UASSERTEQ(u32, reader.getBlockCount(), n * n - 1);
+	UASSERT(readBlock(reader, v3s16(0, 0, 0)).empty());
+	UASSERTEQ(std::string, readBlock(reader, v3s16(0, 1, 0)), "1");
+	UASSERTEQ(std::string, readBlock(reader, v3s16(n - 1, n - 1, 0)),
+			std::to_string(n * n - 1));
+}
@@ -25,13 +25,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include "database/database-async.h"
 #include "database/database-dummy.h"
 #include "database/database-files.h"
 #include "database/database-sqlite3.h"
 #if USE_POSTGRESQL
 #include "database/database-postgresql.h"
 #endif
+#include "exceptions.h"
 #include "filesys.h"
 
 namespace
@@ -117,6 +120,49 @@ class SQLite3Provider : public ModStorageDatabaseProvider
 	ModStorageDatabase *m_db = nullptr;
 };
 
+class SQLite3AsyncProvider : public ModStorageDatabaseProvider
+{
+public:
+	SQLite3AsyncProvider(const std::string &dir): m_dir(dir) {}
+
+	~SQLite3AsyncProvider()
+	{
+		if (m_db)
+			m_db->endSave();
+		delete m_db;
+	}
+
+	ModStorageDatabase *getModStorageDatabase() override
+	{
+		if (m_db)
+			m_db->endSave();
+		delete m_db;
+		m_db = new ModStorageDatabaseAsync(new ModStorageDatabaseSQLite3(m_dir), &m_metrics);
+		m_db->beginSave();
+		return m_db;
+	}
+
+private:
+	std::string m_dir;
+	MetricsBackend m_metrics;
+	ModStorageDatabase *m_db = nullptr;
+};
+
+// Dummy database whose writes can be made to fail
+class FailingDatabase : public Database_Dummy
+{
+public:
+	bool setModEntry(const std::string &modname,
+			const std::string &key, const std::string &value) override
+	{
+		if (fail)
+			throw DatabaseException("Write failed on purpose");
+		return Database_Dummy::setModEntry(modname, key, value);
+	}
+
+	std::atomic<bool> fail{false};
+};
+
 #if USE_POSTGRESQL
 void clearPostgreSQLDatabase(const std::string &connect_string)
 {
@@ -174,6 +220,7 @@ class TestModStorageDatabase : public TestBase
 	void testRecallChanged();
 	void testListMods();
 	void testRemove();
+	void testWriteFailure();
 
 private:
 	ModStorageDatabaseProvider *mod_storage_provider;
@@ -246,6 +293,34 @@ void TestModStorageDatabase::runTests(IGameDef *gamedef)
 
 	delete mod_storage_provider;
 
+	// reset database
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM + "mod_storage.sqlite");
+
+	rawstream << "-------- SQLite3 database written behind (same object)" << std::endl;
+
+	MetricsBackend metrics;
+	mod_storage_db = new ModStorageDatabaseAsync(
+		new ModStorageDatabaseSQLite3(test_dir), &metrics);
+	mod_storage_provider = new FixedProvider(mod_storage_db);
+
+	runTestsForCurrentDB();
+
+	delete mod_storage_db;
+	delete mod_storage_provider;
+
+	// reset database
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM + "mod_storage.sqlite");
+
+	rawstream << "-------- SQLite3 database written behind (new objects)" << std::endl;
+
+	mod_storage_provider = new SQLite3AsyncProvider(test_dir);
+
+	runTestsForCurrentDB();
+
+	delete mod_storage_provider;
+
+	TEST(testWriteFailure);
+
 #if USE_POSTGRESQL
 	const char *env_postgresql_connect_string = getenv("MINETEST_POSTGRESQL_CONNECT_STRING");
 	if (env_postgresql_connect_string) {
@@ -363,3 +438,30 @@ void TestModStorageDatabase::testRemove()
 	UASSERT(!mod_storage_db->removeModEntries("mod1"));
 	UASSERT(mod_storage_db->removeModEntries("mod2"));
 }
+
+void TestModStorageDatabase::testWriteFailure()
+{
+	MetricsBackend metrics;
+	FailingDatabase *failing_db = new FailingDatabase();
+	ModStorageDatabaseAsync mod_storage_db(failing_db, &metrics);
+	std::string value;
+
+	// A failed write is reported
+	failing_db->fail = true;
+	mod_storage_db.setModEntry("mod1", "key1", "value1");
+	mod_storage_db.endSave();
+	mod_storage_db.flush();
+	EXCEPTION_CHECK(DatabaseException, mod_storage_db.checkError());
+	mod_storage_db.checkError();
+
+	// and its changes are written with the next ones, under newer changes
+	failing_db->fail = false;
+	mod_storage_db.setModEntry("mod1", "key2", "value2");
+	mod_storage_db.endSave();
+	mod_storage_db.flush();
+	mod_storage_db.checkError();
+	UASSERT(failing_db->getModEntry("mod1", "key1", &value));
+	UASSERTEQ(std::string, value, "value1");
+	UASSERT(failing_db->getModEntry("mod1", "key2", &value));
+	UASSERTEQ(std::string, value, "value2");
+}
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "test.h"
 
+#include <memory>
 #include <sstream>
 
 #include "gamedef.h"
@@ -34,6 +35,7 @@ class TestNodeDef : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testContentFeaturesSerialization();
+	void testHotProperties();
 };
 
 static TestNodeDef g_test_instance;
@@ -41,6 +43,7 @@ static TestNodeDef g_test_instance;
 void TestNodeDef::runTests(IGameDef *gamedef)
 {
 	TEST(testContentFeaturesSerialization);
+	TEST(testHotProperties);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -65,3 +68,38 @@ void TestNodeDef::testContentFeaturesSerialization()
 	UASSERT(f.walkable == f2.walkable);
 	UASSERT(f.node_box.type == f2.node_box.type);
 }
+
+void TestNodeDef::testHotProperties()
+{
+	std::unique_ptr<NodeDefManager> ndef(createNodeDefManager());
+
+	ContentFeatures f;
+	f.name = "default:water_source";
+	f.drawtype = NDT_LIQUID;
+	f.liquid_type = LIQUID_SOURCE;
+	f.walkable = false;
+	f.groups["float"] = 1;
+	content_t id = ndef->set(f.name, f);
+
+	ContentHotProperties props = ndef->getHotProperties(id);
+	UASSERT(props.getDrawType() == NDT_LIQUID);
+	UASSERT(props.getLiquidType() == LIQUID_SOURCE);
+	UASSERT(!props.walkable);
+	UASSERT(props.floats);
+
+	// The cache must survive the trip to the client
+	std::ostringstream os(std::ios::binary);
+	ndef->serialize(os, LATEST_PROTOCOL_VERSION);
+	std::istringstream is(os.str(), std::ios::binary);
+	std::unique_ptr<NodeDefManager> ndef2(createNodeDefManager());
+	ndef2->deSerialize(is, LATEST_PROTOCOL_VERSION);
+
+	props = ndef2->getHotProperties(id);
+	UASSERT(props.getLiquidType() == LIQUID_SOURCE);
+	UASSERT(props.floats);
+
+	// Unregistered content behaves like CONTENT_UNKNOWN
+	props = ndef2->getHotProperties(CONTENT_MAX);
+	UASSERT(props.walkable == ndef2->get(CONTENT_MAX).walkable);
+	UASSERT(props.getDrawType() == ndef2->get(CONTENT_MAX).drawtype);
+}
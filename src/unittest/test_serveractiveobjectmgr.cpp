@@ -40,6 +40,8 @@ class TestServerActiveObjectMgr : public TestBase
 	void testRemoveObject();
 	void testGetObjectsInsideRadius();
 	void testGetAddedActiveObjectsAroundPos();
+	void testSortBySendPriority();
+	void testSpatialIndex();
 };
 
 static TestServerActiveObjectMgr g_test_instance;
@@ -51,6 +53,8 @@ void TestServerActiveObjectMgr::runTests(IGameDef *gamedef)
 	TEST(testRemoveObject)
 	TEST(testGetObjectsInsideRadius);
 	TEST(testGetAddedActiveObjectsAroundPos);
+	TEST(testSortBySendPriority);
+	TEST(testSpatialIndex);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -185,3 +189,71 @@ void TestServerActiveObjectMgr::testGetAddedActiveObjectsAroundPos()
 
 	saomgr.clear();
 }
+
+void TestServerActiveObjectMgr::testSortBySendPriority()
+{
+	server::ActiveObjectMgr saomgr;
+	auto register_at = [&] (const v3f &p) {
+		auto sao_u = std::make_unique<MockServerActiveObject>(nullptr, p);
+		auto sao = sao_u.get();
+		saomgr.registerObject(std::move(sao_u));
+		return sao->getId();
+	};
+
+	u16 far_ahead = register_at(v3f(0, 0, 30));
+	u16 behind = register_at(v3f(0, 0, -8));
+	u16 ahead = register_at(v3f(0, 0, 10));
+
+	// Behind counts twice as far away, the unknown id is dropped
+	std::vector<u16> ids = {far_ahead, 999, behind, ahead};
+	saomgr.sortBySendPriority(v3f(), v3f(0, 0, 1), ids);
+	UASSERTEQ(size_t, ids.size(), 3);
+	UASSERTEQ(u16, ids[0], ahead);
+	UASSERTEQ(u16, ids[1], behind);
+	UASSERTEQ(u16, ids[2], far_ahead);
+
+	saomgr.clear();
+}
+
+void TestServerActiveObjectMgr::testSpatialIndex()
+{
+	server::ActiveObjectMgr saomgr;
+
+	// Enough objects for the queries below to use the spatial index
+	std::vector<ServerActiveObject *> saos;
+	for (int i = 0; i < 100; i++) {
+		auto sao_u = std::make_unique<MockServerActiveObject>(nullptr,
+				v3f(i * 100, 0, -i * 50));
+		saos.push_back(sao_u.get());
+		saomgr.registerObject(std::move(sao_u));
+	}
+
+	std::vector<ServerActiveObject *> result;
+	saomgr.getObjectsInsideRadius(v3f(0, 0, 0), 120, result, nullptr);
+	UASSERTCMP(int, ==, result.size(), 2);
+	UASSERT(result[0] == saos[0] && result[1] == saos[1]);
+
+	// Moved objects are found at their new position only
+	saos[50]->setBasePosition(v3f(-10, 0, 10));
+	saomgr.updateObjectPosition(saos[50]);
+
+	result.clear();
+	saomgr.getObjectsInsideRadius(v3f(0, 0, 0), 120, result, nullptr);
+	UASSERTCMP(int, ==, result.size(), 3);
+	// Same order as without the index
+	UASSERT(result[0]->getId() < result[1]->getId());
+	UASSERT(result[1]->getId() < result[2]->getId());
+
+	result.clear();
+	saomgr.getObjectsInArea(aabb3f(4900, -1, -2600, 5100, 1, -2400), result, nullptr);
+	UASSERTCMP(int, ==, result.size(), 0);
+
+	// Removed objects are gone from the index too
+	u16 id = saos[0]->getId();
+	saomgr.removeObject(id);
+	result.clear();
+	saomgr.getObjectsInArea(aabb3f(-20, -1, -60, 110, 1, 20), result, nullptr);
+	UASSERTCMP(int, ==, result.size(), 2);
+
+	saomgr.clear();
+}
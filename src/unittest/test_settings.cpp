@@ -34,6 +34,7 @@ class TestSettings : public TestBase {
 	void testAllSettings();
 	void testDefaults();
 	void testFlagDesc();
+	void testSettingHandle();
 
 	static const char *config_text_before;
 	static const std::string config_text_after;
@@ -46,6 +47,7 @@ void TestSettings::runTests(IGameDef *gamedef)
 	TEST(testAllSettings);
 	TEST(testDefaults);
 	TEST(testFlagDesc);
+	TEST(testSettingHandle);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -294,3 +296,31 @@ void TestSettings::testFlagDesc()
 
 	delete &s;
 }
+
+void TestSettings::testSettingHandle()
+{
+	g_settings->set("test_setting_handle", "42");
+	{
+		SettingHandle<s16> handle("test_setting_handle");
+		UASSERTEQ(s16, handle.get(), 42);
+
+		// Follows changes
+		g_settings->setS16("test_setting_handle", -7);
+		UASSERTEQ(s16, handle.get(), -7);
+
+		// Keeps the last value when the setting goes away
+		g_settings->remove("test_setting_handle");
+		UASSERTEQ(s16, handle.get(), -7);
+
+		// Another handle of the same setting only removes its own callback
+		{
+			SettingHandle<s16> other("test_setting_handle");
+			g_settings->setS16("test_setting_handle", 3);
+			UASSERTEQ(s16, other.get(), 3);
+		}
+		g_settings->setS16("test_setting_handle", 5);
+		UASSERTEQ(s16, handle.get(), 5);
+	}
+
+	g_settings->remove("test_setting_handle");
+}